@@ -0,0 +1,182 @@
+#include "bitPacking.h"
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static unsigned bitWidth(uint64_t value) {
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+static unsigned blockWidth(const uint64_t *values, size_t count) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < count; ++i) bits |= values[i];
+    return bitWidth(bits);
+}
+
+static size_t blockBytes(unsigned width) {
+    return 1 + width * BITPACK_BLOCK / 8;
+}
+
+// Packs 128 values of at most width (1-32) bits into width * 4 words.
+static void packLanes(const uint32_t *values, unsigned width, uint8_t *out) {
+    std::vector<uint32_t> words(width * 4, 0);
+    for (unsigned lane = 0; lane < 4; ++lane) {
+        unsigned bit = 0;
+        for (unsigned j = 0; j < BITPACK_BLOCK / 4; ++j, bit += width) {
+            uint64_t v = values[j * 4 + lane];
+            unsigned word = bit / 32, shift = bit % 32;
+            words[word * 4 + lane] |= static_cast<uint32_t>(v << shift);
+            if (shift + width > 32) words[(word + 1) * 4 + lane] |= static_cast<uint32_t>(v >> (32 - shift));
+        }
+    }
+    std::memcpy(out, words.data(), words.size() * sizeof(uint32_t));
+}
+
+#if defined(__SSE2__)
+template <unsigned W>
+static void unpackLanes(const uint8_t *in, uint32_t *values) {
+    const __m128i mask = _mm_set1_epi32(W == 32 ? -1 : static_cast<int>((1u << W) - 1));
+    const __m128i *words = reinterpret_cast<const __m128i*>(in);
+    __m128i cur = _mm_loadu_si128(words++);
+#pragma GCC unroll 32
+    for (unsigned j = 0; j < BITPACK_BLOCK / 4; ++j) {
+        const unsigned shift = (j * W) % 32;
+        __m128i v = _mm_srli_epi32(cur, shift);
+        if (shift + W > 32) {
+            cur = _mm_loadu_si128(words++);
+            v = _mm_or_si128(v, _mm_slli_epi32(cur, 32 - shift));
+        } else if (shift + W == 32 && j + 1 < BITPACK_BLOCK / 4) {
+            cur = _mm_loadu_si128(words++);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + j * 4), _mm_and_si128(v, mask));
+    }
+}
+#else
+template <unsigned W>
+static void unpackLanes(const uint8_t *in, uint32_t *values) {
+    const uint64_t mask = (uint64_t(1) << W) - 1;
+    for (unsigned lane = 0; lane < 4; ++lane) {
+        for (unsigned j = 0; j < BITPACK_BLOCK / 4; ++j) {
+            unsigned bit = j * W, word = bit / 32, shift = bit % 32;
+            uint32_t lo, hi = 0;
+            std::memcpy(&lo, in + (word * 4 + lane) * 4, 4);
+            if (shift + W > 32) std::memcpy(&hi, in + ((word + 1) * 4 + lane) * 4, 4);
+            uint64_t v = ((uint64_t(hi) << 32) | lo) >> shift;
+            values[j * 4 + lane] = static_cast<uint32_t>(v & mask);
+        }
+    }
+}
+#endif
+
+using UnpackKernel = void (*)(const uint8_t*, uint32_t*);
+
+template <unsigned... W>
+static constexpr std::array<UnpackKernel, sizeof...(W)> unpackKernels(std::integer_sequence<unsigned, W...>) {
+    return {unpackLanes<W + 1>...};
+}
+
+// Kernels for widths 1-32, each fully unrolled for its width.
+static constexpr auto UNPACK = unpackKernels(std::make_integer_sequence<unsigned, 32>());
+
+static void unpackLanes(const uint8_t *in, unsigned width, uint32_t *values) {
+    UNPACK[width - 1](in, values);
+}
+
+size_t bitPackedSize(const std::vector<uint64_t> &deltas) {
+    size_t bytes = 0;
+    for (size_t start = 0; start < deltas.size(); start += BITPACK_BLOCK) {
+        size_t n = std::min(BITPACK_BLOCK, deltas.size() - start);
+        bytes += blockBytes(blockWidth(deltas.data() + start, n));
+    }
+    return bytes;
+}
+
+void bitPack(std::vector<uint8_t> &out, const std::vector<uint64_t> &deltas) {
+    uint32_t lo[BITPACK_BLOCK], hi[BITPACK_BLOCK];
+    for (size_t start = 0; start < deltas.size(); start += BITPACK_BLOCK) {
+        size_t n = std::min(BITPACK_BLOCK, deltas.size() - start);
+        unsigned width = blockWidth(deltas.data() + start, n);
+        for (size_t i = 0; i < BITPACK_BLOCK; ++i) {
+            uint64_t v = i < n ? deltas[start + i] : 0;
+            lo[i] = static_cast<uint32_t>(v);
+            hi[i] = static_cast<uint32_t>(v >> 32);
+        }
+        size_t at = out.size();
+        out.resize(at + blockBytes(width));
+        out[at] = static_cast<uint8_t>(width);
+        uint8_t *words = out.data() + at + 1;
+        if (width == 0) continue;
+        unsigned low = std::min(width, 32u);
+        packLanes(lo, low, words);
+        if (width > 32) packLanes(hi, width - 32, words + low * BITPACK_BLOCK / 8);
+    }
+}
+
+bool bitUnpack(std::string_view data, size_t count, int64_t base, std::vector<int64_t> &out) {
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(data.data());
+    size_t pos = 0;
+    uint32_t lo[BITPACK_BLOCK], hi[BITPACK_BLOCK];
+    size_t at = out.size();
+    out.resize(at + count);
+    int64_t *values = out.data() + at;
+    for (size_t start = 0; start < count; start += BITPACK_BLOCK) {
+        size_t n = std::min(BITPACK_BLOCK, count - start);
+        if (pos >= data.size() || in[pos] > 64 || pos + blockBytes(in[pos]) > data.size()) {
+            out.resize(at + start);
+            return false;
+        }
+        unsigned width = in[pos];
+        const uint8_t *words = in + pos + 1;
+        pos += blockBytes(width);
+        if (width == 0) {
+            std::fill(values + start, values + start + n, base);
+            continue;
+        }
+        unsigned low = std::min(width, 32u);
+        unpackLanes(words, low, lo);
+        if (width > 32) {
+            unpackLanes(words + low * BITPACK_BLOCK / 8, width - 32, hi);
+            for (size_t i = 0; i < n; ++i) {
+                values[start + i] = static_cast<int64_t>(((uint64_t(hi[i]) << 32) | lo[i]) + static_cast<uint64_t>(base));
+            }
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                values[start + i] = static_cast<int64_t>(lo[i] + static_cast<uint64_t>(base));
+            }
+        }
+    }
+    return true;
+}
+
+bool bitUnpackCodes(std::string_view data, size_t count, std::vector<uint32_t> &out) {
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(data.data());
+    size_t pos = 0;
+    uint32_t block[BITPACK_BLOCK];
+    size_t at = out.size();
+    out.resize(at + count);
+    uint32_t *values = out.data() + at;
+    for (size_t start = 0; start < count; start += BITPACK_BLOCK) {
+        size_t n = std::min(BITPACK_BLOCK, count - start);
+        if (pos >= data.size() || in[pos] > 32 || pos + blockBytes(in[pos]) > data.size()) {
+            out.resize(at + start);
+            return false;
+        }
+        unsigned width = in[pos];
+        const uint8_t *words = in + pos + 1;
+        pos += blockBytes(width);
+        if (width == 0) {
+            std::fill(values + start, values + start + n, 0);
+        } else if (n == BITPACK_BLOCK) {
+            unpackLanes(words, width, values + start);
+        } else {
+            unpackLanes(words, width, block);
+            std::copy(block, block + n, values + start);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Frame-of-reference bit packing of non-negative deltas in blocks of 128
+// values. Every block starts with its bit width (0-64) and is laid out in the
+// four-lane interleaved order of SIMD-BP128: value i belongs to lane i % 4 and
+// the lanes are packed side by side into 32-bit words, so one 128-bit load
+// unpacks four values at once. Widths above 32 store the low 32 bits first and
+// the remaining high bits as a second packed block.
+
+inline constexpr size_t BITPACK_BLOCK = 128;
+
+// Size of bitPack's output for the given deltas.
+size_t bitPackedSize(const std::vector<uint64_t> &deltas);
+
+void bitPack(std::vector<uint8_t> &out, const std::vector<uint64_t> &deltas);
+
+// Appends count values (base + delta) to out; false when data is truncated.
+bool bitUnpack(std::string_view data, size_t count, int64_t base, std::vector<int64_t> &out);
+
+// Same for data packed from values of at most 32 bits (dictionary codes).
+bool bitUnpackCodes(std::string_view data, size_t count, std::vector<uint32_t> &out);
@@ -1,11 +1,16 @@
 #include "codec_int.h"
+#include "bitPacking.h"
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 
 struct EncodeIntColumn {
     string name;
     vector<uint8_t> compressed_data;
     int64_t delta_base;
+    int64_t max_value;
+    uint32_t row_count;
+    uint8_t codec;
 };
 
 static void variableLengthEncoding(vector<uint8_t> &compressed_data, const vector<uint64_t> &column) {
@@ -24,13 +29,15 @@ static void variableLengthEncoding(vector<uint8_t> &compressed_data, const vecto
     }
 }
 
-static void variableLengthDecoding(const vector<uint8_t> &compressed_data, vector<uint64_t> &out) {
+// Decodes the varint deltas straight from the stored bytes into values.
+static void variableLengthDecoding(std::string_view compressed_data, int64_t base, vector<int64_t> &out) {
     uint64_t value = 0;
     unsigned shift = 0;
-    for (uint8_t chunk : compressed_data) {
+    for (char c : compressed_data) {
+        uint8_t chunk = static_cast<uint8_t>(c);
         value |= (uint64_t)(chunk & 0x7F) << shift;
         if ((chunk & 0x80) == 0) {
-            out.push_back(value);
+            out.push_back(static_cast<int64_t>(value + static_cast<uint64_t>(base)));
             value = 0;
             shift = 0;
         } else {
@@ -39,84 +46,268 @@ static void variableLengthDecoding(const vector<uint8_t> &compressed_data, vecto
     }
 }
 
+static size_t varintSize(uint64_t v) {
+    return v == 0 ? 1 : (64 - __builtin_clzll(v) + 6) / 7;
+}
+
+static size_t variableLengthSize(const vector<uint64_t> &column) {
+    size_t bytes = 0;
+    for (uint64_t v : column) bytes += varintSize(v);
+    return bytes;
+}
+
+// Offsets from the chunk minimum. They are taken in uint64_t, so a chunk
+// spanning more than INT64_MAX still wraps around instead of overflowing.
 static vector<uint64_t> deltaEncoding(const vector<int64_t> &column, int64_t base) {
     vector<uint64_t> out;
     out.reserve(column.size());
     for (size_t i = 0; i < column.size(); ++i) {
-        int64_t diff = column[i] - base;
-        out.push_back(static_cast<uint64_t>(diff));
+        out.push_back(static_cast<uint64_t>(column[i]) - static_cast<uint64_t>(base));
     }
     return out;
 }
 
-static vector<int64_t> deltaDecoding(const vector<uint64_t> &diffs, int64_t base) {
+// Differences between neighbours, with wrap-around so any int64 input works.
+static vector<int64_t> differences(const vector<int64_t> &column) {
     vector<int64_t> out;
-    out.reserve(diffs.size());
-    for (size_t i = 0; i < diffs.size(); ++i) {
-        out.push_back(static_cast<int64_t>(diffs[i]) + base);
+    if (column.size() < 2) return out;
+    out.reserve(column.size() - 1);
+    for (size_t i = 1; i < column.size(); ++i) {
+        out.push_back(static_cast<int64_t>(static_cast<uint64_t>(column[i]) - static_cast<uint64_t>(column[i - 1])));
     }
     return out;
 }
 
+static vector<uint64_t> frameOfReference(const vector<int64_t> &values, int64_t &base) {
+    base = values.empty() ? 0 : *min_element(values.begin(), values.end());
+    vector<uint64_t> out;
+    out.reserve(values.size());
+    for (int64_t v : values) out.push_back(static_cast<uint64_t>(v) - static_cast<uint64_t>(base));
+    return out;
+}
+
+static void appendInt(vector<uint8_t> &out, int64_t value) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+static size_t runLengthSize(const vector<uint64_t> &column) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < column.size();) {
+        size_t j = i;
+        while (j < column.size() && column[j] == column[i]) j++;
+        bytes += varintSize(column[i]) + varintSize(j - i);
+        i = j;
+    }
+    return bytes;
+}
+
+static void runLengthEncoding(vector<uint8_t> &out, const vector<uint64_t> &column) {
+    vector<uint64_t> pairs;
+    for (size_t i = 0; i < column.size();) {
+        size_t j = i;
+        while (j < column.size() && column[j] == column[i]) j++;
+        pairs.push_back(column[i]);
+        pairs.push_back(j - i);
+        i = j;
+    }
+    variableLengthEncoding(out, pairs);
+}
+
 EncodeIntColumn compressIntColumn(IntColumn& column) {
     EncodeIntColumn out;
     out.name = column.name;
+    out.row_count = static_cast<uint32_t>(column.column.size());
+    out.codec = INT_CODEC_CONSTANT;
     if (column.column.empty()) {
         out.delta_base = 0;
+        out.max_value = 0;
         out.compressed_data.clear();
         return out;
     }
-    auto min_it = min_element(column.column.begin(), column.column.end());
+    auto [min_it, max_it] = minmax_element(column.column.begin(), column.column.end());
     out.delta_base = *min_it;
+    out.max_value = *max_it;
+    if (out.delta_base == out.max_value) return out;
+
+    // Every candidate is sized over the whole chunk (a single batch, so this
+    // stays cheap) and the smallest one wins. Candidates are listed from the
+    // cheapest to decode, so ties go to the faster decoder.
     vector<uint64_t> modified = deltaEncoding(column.column, out.delta_base);
-    variableLengthEncoding(out.compressed_data, modified);
+    vector<int64_t> steps = differences(column.column);
+    vector<int64_t> steps2 = differences(steps);
+    int64_t steps_base = 0, steps2_base = 0;
+    vector<uint64_t> packed_steps = frameOfReference(steps, steps_base);
+    vector<uint64_t> packed_steps2 = frameOfReference(steps2, steps2_base);
+
+    vector<pair<IntCodec, size_t>> candidates = {
+        {INT_CODEC_RAW, column.column.size() * sizeof(int64_t)},
+        {INT_CODEC_BITPACK, bitPackedSize(modified)},
+        {INT_CODEC_RLE, runLengthSize(modified)},
+        {INT_CODEC_DELTA, sizeof(int64_t) * 2 + bitPackedSize(packed_steps)},
+        {INT_CODEC_VARINT, variableLengthSize(modified)},
+    };
+    if (column.column.size() > 2) {
+        candidates.push_back({INT_CODEC_DELTA_OF_DELTA, sizeof(int64_t) * 3 + bitPackedSize(packed_steps2)});
+    }
+    auto best = min_element(candidates.begin(), candidates.end(),
+                            [](const auto &a, const auto &b) { return a.second < b.second; });
+    out.codec = best->first;
+
+    switch (out.codec) {
+    case INT_CODEC_RAW:
+        for (int64_t v : column.column) appendInt(out.compressed_data, v);
+        break;
+    case INT_CODEC_BITPACK:
+        bitPack(out.compressed_data, modified);
+        break;
+    case INT_CODEC_RLE:
+        runLengthEncoding(out.compressed_data, modified);
+        break;
+    case INT_CODEC_DELTA:
+        appendInt(out.compressed_data, column.column[0]);
+        appendInt(out.compressed_data, steps_base);
+        bitPack(out.compressed_data, packed_steps);
+        break;
+    case INT_CODEC_DELTA_OF_DELTA:
+        appendInt(out.compressed_data, column.column[0]);
+        appendInt(out.compressed_data, steps[0]);
+        appendInt(out.compressed_data, steps2_base);
+        bitPack(out.compressed_data, packed_steps2);
+        break;
+    default:
+        variableLengthEncoding(out.compressed_data, modified);
+        break;
+    }
     return out;
 }
 
-IntColumn decodeSingleIntColumn(EncodeIntColumn& column) {
-    IntColumn out;
-    out.name = column.name;
-    vector<uint64_t> diffs;
-    variableLengthDecoding(column.compressed_data, diffs);
-    out.column = deltaDecoding(diffs, column.delta_base);
-    return out;
+static uint64_t readIntColumnHeader(ByteReader &in, EncodeIntColumn &column, uint32_t version) {
+    uint64_t prev_ptr = in.read<uint64_t>();
+
+    uint32_t name_len = in.read<uint32_t>();
+    column.name = string(in.bytes(name_len));
+
+    column.delta_base = in.read<int64_t>();
+    column.max_value = 0;
+    column.row_count = 0;
+    column.codec = INT_CODEC_VARINT;
+    if (version >= 2) {
+        column.max_value = in.read<int64_t>();
+        column.row_count = in.read<uint32_t>();
+    }
+    if (version >= 3) {
+        column.codec = in.read<uint8_t>();
+    }
+    return prev_ptr;
 }
 
-pair<uint64_t, IntColumn> decodeIntColumn(ifstream &in) {
+pair<uint64_t, ChunkStats> readIntColumnStats(ByteReader &in, uint32_t version) {
     EncodeIntColumn column;
-    uint64_t prev_ptr = 0;
-    in.read((char *)(&prev_ptr), sizeof(prev_ptr));
+    uint64_t prev_ptr = readIntColumnHeader(in, column, version);
+    ChunkStats stats;
+    stats.valid = version >= 2 && column.row_count > 0;
+    stats.rowCount = column.row_count;
+    stats.intMin = column.delta_base;
+    stats.intMax = column.max_value;
+    return {prev_ptr, stats};
+}
 
-    uint32_t name_len = 0;
-    in.read((char *)(&name_len), sizeof(name_len));
-    column.name.resize(name_len);
-    if (name_len > 0) {
-        in.read(&column.name[0], name_len);
+static int64_t readInt(std::string_view &data) {
+    int64_t value = 0;
+    if (data.size() < sizeof(value)) {
+        data = {};
+        return 0;
     }
+    memcpy(&value, data.data(), sizeof(value));
+    data.remove_prefix(sizeof(value));
+    return value;
+}
 
-    in.read((char *)(&column.delta_base), sizeof(column.delta_base));
+// Turns differences of the given order, stored after the first value(s),
+// back into values.
+static void prefixSums(vector<int64_t> &values, size_t order) {
+    for (size_t pass = order; pass > 0; --pass) {
+        for (size_t i = pass; i < values.size(); ++i) {
+            values[i] = static_cast<int64_t>(static_cast<uint64_t>(values[i]) + static_cast<uint64_t>(values[i - 1]));
+        }
+    }
+}
 
-    uint32_t compressed_bits_length = 0;
-    in.read((char *)(&compressed_bits_length), sizeof(compressed_bits_length));
-    column.compressed_data.resize(static_cast<size_t>(compressed_bits_length));
-    if (compressed_bits_length > 0) {
-        in.read((char *)(column.compressed_data.data()), compressed_bits_length);
+static bool decodeIntPayload(std::string_view data, const EncodeIntColumn &column, vector<int64_t> &out) {
+    size_t rows = column.row_count;
+    switch (column.codec) {
+    case INT_CODEC_CONSTANT:
+        out.assign(rows, column.delta_base);
+        return true;
+    case INT_CODEC_RAW:
+        if (data.size() != rows * sizeof(int64_t)) return false;
+        out.resize(rows);
+        if (rows > 0) memcpy(out.data(), data.data(), data.size());
+        return true;
+    case INT_CODEC_BITPACK:
+        return bitUnpack(data, rows, column.delta_base, out);
+    case INT_CODEC_RLE: {
+        vector<int64_t> pairs;
+        variableLengthDecoding(data, 0, pairs);
+        out.reserve(rows);
+        for (size_t i = 0; i + 1 < pairs.size(); i += 2) {
+            if (static_cast<uint64_t>(pairs[i + 1]) > rows - out.size()) return false;
+            int64_t value = static_cast<int64_t>(static_cast<uint64_t>(pairs[i]) + static_cast<uint64_t>(column.delta_base));
+            out.insert(out.end(), static_cast<size_t>(pairs[i + 1]), value);
+        }
+        return true;
+    }
+    case INT_CODEC_DELTA:
+    case INT_CODEC_DELTA_OF_DELTA: {
+        size_t order = column.codec == INT_CODEC_DELTA ? 1 : 2;
+        if (rows < order) return false;
+        out.reserve(rows);
+        for (size_t i = 0; i < order; ++i) out.push_back(readInt(data));
+        int64_t base = readInt(data);
+        if (!bitUnpack(data, rows - order, base, out)) return false;
+        prefixSums(out, order);
+        return true;
     }
+    case INT_CODEC_VARINT:
+        out.reserve(rows);
+        variableLengthDecoding(data, column.delta_base, out);
+        return true;
+    }
+    return false;
+}
 
-    IntColumn out = decodeSingleIntColumn(column);
+pair<uint64_t, IntColumn> decodeIntColumn(ByteReader &in, uint32_t version) {
+    EncodeIntColumn column;
+    uint64_t prev_ptr = readIntColumnHeader(in, column, version);
+
+    uint32_t compressed_bits_length = in.read<uint32_t>();
+    std::string_view compressed_data = in.bytes(compressed_bits_length);
+
+    IntColumn out;
+    out.name = move(column.name);
+    if (!decodeIntPayload(compressed_data, column, out.column) || out.column.size() != column.row_count) {
+        cerr << "decodeIntColumn: corrupt chunk of column " << out.name << "\n";
+    }
     return {prev_ptr, move(out)};
 }
 
-uint64_t encodeSingleIntColumn(ofstream& out, IntColumn& column){
+uint64_t encodeSingleIntColumn(ofstream& out, IntColumn& column, ChunkStats& stats){
     EncodeIntColumn col = compressIntColumn(column);
     uint32_t len = static_cast<uint32_t>(col.name.size());
     uint32_t compressed_bits_length = static_cast<uint32_t>(col.compressed_data.size());
     int64_t delta_base = col.delta_base;
+    int64_t max_value = col.max_value;
+    uint32_t row_count = col.row_count;
+    uint8_t codec = col.codec;
 
     out.write((char*)&len, sizeof(len));
     out.write(col.name.data(), len);
 
     out.write((char*)&delta_base, sizeof(delta_base));
+    out.write((char*)&max_value, sizeof(max_value));
+    out.write((char*)&row_count, sizeof(row_count));
+    out.write((char*)&codec, sizeof(codec));
 
     out.write((char*)&compressed_bits_length, sizeof(compressed_bits_length));
     if (compressed_bits_length > 0) {
@@ -127,13 +318,21 @@ uint64_t encodeSingleIntColumn(ofstream& out, IntColumn& column){
     total += sizeof(len);
     total += static_cast<uint64_t>(len);
     total += sizeof(delta_base);
+    total += sizeof(max_value);
+    total += sizeof(row_count);
+    total += sizeof(codec);
     total += sizeof(compressed_bits_length);
     total += static_cast<uint64_t>(compressed_bits_length);
+
+    stats.valid = row_count > 0;
+    stats.rowCount = row_count;
+    stats.intMin = delta_base;
+    stats.intMax = max_value;
     return total;
 }
 
-void decodeIntColumns(ifstream& in, vector<IntColumn>& columns, uint32_t length) {
+void decodeIntColumns(ByteReader& in, vector<IntColumn>& columns, uint32_t length, uint32_t version) {
     for (uint32_t j = 0; j < length; j++) {
-        columns.push_back(decodeIntColumn(in).second);
+        columns.push_back(decodeIntColumn(in, version).second);
     }
 }
\ No newline at end of file
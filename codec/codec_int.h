@@ -6,10 +6,25 @@
 #include <utility>
 
 #include "../types.h"
+#include "../serialization/mappedFile.h"
 
+// Encoding of a chunk, stored in its header since format v3. VARINT and
+// BITPACK store value - delta_base; DELTA and DELTA_OF_DELTA store the first
+// value(s) and bit-pack the differences of the given order.
+enum IntCodec : uint8_t {
+    INT_CODEC_VARINT = 0,
+    INT_CODEC_BITPACK = 1,
+    INT_CODEC_CONSTANT = 2,
+    INT_CODEC_RLE = 3,
+    INT_CODEC_DELTA = 4,
+    INT_CODEC_DELTA_OF_DELTA = 5,
+    INT_CODEC_RAW = 6
+};
 
-uint64_t encodeSingleIntColumn(std::ofstream& out, IntColumn& column);
+uint64_t encodeSingleIntColumn(std::ofstream& out, IntColumn& column, ChunkStats& stats);
 
-void decodeIntColumns(std::ifstream& in, std::vector<IntColumn>& columns, uint32_t length); 
+void decodeIntColumns(ByteReader& in, std::vector<IntColumn>& columns, uint32_t length, uint32_t version);
 
-std::pair<uint64_t, IntColumn> decodeIntColumn(std::ifstream& in);
+std::pair<uint64_t, IntColumn> decodeIntColumn(ByteReader& in, uint32_t version);
+
+std::pair<uint64_t, ChunkStats> readIntColumnStats(ByteReader& in, uint32_t version);
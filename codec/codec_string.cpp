@@ -1,94 +1,373 @@
 #include "codec_string.h"
 #include <zstd.h>
+#include "bitPacking.h"
+#include "fsst.h"
+#include "zstdDictionary.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
 
 struct EncodeStringColumn {
     string name;
     vector<uint8_t> compressed_data;
     uint32_t uncompressed_size;  
     uint32_t compressed_size;
+    uint32_t row_count;
+    string min_prefix;
+    string max_prefix;
+    uint8_t codec;
 };
 
-StringColumn decodeSingleStringColumn(EncodeStringColumn& column) {
-
-    StringColumn out;
-    out.name = move(column.name);
-
-    string decompressed(column.uncompressed_size, '\0');
-    ZSTD_decompress(
-        decompressed.data(),
-        column.uncompressed_size,
-        column.compressed_data.data(),
-        column.compressed_size
-    );
+// Dictionary encoding pays off once values repeat on average this many times.
+static constexpr size_t DICTIONARY_MIN_REPEATS = 4;
+// FSST chunks are kept while at most this much larger than zstd ones, since
+// their values are read and compared without decompressing the whole chunk.
+static constexpr double FSST_MAX_OVERHEAD = 1.1;
 
+static void splitValues(std::string_view blob, vector<std::string_view> &values) {
     size_t start = 0;
-    for (size_t i = 0; i < decompressed.size(); ++i) {
-        if (decompressed[i] == '\0') {
-            out.column.emplace_back(decompressed.substr(start, i - start));
+    for (size_t i = 0; i < blob.size(); ++i) {
+        if (blob[i] == '\0') {
+            values.push_back(blob.substr(start, i - start));
             start = i + 1;
         }
     }
-    return out;
 }
 
-pair<uint64_t, StringColumn> decodeStringColumn(ifstream& in) {
+// Value lengths, bit-packed and prefixed with their byte size. The offset of
+// a value is the running sum of the lengths before it.
+template <typename Values>
+static void appendLengths(vector<uint8_t>& out, const Values& values) {
+    vector<uint64_t> lengths;
+    lengths.reserve(values.size());
+    for (const auto &v : values) lengths.push_back(v.size());
+    size_t at = out.size();
+    out.resize(at + sizeof(uint32_t));
+    bitPack(out, lengths);
+    uint32_t bytes = static_cast<uint32_t>(out.size() - at - sizeof(uint32_t));
+    memcpy(out.data() + at, &bytes, sizeof(bytes));
+}
+
+// Reads count lengths written by appendLengths from the front of payload and
+// turns them into count + 1 offsets.
+static bool readOffsets(std::string_view& payload, size_t count, vector<uint32_t>& offsets) {
+    uint32_t bytes = 0;
+    if (payload.size() < sizeof(bytes)) return false;
+    memcpy(&bytes, payload.data(), sizeof(bytes));
+    payload.remove_prefix(sizeof(bytes));
+    if (bytes > payload.size()) return false;
+    offsets.clear();
+    offsets.reserve(count + 1);
+    offsets.push_back(0);
+    if (!bitUnpackCodes(payload.substr(0, bytes), count, offsets)) return false;
+    payload.remove_prefix(bytes);
+    uint64_t end = 0;
+    for (size_t i = 1; i <= count; ++i) {
+        end += offsets[i];
+        if (end > UINT32_MAX) return false;
+        offsets[i] = static_cast<uint32_t>(end);
+    }
+    return true;
+}
+
+static void viewsFromOffsets(std::string_view data, const vector<uint32_t>& offsets, vector<std::string_view>& values) {
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+        values.push_back(data.substr(offsets[i], offsets[i + 1] - offsets[i]));
+    }
+}
+
+static void readPrefix(ByteReader& in, string& prefix) {
+    uint8_t len = in.read<uint8_t>();
+    prefix = string(in.bytes(len));
+}
+
+static void writePrefix(ofstream& out, const string& prefix) {
+    uint8_t len = static_cast<uint8_t>(prefix.size());
+    out.write((char *)(&len), sizeof(len));
+    if (len > 0) out.write(prefix.data(), len);
+}
+
+static uint64_t readStringColumnHeader(ByteReader& in, EncodeStringColumn& column, uint32_t version) {
+    uint64_t prev_ptr = in.read<uint64_t>();
+
+    uint32_t name_len = in.read<uint32_t>();
+    column.name = string(in.bytes(name_len));
+
+    column.uncompressed_size = in.read<uint32_t>();
+    column.compressed_size = in.read<uint32_t>();
+    column.row_count = 0;
+    if (version >= 2) {
+        column.row_count = in.read<uint32_t>();
+        readPrefix(in, column.min_prefix);
+        readPrefix(in, column.max_prefix);
+    }
+    column.codec = STRING_CODEC_BLOB;
+    if (version >= 4) {
+        column.codec = in.read<uint8_t>();
+    }
+    return prev_ptr;
+}
+
+pair<uint64_t, ChunkStats> readStringColumnStats(ByteReader& in, uint32_t version) {
     EncodeStringColumn column;
-    uint64_t prev_ptr = 0;
-    in.read((char *)(&prev_ptr), sizeof(prev_ptr));
+    uint64_t prev_ptr = readStringColumnHeader(in, column, version);
+    ChunkStats stats;
+    stats.valid = version >= 2 && column.row_count > 0;
+    stats.rowCount = column.row_count;
+    stats.strMin = move(column.min_prefix);
+    stats.strMax = move(column.max_prefix);
+    return {prev_ptr, stats};
+}
 
-    string name;
-    uint32_t name_len;
-    uint32_t uncompressed_size;
-    uint32_t compressed_size;
+// Splits a dictionary payload into views of its entries and the row codes.
+static bool readDictionary(std::string_view payload, uint32_t version, uint32_t row_count, vector<std::string_view>& entries, vector<uint32_t>& codes) {
+    uint32_t count = 0;
+    if (payload.size() < sizeof(count)) return false;
+    memcpy(&count, payload.data(), sizeof(count));
+    payload.remove_prefix(sizeof(count));
+    entries.reserve(count);
+    if (version >= 5) {
+        vector<uint32_t> offsets;
+        if (!readOffsets(payload, count, offsets) || offsets.back() > payload.size()) return false;
+        viewsFromOffsets(payload, offsets, entries);
+        payload.remove_prefix(offsets.back());
+    } else {
+        uint32_t bytes = 0;
+        if (payload.size() < sizeof(bytes)) return false;
+        memcpy(&bytes, payload.data(), sizeof(bytes));
+        payload.remove_prefix(sizeof(bytes));
+        if (bytes > payload.size()) return false;
+        splitValues(payload.substr(0, bytes), entries);
+        payload.remove_prefix(bytes);
+    }
+    if (entries.size() != count) return false;
+    if (!bitUnpackCodes(payload, row_count, codes)) return false;
+    for (uint32_t code : codes) {
+        if (code >= count) return false;
+    }
+    return true;
+}
 
-    in.read((char *)(&name_len), sizeof(name_len));
-    name.resize(name_len);
-    if (name_len > 0) {
-        in.read(&name[0], name_len);
+void materializeStrings(StringColumn& column) {
+    if (column.symbols) {
+        std::string_view data = *column.data;
+        column.column.clear();
+        column.column.resize(column.rowCount());
+        for (size_t i = 0; i + 1 < column.offsets.size(); ++i) {
+            if (!fsstDecompress(*column.symbols, data.substr(column.offsets[i], column.offsets[i + 1] - column.offsets[i]), column.column[i])) {
+                cerr << "materializeStrings: corrupt FSST value in column " << column.name << "\n";
+            }
+        }
+        column.symbols.reset();
+        column.data.reset();
+        column.offsets.clear();
+        column.offsets.shrink_to_fit();
+    } else if (column.dictionary) {
+        const vector<string> &dictionary = *column.dictionary;
+        column.column.clear();
+        column.column.reserve(column.codes.size());
+        for (uint32_t code : column.codes) column.column.push_back(dictionary[code]);
+        column.dictionary.reset();
+        column.codes.clear();
+        column.codes.shrink_to_fit();
+    } else if (column.data) {
+        const string &data = *column.data;
+        column.column.clear();
+        column.column.reserve(column.rowCount());
+        for (size_t i = 0; i + 1 < column.offsets.size(); ++i) {
+            column.column.emplace_back(data, column.offsets[i], column.offsets[i + 1] - column.offsets[i]);
+        }
+        column.data.reset();
+        column.offsets.clear();
+        column.offsets.shrink_to_fit();
     }
-    column.name = move(name);
+}
 
-    in.read((char *)(&uncompressed_size), sizeof(uncompressed_size));
-    in.read((char *)(&compressed_size), sizeof(compressed_size));
-    column.uncompressed_size = uncompressed_size;
-    column.compressed_size = compressed_size;
-    column.compressed_data.resize(static_cast<size_t>(compressed_size));
-    if (compressed_size > 0) {
-        in.read((char *)(column.compressed_data.data()), compressed_size);
+pair<uint64_t, StringColumn> decodeStringColumn(ByteReader& in, uint32_t version, bool compact) {
+    EncodeStringColumn column;
+    uint64_t prev_ptr = readStringColumnHeader(in, column, version);
+    std::string_view stored = in.bytes(column.compressed_size);
+
+    if (column.codec == STRING_CODEC_DICTIONARY) {
+        StringColumn out;
+        out.name = move(column.name);
+        vector<std::string_view> entries;
+        if (!readDictionary(stored, version, column.row_count, entries, out.codes)) {
+            cerr << "decodeStringColumn: corrupt dictionary chunk of column " << out.name << "\n";
+            out.codes.clear();
+            return {prev_ptr, move(out)};
+        }
+        out.dictionary = std::make_shared<const vector<string>>(entries.begin(), entries.end());
+        if (!compact) materializeStrings(out);
+        return {prev_ptr, move(out)};
+    }
+
+    if (column.codec == STRING_CODEC_OFFSETS) {
+        StringColumn out;
+        out.name = move(column.name);
+        if (!readOffsets(stored, column.row_count, out.offsets) || out.offsets.back() != column.uncompressed_size) {
+            cerr << "decodeStringColumn: corrupt chunk of column " << out.name << "\n";
+            out.offsets.clear();
+            return {prev_ptr, move(out)};
+        }
+        // All values of the chunk share one buffer.
+        auto data = std::make_shared<string>();
+        if (stored.size() == column.uncompressed_size) {
+            data->assign(stored);
+        } else {
+            data->resize(column.uncompressed_size);
+            size_t res = decompressChunk(data->data(), data->size(), stored.data(), stored.size());
+            if (ZSTD_isError(res) || res != data->size()) {
+                cerr << "ZSTD decompression error: " << (ZSTD_isError(res) ? ZSTD_getErrorName(res) : "size mismatch") << "\n";
+                out.offsets.clear();
+                return {prev_ptr, move(out)};
+            }
+        }
+        out.data = move(data);
+        if (!compact) materializeStrings(out);
+        return {prev_ptr, move(out)};
     }
 
-    return {prev_ptr, decodeSingleStringColumn(column)};
+    if (column.codec == STRING_CODEC_FSST) {
+        StringColumn out;
+        out.name = move(column.name);
+        auto symbols = std::make_shared<SymbolTable>();
+        if (!readSymbolTable(stored, *symbols) || !readOffsets(stored, column.row_count, out.offsets) || out.offsets.back() != stored.size()) {
+            cerr << "decodeStringColumn: corrupt FSST chunk of column " << out.name << "\n";
+            out.offsets.clear();
+            return {prev_ptr, move(out)};
+        }
+        out.symbols = move(symbols);
+        out.data = std::make_shared<const string>(stored);
+        if (!compact) materializeStrings(out);
+        return {prev_ptr, move(out)};
+    }
+
+    // Raw chunks are split in place; compressed ones are decompressed from
+    // the stored bytes without copying them first. Files before version 3
+    // always compressed, so equal sizes only mark a raw chunk from v3 on.
+    string decompressed;
+    std::string_view blob = stored;
+    if (version < 3 || column.compressed_size != column.uncompressed_size) {
+        decompressed.resize(column.uncompressed_size);
+        size_t res = decompressChunk(decompressed.data(), decompressed.size(), stored.data(), stored.size());
+        if (ZSTD_isError(res)) {
+            cerr << "ZSTD decompression error: " << ZSTD_getErrorName(res) << "\n";
+            decompressed.clear();
+        }
+        blob = decompressed;
+    }
+
+    vector<std::string_view> values;
+    values.reserve(column.row_count);
+    splitValues(blob, values);
+
+    StringColumn out;
+    out.name = move(column.name);
+    out.column.reserve(values.size());
+    for (std::string_view v : values) out.column.emplace_back(v);
+    return {prev_ptr, move(out)};
 }
 
-EncodeStringColumn* compressStringColumn(StringColumn& column) {
+// Payload: entry count, the lengths and bytes of the sorted distinct values,
+// then the bit-packed code of every row. Returns false when the chunk
+// has too many distinct values for a dictionary to pay off.
+static bool encodeDictionary(const StringColumn& column, vector<uint8_t>& payload) {
+    size_t rows = column.column.size();
+    size_t limit = rows / DICTIONARY_MIN_REPEATS;
+    if (rows == 0) return false;
+    std::unordered_map<std::string_view, uint32_t> codes;
+    for (const auto &s : column.column) {
+        codes.emplace(s, 0);
+        if (codes.size() > limit) return false;
+    }
+
+    vector<std::string_view> entries;
+    entries.reserve(codes.size());
+    for (const auto &kv : codes) entries.push_back(kv.first);
+    sort(entries.begin(), entries.end());
+
+    for (size_t i = 0; i < entries.size(); ++i) codes[entries[i]] = static_cast<uint32_t>(i);
+    vector<uint64_t> rowCodes;
+    rowCodes.reserve(rows);
+    for (const auto &s : column.column) rowCodes.push_back(codes[s]);
+
+    uint32_t count = static_cast<uint32_t>(entries.size());
+    payload.resize(sizeof(count));
+    memcpy(payload.data(), &count, sizeof(count));
+    appendLengths(payload, entries);
+    for (std::string_view e : entries) payload.insert(payload.end(), e.begin(), e.end());
+    bitPack(payload, rowCodes);
+    return true;
+}
+
+// Payload: the symbol table, the lengths of the compressed values, then the
+// compressed values.
+static void encodeFsst(const StringColumn& column, vector<uint8_t>& payload) {
+    SymbolTable table = buildSymbolTable(column.column);
+    writeSymbolTable(payload, table);
+    string data;
+    vector<uint32_t> ends;
+    ends.reserve(column.column.size());
+    for (const auto &s : column.column) {
+        fsstCompress(table, s, data);
+        ends.push_back(static_cast<uint32_t>(data.size()));
+    }
+    vector<std::string_view> values;
+    values.reserve(ends.size());
+    for (size_t i = 0; i < ends.size(); ++i) {
+        uint32_t begin = i == 0 ? 0 : ends[i - 1];
+        values.push_back(std::string_view(data).substr(begin, ends[i] - begin));
+    }
+    appendLengths(payload, values);
+    payload.insert(payload.end(), data.begin(), data.end());
+}
+
+EncodeStringColumn* compressStringColumn(StringColumn& column, const ColumnDictionary* dictionary) {
     auto* out = new EncodeStringColumn();
 
+    out->name = column.name;
+    out->row_count = static_cast<uint32_t>(column.column.size());
+    if (!column.column.empty()) {
+        auto [min_it, max_it] = minmax_element(column.column.begin(), column.column.end());
+        out->min_prefix = min_it->substr(0, STATS_PREFIX_LEN);
+        out->max_prefix = max_it->substr(0, STATS_PREFIX_LEN);
+    }
+
+    if (encodeDictionary(column, out->compressed_data)) {
+        out->codec = STRING_CODEC_DICTIONARY;
+        out->uncompressed_size = out->compressed_size = static_cast<uint32_t>(out->compressed_data.size());
+        return out;
+    }
+
+    // Payload: the value lengths, then the concatenated values. The sizes in
+    // the header describe the values only.
+    out->codec = STRING_CODEC_OFFSETS;
     size_t total_size = 0;
     for (const auto &s : column.column) {
-        total_size += s.size() + 1; 
+        total_size += s.size();
     }
 
     string blob;
     blob.reserve(total_size);
     for (const auto &val : column.column) {
         blob.append(val);
-        blob.push_back('\0');
     }
 
-    out->name = column.name;
-
     size_t uncompressed_size = blob.size();
     out->uncompressed_size = static_cast<uint32_t>(uncompressed_size);
 
+    appendLengths(out->compressed_data, column.column);
+    size_t lengths_size = out->compressed_data.size();
     size_t bound = ZSTD_compressBound(uncompressed_size);
-    out->compressed_data.resize(bound);
+    out->compressed_data.resize(lengths_size + bound);
 
-    size_t compressed_size = ZSTD_compress(
-        out->compressed_data.data(),
-        out->compressed_data.size(),
+    size_t compressed_size = compressChunk(
+        out->compressed_data.data() + lengths_size,
+        bound,
         blob.data(),
         uncompressed_size,
-        compresion_level
+        dictionary
     );
 
     if (ZSTD_isError(compressed_size)) {
@@ -97,14 +376,28 @@ EncodeStringColumn* compressStringColumn(StringColumn& column) {
         return nullptr;
     }
 
-    out->compressed_data.resize(compressed_size);
-    out->compressed_size = static_cast<uint32_t>(compressed_size);
+    // Values zstd cannot shrink are stored raw, marked by a stored size equal
+    // to the uncompressed one, so they can be read without decompression.
+    if (compressed_size >= uncompressed_size) {
+        out->compressed_data.resize(lengths_size);
+        out->compressed_data.insert(out->compressed_data.end(), blob.begin(), blob.end());
+        compressed_size = uncompressed_size;
+    }
+    out->compressed_data.resize(lengths_size + compressed_size);
+
+    vector<uint8_t> fsst;
+    encodeFsst(column, fsst);
+    if (fsst.size() < lengths_size + uncompressed_size && fsst.size() <= out->compressed_data.size() * FSST_MAX_OVERHEAD) {
+        out->codec = STRING_CODEC_FSST;
+        out->compressed_data = move(fsst);
+    }
+    out->compressed_size = static_cast<uint32_t>(out->compressed_data.size());
 
     return out;
 }
 
-uint64_t encodeSingleStringColumn(ofstream& out, StringColumn& column){
-    EncodeStringColumn* col = compressStringColumn(column);
+uint64_t encodeSingleStringColumn(ofstream& out, StringColumn& column, ChunkStats& stats, const ColumnDictionary* dictionary){
+    EncodeStringColumn* col = compressStringColumn(column, dictionary);
     uint32_t len = (*col).name.size();
     uint32_t uncompressed_size = (*col).uncompressed_size;
     uint32_t compressed_size = (*col).compressed_size;
@@ -114,6 +407,10 @@ uint64_t encodeSingleStringColumn(ofstream& out, StringColumn& column){
 
     out.write((char *)(&uncompressed_size), sizeof(uncompressed_size));
     out.write((char *)(&compressed_size) , sizeof(compressed_size));
+    out.write((char *)(&(*col).row_count), sizeof((*col).row_count));
+    writePrefix(out, (*col).min_prefix);
+    writePrefix(out, (*col).max_prefix);
+    out.write((char *)(&(*col).codec), sizeof((*col).codec));
 
     if (compressed_size > 0) {
         out.write((char *)((*col).compressed_data.data()), compressed_size);
@@ -124,14 +421,22 @@ uint64_t encodeSingleStringColumn(ofstream& out, StringColumn& column){
     total += static_cast<uint64_t>(len);
     total += sizeof(uncompressed_size);
     total += sizeof(compressed_size);
+    total += sizeof((*col).row_count);
+    total += 2 * sizeof(uint8_t) + (*col).min_prefix.size() + (*col).max_prefix.size();
+    total += sizeof((*col).codec);
     total += static_cast<uint64_t>(compressed_size);
 
+    stats.valid = (*col).row_count > 0;
+    stats.rowCount = (*col).row_count;
+    stats.strMin = (*col).min_prefix;
+    stats.strMax = (*col).max_prefix;
+
     delete col;
     return total;
 }
 
-void decodeStringColumns(ifstream& in, vector<StringColumn>& columns, uint32_t length) {
+void decodeStringColumns(ByteReader& in, vector<StringColumn>& columns, uint32_t length, uint32_t version) {
     for (uint32_t j = 0; j < length; j++) {
-        columns.push_back(move(decodeStringColumn(in).second));
+        columns.push_back(move(decodeStringColumn(in, version).second));
     }
 }
\ No newline at end of file
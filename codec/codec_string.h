@@ -5,10 +5,37 @@
 #include <utility>
 
 #include "../types.h"
+#include "../serialization/mappedFile.h"
 
+// Encoding of a chunk, stored in its header since format v4.
+// - OFFSETS: bit-packed value lengths followed by the concatenated values,
+//   zstd-compressed unless that does not shrink them. Written since v5.
+// - DICTIONARY: the sorted distinct values followed by bit-packed codes,
+//   chosen for low-cardinality chunks. Since v5 the values are laid out as
+//   in OFFSETS (uncompressed).
+// - FSST: a symbol table, then the values compressed one by one with it
+//   (codec/fsst.h), laid out as in OFFSETS. Written since v6.
+// - BLOB: NUL-separated values, written up to v4.
+enum StringCodec : uint8_t {
+    STRING_CODEC_BLOB = 0,
+    STRING_CODEC_DICTIONARY = 1,
+    STRING_CODEC_OFFSETS = 2,
+    STRING_CODEC_FSST = 3
+};
 
-uint64_t encodeSingleStringColumn(std::ofstream& out, StringColumn& column);
+struct ColumnDictionary;
 
-void decodeStringColumns(std::ifstream& in, std::vector<StringColumn>& columns, uint32_t length); 
+// OFFSETS chunks are compressed with the column's zstd dictionary when given.
+uint64_t encodeSingleStringColumn(std::ofstream& out, StringColumn& column, ChunkStats& stats, const ColumnDictionary* dictionary = nullptr);
 
-std::pair<uint64_t, StringColumn> decodeStringColumn(std::ifstream& in);
+void decodeStringColumns(ByteReader& in, std::vector<StringColumn>& columns, uint32_t length, uint32_t version);
+
+// With compact, chunks are returned as dictionary and codes or as one buffer
+// with offsets (FSST chunks stay compressed), without materializing a string
+// per row.
+std::pair<uint64_t, StringColumn> decodeStringColumn(ByteReader& in, uint32_t version, bool compact = false);
+
+// Expands a compact column into one string per row.
+void materializeStrings(StringColumn& column);
+
+std::pair<uint64_t, ChunkStats> readStringColumnStats(ByteReader& in, uint32_t version);
@@ -0,0 +1,149 @@
+#include "fsst.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+// The table is trained on about this many bytes of the chunk's values.
+static constexpr size_t FSST_SAMPLE_BYTES = 16 * 1024;
+static constexpr int FSST_ROUNDS = 5;
+
+static void indexSymbols(SymbolTable &table) {
+    for (auto &codes : table.byFirstByte) codes.clear();
+    for (size_t c = 0; c < table.count; ++c) {
+        table.byFirstByte[static_cast<uint8_t>(table.symbols[c][0])].push_back(static_cast<uint8_t>(c));
+    }
+    for (auto &codes : table.byFirstByte) {
+        std::stable_sort(codes.begin(), codes.end(), [&](uint8_t a, uint8_t b) { return table.lengths[a] > table.lengths[b]; });
+    }
+}
+
+// Length of the longest symbol at the start of in (not empty); code is
+// FSST_ESCAPE when no symbol matches.
+static size_t longestMatch(const SymbolTable &table, std::string_view in, uint8_t &code) {
+    for (uint8_t c : table.byFirstByte[static_cast<uint8_t>(in[0])]) {
+        size_t len = table.lengths[c];
+        if (len <= in.size() && std::memcmp(table.symbols[c], in.data(), len) == 0) {
+            code = c;
+            return len;
+        }
+    }
+    code = FSST_ESCAPE;
+    return 1;
+}
+
+// Each round compresses the sample with the current table, counts the
+// symbols it used and the concatenations of neighbouring symbols, and keeps
+// the 255 candidates that cover the most bytes.
+SymbolTable buildSymbolTable(const std::vector<std::string> &values) {
+    size_t total = 0;
+    for (const auto &v : values) total += v.size();
+    size_t step = std::max<size_t>(1, total / FSST_SAMPLE_BYTES);
+    std::vector<std::string_view> sample;
+    for (size_t i = 0; i < values.size(); i += step) sample.push_back(values[i]);
+
+    SymbolTable table;
+    for (int round = 0; round < FSST_ROUNDS; ++round) {
+        std::unordered_map<std::string_view, size_t> counts;
+        for (std::string_view value : sample) {
+            std::string_view prev;
+            size_t pos = 0;
+            while (pos < value.size()) {
+                uint8_t code;
+                size_t len = longestMatch(table, value.substr(pos), code);
+                std::string_view symbol = value.substr(pos, len);
+                counts[symbol]++;
+                if (!prev.empty() && prev.size() + len <= FSST_SYMBOL_BYTES) {
+                    counts[std::string_view(prev.data(), prev.size() + len)]++;
+                }
+                prev = symbol;
+                pos += len;
+            }
+        }
+
+        std::vector<std::pair<size_t, std::string_view>> ranked;
+        ranked.reserve(counts.size());
+        for (const auto &kv : counts) ranked.emplace_back(kv.second * kv.first.size(), kv.first);
+        size_t keep = std::min(FSST_MAX_SYMBOLS, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(), [](const auto &a, const auto &b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+        SymbolTable next;
+        next.count = keep;
+        for (size_t c = 0; c < keep; ++c) {
+            next.lengths[c] = static_cast<uint8_t>(ranked[c].second.size());
+            std::memcpy(next.symbols[c], ranked[c].second.data(), ranked[c].second.size());
+        }
+        indexSymbols(next);
+        table = std::move(next);
+    }
+    return table;
+}
+
+// Layout: symbol count (u8), the symbol lengths (u8 each), the symbol bytes.
+void writeSymbolTable(std::vector<uint8_t> &out, const SymbolTable &table) {
+    out.push_back(static_cast<uint8_t>(table.count));
+    out.insert(out.end(), table.lengths, table.lengths + table.count);
+    for (size_t c = 0; c < table.count; ++c) {
+        out.insert(out.end(), table.symbols[c], table.symbols[c] + table.lengths[c]);
+    }
+}
+
+bool readSymbolTable(std::string_view &in, SymbolTable &table) {
+    if (in.empty()) return false;
+    table.count = static_cast<uint8_t>(in[0]);
+    in.remove_prefix(1);
+    if (in.size() < table.count) return false;
+    size_t bytes = 0;
+    for (size_t c = 0; c < table.count; ++c) {
+        table.lengths[c] = static_cast<uint8_t>(in[c]);
+        if (table.lengths[c] == 0 || table.lengths[c] > FSST_SYMBOL_BYTES) return false;
+        bytes += table.lengths[c];
+    }
+    in.remove_prefix(table.count);
+    if (in.size() < bytes) return false;
+    for (size_t c = 0; c < table.count; ++c) {
+        std::memset(table.symbols[c], 0, FSST_SYMBOL_BYTES);
+        std::memcpy(table.symbols[c], in.data(), table.lengths[c]);
+        in.remove_prefix(table.lengths[c]);
+    }
+    indexSymbols(table);
+    return true;
+}
+
+void fsstCompress(const SymbolTable &table, std::string_view value, std::string &out) {
+    while (!value.empty()) {
+        uint8_t code;
+        size_t len = longestMatch(table, value, code);
+        out.push_back(static_cast<char>(code));
+        if (code == FSST_ESCAPE) out.push_back(value[0]);
+        value.remove_prefix(len);
+    }
+}
+
+// A code expands to at most 8 bytes, so the output is sized for that up
+// front and every symbol is copied as a whole 8-byte word.
+bool fsstDecompress(const SymbolTable &table, std::string_view codes, std::string &out) {
+    size_t at = out.size();
+    out.resize(at + codes.size() * FSST_SYMBOL_BYTES);
+    char *dst = out.data() + at;
+    for (size_t i = 0; i < codes.size(); ++i) {
+        uint8_t code = static_cast<uint8_t>(codes[i]);
+        if (code == FSST_ESCAPE) {
+            if (++i == codes.size()) {
+                out.resize(at);
+                return false;
+            }
+            *dst++ = codes[i];
+        } else if (code < table.count) {
+            std::memcpy(dst, table.symbols[code], FSST_SYMBOL_BYTES);
+            dst += table.lengths[code];
+        } else {
+            out.resize(at);
+            return false;
+        }
+    }
+    out.resize(dst - out.data());
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Static symbol table compression in the style of FSST. A table holds up to
+// 255 symbols of 1-8 bytes; a value is compressed to one code byte per
+// symbol, and code 255 is followed by a literal byte that no symbol covers.
+// Every value is compressed on its own, so single values can be decompressed
+// (or compared) without touching the rest of the chunk. The encoder always
+// takes the longest matching symbol, so equal values compress to equal codes.
+
+inline constexpr size_t FSST_MAX_SYMBOLS = 255;
+inline constexpr size_t FSST_SYMBOL_BYTES = 8;
+inline constexpr uint8_t FSST_ESCAPE = 255;
+
+struct SymbolTable {
+    size_t count = 0;
+    uint8_t lengths[FSST_MAX_SYMBOLS] = {};
+    char symbols[FSST_MAX_SYMBOLS][FSST_SYMBOL_BYTES] = {};
+    // Codes of the symbols starting with each byte, longest first.
+    std::vector<uint8_t> byFirstByte[256];
+};
+
+// Builds a table for a chunk from a sample of its values.
+SymbolTable buildSymbolTable(const std::vector<std::string> &values);
+
+void writeSymbolTable(std::vector<uint8_t> &out, const SymbolTable &table);
+
+// Reads a table from the front of in; false when it is truncated.
+bool readSymbolTable(std::string_view &in, SymbolTable &table);
+
+// Appends the codes of value to out.
+void fsstCompress(const SymbolTable &table, std::string_view value, std::string &out);
+
+// Appends the value decoded from codes to out; false on invalid codes.
+bool fsstDecompress(const SymbolTable &table, std::string_view codes, std::string &out);
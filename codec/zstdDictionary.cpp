@@ -0,0 +1,232 @@
+#include "zstdDictionary.h"
+#include "../utils/utils.h"
+#include <zstd.h>
+#include <zstd_errors.h>
+#include <zdict.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Dictionaries are kept only when they shrink the first batches by this much.
+constexpr double DICTIONARY_MIN_GAIN = 0.05;
+constexpr size_t DICTIONARY_SAMPLE_PIECE = 4 * 1024;
+
+struct ThreadContexts {
+    ZSTD_CCtx *compression = ZSTD_createCCtx();
+    ZSTD_DCtx *decompression = ZSTD_createDCtx();
+
+    ~ThreadContexts() {
+        ZSTD_freeCCtx(compression);
+        ZSTD_freeDCtx(decompression);
+    }
+};
+
+ThreadContexts &contexts() {
+    thread_local ThreadContexts c;
+    return c;
+}
+
+struct DictionaryRegistry {
+    std::mutex mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<const ColumnDictionary>> byId;
+    std::unordered_map<std::string, ColumnDictionaries> byFolder;
+};
+
+DictionaryRegistry &registry() {
+    static DictionaryRegistry r;
+    return r;
+}
+
+std::string normalizeFolder(const std::string &folder) {
+    fs::path p = fs::path(folder).lexically_normal();
+    if (!p.has_filename()) p = p.parent_path();
+    return p.string();
+}
+
+std::shared_ptr<const ColumnDictionary> makeDictionary(const std::string &column, std::string bytes) {
+    auto dictionary = std::make_shared<ColumnDictionary>();
+    dictionary->column = column;
+    dictionary->id = ZDICT_getDictID(bytes.data(), bytes.size());
+    dictionary->bytes = std::move(bytes);
+    if (dictionary->id == 0) return nullptr;
+    dictionary->cdict = ZSTD_createCDict(dictionary->bytes.data(), dictionary->bytes.size(), compresion_level);
+    dictionary->ddict = ZSTD_createDDict(dictionary->bytes.data(), dictionary->bytes.size());
+    if (!dictionary->cdict || !dictionary->ddict) return nullptr;
+    return dictionary;
+}
+
+// File layout: column name length (u16), column name, dictionary bytes.
+std::shared_ptr<const ColumnDictionary> readDictionaryFile(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    uint16_t nameLen = 0;
+    if (content.size() < sizeof(nameLen)) return nullptr;
+    std::memcpy(&nameLen, content.data(), sizeof(nameLen));
+    if (content.size() < sizeof(nameLen) + nameLen) return nullptr;
+    return makeDictionary(content.substr(sizeof(nameLen), nameLen), content.substr(sizeof(nameLen) + nameLen));
+}
+
+bool writeDictionaryFile(const std::string &folder, const ColumnDictionary &dictionary) {
+    fs::path path = fs::path(folder) / ("dict" + std::to_string(dictionary.id) + ".zdict");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint16_t nameLen = static_cast<uint16_t>(dictionary.column.size());
+    out.write(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
+    out.write(dictionary.column.data(), nameLen);
+    out.write(dictionary.bytes.data(), dictionary.bytes.size());
+    return static_cast<bool>(out);
+}
+
+bool isDictionaryFile(const fs::path &path) {
+    std::string name = path.filename().string();
+    return name.rfind("dict", 0) == 0 && path.extension() == ".zdict";
+}
+
+size_t compressedSize(const std::string &data, const ColumnDictionary *dictionary) {
+    std::string out(ZSTD_compressBound(data.size()), '\0');
+    size_t size = compressChunk(out.data(), out.size(), data.data(), data.size(), dictionary);
+    return ZSTD_isError(size) ? data.size() : size;
+}
+
+// Trains a dictionary on pieces of about DICTIONARY_SAMPLE_PIECE bytes of
+// whole values and keeps it when it pays off on the column's first batches.
+std::shared_ptr<const ColumnDictionary> trainColumn(const std::string &column, const std::vector<const StringColumn*> &chunks) {
+    std::string samples;
+    std::vector<size_t> sizes;
+    size_t piece = 0;
+    for (const StringColumn *chunk : chunks) {
+        for (const auto &value : chunk->column) {
+            if (samples.size() + value.size() > ZSTD_DICTIONARY_SAMPLE_BYTES) break;
+            samples.append(value);
+            piece += value.size();
+            if (piece >= DICTIONARY_SAMPLE_PIECE) {
+                sizes.push_back(piece);
+                piece = 0;
+            }
+        }
+    }
+    if (piece > 0) sizes.push_back(piece);
+    if (samples.size() < 8 * ZSTD_DICTIONARY_BYTES || sizes.size() < 8) return nullptr;
+
+    std::string bytes(ZSTD_DICTIONARY_BYTES, '\0');
+    size_t size = ZDICT_trainFromBuffer(bytes.data(), bytes.size(), samples.data(), sizes.data(), static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(size)) {
+        log_info(std::string("trainDictionaries: no dictionary for column ") + column + ": " + ZDICT_getErrorName(size));
+        return nullptr;
+    }
+    bytes.resize(size);
+    auto dictionary = makeDictionary(column, std::move(bytes));
+    if (!dictionary) return nullptr;
+
+    size_t plain = 0, trained = 0;
+    for (size_t c = 0; c < std::min<size_t>(chunks.size(), 2); ++c) {
+        std::string blob;
+        for (const auto &value : chunks[c]->column) blob.append(value);
+        plain += compressedSize(blob, nullptr);
+        trained += compressedSize(blob, dictionary.get());
+    }
+    if (trained + dictionary->bytes.size() / 4 > plain * (1.0 - DICTIONARY_MIN_GAIN)) return nullptr;
+    return dictionary;
+}
+
+}
+
+ColumnDictionary::~ColumnDictionary() {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+}
+
+size_t compressChunk(void *dst, size_t capacity, const void *src, size_t size, const ColumnDictionary *dictionary) {
+    ZSTD_CCtx *ctx = contexts().compression;
+    if (dictionary) return ZSTD_compress_usingCDict(ctx, dst, capacity, src, size, dictionary->cdict);
+    return ZSTD_compressCCtx(ctx, dst, capacity, src, size, compresion_level);
+}
+
+size_t decompressChunk(void *dst, size_t capacity, const void *src, size_t size) {
+    ZSTD_DCtx *ctx = contexts().decompression;
+    unsigned id = ZSTD_getDictID_fromFrame(src, size);
+    if (id == 0) return ZSTD_decompressDCtx(ctx, dst, capacity, src, size);
+
+    std::shared_ptr<const ColumnDictionary> dictionary;
+    {
+        DictionaryRegistry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        auto it = r.byId.find(id);
+        if (it != r.byId.end()) dictionary = it->second;
+    }
+    if (!dictionary) return static_cast<size_t>(-static_cast<int>(ZSTD_error_dictionary_wrong));
+    return ZSTD_decompress_usingDDict(ctx, dst, capacity, src, size, dictionary->ddict);
+}
+
+ColumnDictionaries loadDictionaries(const std::string &folder) {
+    std::string key = normalizeFolder(folder);
+    DictionaryRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    auto it = r.byFolder.find(key);
+    if (it != r.byFolder.end()) return it->second;
+
+    ColumnDictionaries loaded;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(key.empty() ? "." : key, ec)) {
+        if (!isDictionaryFile(entry.path())) continue;
+        auto dictionary = readDictionaryFile(entry.path());
+        if (!dictionary) {
+            log_error(std::string("loadDictionaries: invalid dictionary file ") + entry.path().string());
+            continue;
+        }
+        r.byId[dictionary->id] = dictionary;
+        loaded[dictionary->column] = dictionary;
+    }
+    r.byFolder[key] = loaded;
+    return loaded;
+}
+
+ColumnDictionaries trainDictionaries(const std::string &folder, const std::vector<Batch> &batches) {
+    ColumnDictionaries dictionaries = loadDictionaries(folder);
+    if (batches.empty()) return dictionaries;
+
+    for (const auto &first : batches[0].stringColumns) {
+        if (dictionaries.count(first.name)) continue;
+        std::vector<const StringColumn*> chunks;
+        for (const auto &batch : batches) {
+            for (const auto &col : batch.stringColumns) {
+                if (col.name == first.name) chunks.push_back(&col);
+            }
+        }
+        auto dictionary = trainColumn(first.name, chunks);
+        if (!dictionary) continue;
+        if (!writeDictionaryFile(folder, *dictionary)) {
+            log_error(std::string("trainDictionaries: cannot store dictionary for column ") + first.name);
+            continue;
+        }
+        log_info(std::string("trainDictionaries: trained dictionary ") + std::to_string(dictionary->id) + " for column " + first.name);
+        dictionaries[first.name] = dictionary;
+    }
+
+    DictionaryRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto &kv : dictionaries) r.byId[kv.second->id] = kv.second;
+    r.byFolder[normalizeFolder(folder)] = dictionaries;
+    return dictionaries;
+}
+
+void removeDictionaries(const std::string &folder) {
+    std::string key = normalizeFolder(folder);
+    DictionaryRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    auto it = r.byFolder.find(key);
+    if (it != r.byFolder.end()) {
+        for (const auto &kv : it->second) r.byId.erase(kv.second->id);
+        r.byFolder.erase(it);
+    }
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(key.empty() ? "." : key, ec)) {
+        if (isDictionaryFile(entry.path())) fs::remove(entry.path(), ec);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../types.h"
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+// A zstd dictionary trained for one string column of a table. It is stored
+// next to the table's part files as dict<id>.zdict. Compressed chunks carry the
+// dictionary id in their frame header, so the reader finds the dictionary
+// without extra metadata.
+struct ColumnDictionary {
+    std::string column;
+    uint32_t id = 0;
+    std::string bytes;
+    ZSTD_CDict_s *cdict = nullptr;
+    ZSTD_DDict_s *ddict = nullptr;
+
+    ~ColumnDictionary();
+};
+
+using ColumnDictionaries = std::unordered_map<std::string, std::shared_ptr<const ColumnDictionary>>;
+
+// Compression with this thread's reusable context; dictionary may be null.
+// Returns the compressed size or a zstd error code.
+size_t compressChunk(void *dst, size_t capacity, const void *src, size_t size, const ColumnDictionary *dictionary);
+
+// Decompression with this thread's reusable context, using the dictionary
+// named in the frame header. Returns the decompressed size or a zstd error
+// code.
+size_t decompressChunk(void *dst, size_t capacity, const void *src, size_t size);
+
+// Loads the dictionaries stored in a table directory; they are registered for
+// decompression. Already loaded directories are not read again.
+ColumnDictionaries loadDictionaries(const std::string &folder);
+
+// Trains dictionaries for the string columns of the batches that have none
+// yet, keeps those that improve compression and stores them in the folder.
+ColumnDictionaries trainDictionaries(const std::string &folder, const std::vector<Batch> &batches);
+
+void removeDictionaries(const std::string &folder);
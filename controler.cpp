@@ -2,6 +2,7 @@
 #include <iostream>
 #include "queries/queries.h"
 #include "results/results.h"
+#include "results/resultStream.h"
 #include "errors/errors.h"
 #include "metastore/metastore.h"
 #include <iostream>
@@ -14,6 +15,8 @@
 #include <nlohmann/json.hpp>
 #include <chrono>
 #include <utility>
+#include <functional>
+#include <cstdlib>
 
 #include "corvusoft/restbed/settings.hpp"
 #include "corvusoft/restbed/resource.hpp"
@@ -24,8 +27,11 @@
 #include "corvusoft/restbed/logger.hpp"
 
 #include "service/executionService.h"
+#include "service/queryScheduler.h"
 #include "utils/utils.h"
 #include "query/parser/selectQueryParser.h"
+#include "serialization/partFileCache.h"
+#include "serialization/bufferPool.h"
 
 
 
@@ -175,6 +181,42 @@ void getQueriesHandler(const shared_ptr<Session> session) {
     closeConnection(session, 200, getQueries().dump() );
 }
 
+std::unique_ptr<QueryScheduler> scheduler;
+
+void failQuery(const string &query_id, const string &message) {
+    changeStatus(query_id, QueryStatus::FAILED);
+    addError(query_id, createErrorResponse(message));
+}
+
+void runCopyQuery(const CopyQuery &copyQuery, const string &query_id) {
+    changeStatus(query_id, QueryStatus::PLANNING);
+    QueryCreatedResponse response = copyCSV(copyQuery, query_id);
+
+    if (response.status == CSV_TABLE_ERROR::NONE) {
+        changeStatus(query_id, QueryStatus::COMPLETED);
+        log_info("runCopyQuery - copy " + query_id + " completed");
+        return;
+    }
+    handleCsvError(query_id, response.status);
+    log_info("runCopyQuery - copy " + query_id + " failed");
+}
+
+void runSelectQuery(SelectQuery &selectQuery, const json &def, const string &query_id) {
+    changeStatus(query_id, QueryStatus::PLANNING);
+    SELECT_TABLE_ERROR response = selectTable(selectQuery, query_id);
+
+    if (response == SELECT_TABLE_ERROR::NONE) {
+        addQueryDefinitionRaw(query_id, def);
+        changeStatus(query_id, QueryStatus::COMPLETED);
+        log_info("runSelectQuery - select " + query_id + " completed");
+        return;
+    }
+    handleSelectError(query_id, selectQuery.tableName, response);
+    log_info("runSelectQuery - select " + query_id + " failed");
+}
+
+// Only cheap checks run here; the query itself is executed by the scheduler and
+// the client follows its status through GET /query/{queryId}.
 void submitQueryHandler(const shared_ptr<Session> session) {
     log_info("handler submitQueryHandler entered");
     int content_length = session->get_request()->get_header("Content-Length", 0);
@@ -198,50 +240,71 @@ void submitQueryHandler(const shared_ptr<Session> session) {
                 return;
             }
 
-            const auto &def = json_message["queryDefinition"];
+            const json def = json_message["queryDefinition"];
             string query_id = generateID();
             initQuery(query_id);
             json jsonResponse = query_id;
-            changeStatus(query_id, QueryStatus::PLANNING);
-            log_info("submitQuery changed status to PLANNING");
 
+            std::function<void()> job;
+            QueryLane lane = QueryLane::SELECT;
             switch(type) {
                 case QueryType::COPY: {
                     log_info("submitQuery handling COPY query");
-                    CopyQuery copyQuery = createCopyQuery(def); 
-                    
+                    auto copyQuery = std::make_shared<CopyQuery>();
+                    try {
+                        *copyQuery = createCopyQuery(def);
+                    } catch (const std::exception &e) {
+                        failQuery(query_id, std::string("Invalid COPY query: ") + e.what());
+                        closeConnection(session, 400, createErrorResponse(std::string("Invalid COPY query: ") + e.what()).dump());
+                        return;
+                    }
                     addQueryDefinitionRaw(query_id, def);
-                    QueryCreatedResponse response = copyCSV(copyQuery, query_id);
 
-                    if (response.status == CSV_TABLE_ERROR::NONE) {
-                        changeStatus(query_id, QueryStatus::COMPLETED);
-                        log_info("submitQuery - copy finished with status 200");
-                        closeConnection(session, 200, jsonResponse.dump());
+                    CSV_TABLE_ERROR precheck = CSV_TABLE_ERROR::NONE;
+                    if (!getTableDescriptor(copyQuery->destinationTableName)) precheck = CSV_TABLE_ERROR::TABLE_NOT_FOUND;
+                    else if (!std::filesystem::exists(copyQuery->path)) precheck = CSV_TABLE_ERROR::FILE_NOT_FOUND;
+                    if (precheck != CSV_TABLE_ERROR::NONE) {
+                        log_info("submitQuery - copy rejected with status 400");
+                        closeConnection(session, 400, handleCsvError(query_id, precheck));
                         return;
                     }
-                    log_info("submitQuery - copy finished with status 400");
-                    string error = handleCsvError(query_id, response.status);
-                    closeConnection(session, 400, error);
+
+                    lane = QueryLane::COPY;
+                    job = [copyQuery, query_id] { runCopyQuery(*copyQuery, query_id); };
                     break;
-                } 
+                }
                 case QueryType::SELECT: {
-                    SelectQuery sq = parseSelect(def);
-                    SELECT_TABLE_ERROR response = selectTable(sq, query_id);
-
-                    if (response == SELECT_TABLE_ERROR::NONE){
-                        addQueryDefinitionRaw(query_id, def);
-                        changeStatus(query_id, QueryStatus::COMPLETED);
-                        log_info("submitQuery - select finished with status 200");
-                        closeConnection(session, 200, jsonResponse.dump());
+                    auto selectQuery = std::make_shared<SelectQuery>();
+                    try {
+                        *selectQuery = parseSelect(def);
+                    } catch (const std::exception &e) {
+                        failQuery(query_id, std::string("Invalid SELECT query: ") + e.what());
+                        closeConnection(session, 400, createErrorResponse(std::string("Invalid SELECT query: ") + e.what()).dump());
                         return;
                     }
+                    job = [selectQuery, def, query_id] { runSelectQuery(*selectQuery, def, query_id); };
+                    break;
+                }
+                default:
+                    return;
+            }
 
-                    changeStatus(query_id, QueryStatus::FAILED);
-                    string error = "Table " + sq.tableName + " does not exist" ;
-                    log_info("submitQuery - select finished with status 400");
-                    closeConnection(session, 400, createErrorResponse(error).dump());
+            auto guarded = [job, query_id] {
+                try {
+                    job();
+                } catch (const std::exception &e) {
+                    log_error("submitQuery - query " + query_id + " threw: " + e.what());
+                    failQuery(query_id, std::string("Query execution failed: ") + e.what());
                 }
+            };
+            if (!scheduler->submit(lane, guarded)) {
+                log_info("submitQuery - queue full, rejected with status 503");
+                failQuery(query_id, "Too many queued queries");
+                closeConnection(session, 503, createErrorResponse("Too many queued queries").dump());
+                return;
             }
+            log_info("submitQuery - query " + query_id + " queued");
+            closeConnection(session, 200, jsonResponse.dump());
         }
     );
 }
@@ -274,6 +337,37 @@ void getQueryHandler(const shared_ptr<Session> session) {
     closeConnection(session, 200, response.dump());
 }
 
+static const char *ARROW_STREAM_MEDIA_TYPE = "application/vnd.apache.arrow.stream";
+
+static std::string httpChunk(const std::string &data) {
+    char size[20];
+    snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    return size + data + "\r\n";
+}
+
+// Sends the result body as HTTP chunks, producing the next piece only after the
+// previous one has been written.
+static void sendResultChunks(const shared_ptr<Session> session, const shared_ptr<ResultStream> stream, const std::string &queryId, bool flushResult) {
+    std::string piece;
+    bool more = stream->next(piece);
+    if (stream->failed()) {
+        session->close();
+        return;
+    }
+    if (more) {
+        session->yield(httpChunk(piece), [stream, queryId, flushResult](const shared_ptr<Session> s) {
+            sendResultChunks(s, stream, queryId, flushResult);
+        });
+        return;
+    }
+    session->close((piece.empty() ? std::string() : httpChunk(piece)) + "0\r\n\r\n");
+    log_info("handler getQueryResultHandler finished with status 200");
+    if (flushResult) {
+        removeResult(queryId);
+        log_info(std::string("handler getQueryResultHandler: flushed result for query ") + queryId);
+    }
+}
+
 void getQueryResultHandler(const shared_ptr<Session> session) {
     log_info("handler getQueryResultHandler entered");
     const auto request = session->get_request();
@@ -290,11 +384,12 @@ void getQueryResultHandler(const shared_ptr<Session> session) {
     session->fetch(content_length, [queryIdStr](const std::shared_ptr<restbed::Session> sess, const restbed::Bytes &body) {
         std::string json_body(body.begin(), body.end());
         int rowLimit = 0;
+        size_t offset = 0;
         bool flushResult = false;
         json parsed;
 
         json parseErr;
-        if (!parseResultRequestBody(json_body, rowLimit, flushResult, parseErr)) {
+        if (!parseResultRequestBody(json_body, rowLimit, offset, flushResult, parseErr)) {
             closeConnection(sess, 404, parseErr.dump());
             return;
         }
@@ -308,31 +403,28 @@ void getQueryResultHandler(const shared_ptr<Session> session) {
             return;
         }
 
-        optional<QueryResult> result = getQueryResult(queryIdStr, rowLimit);
-        if (!result.has_value()) {
+        bool finished = qresp->status == QueryStatus::COMPLETED || qresp->status == QueryStatus::FAILED;
+        bool arrow = sess->get_request()->get_header("Accept", std::string()).find(ARROW_STREAM_MEDIA_TYPE) != std::string::npos;
+        auto stream = std::make_shared<ResultStream>();
+        if (!stream->open(queryIdStr, rowLimit, offset, finished, arrow ? ResultFormat::ARROW : ResultFormat::JSON)) {
             log_info("handler getQueryResultHandler finished with status 400");
             json err = json::object();
             err["message"] = "Result of this query is not available";
             closeConnection(sess, 400, err.dump());
             return;
         }
-        QueryResult qr = result.value();
-
-        if (qr.rowCount == 0) {
-            json emptyResp = json::array();
-            closeConnection(sess, 200, emptyResp.dump());
-            return;
-        }
-
-        json response = json::array();
-        response.push_back(prepareQueryResultResponse(qr));
-        log_info("handler getQueryResultHandler finished with status 200");
-        closeConnection(sess, 200, response.dump());
 
-        if (flushResult) {
-            removeResult(queryIdStr);
-            log_info(std::string("handler getQueryResultHandler: flushed result for query ") + queryIdStr);
-        }
+        std::multimap<std::string, std::string> headers = {
+            {"Content-Type", arrow ? ARROW_STREAM_MEDIA_TYPE : "application/json"},
+            {"Transfer-Encoding", "chunked"}
+        };
+        if (arrow && stream->nextOffset().has_value()) headers.emplace("X-Next-Offset", std::to_string(*stream->nextOffset()));
+        // A running query keeps appending to its result, so it is only removed once finished.
+        bool removeAfter = flushResult && finished;
+        sess->yield(200, "", headers,
+            [stream, queryIdStr, removeAfter](const shared_ptr<Session> s) {
+                sendResultChunks(s, stream, queryIdStr, removeAfter);
+            });
     });
 }
 
@@ -384,12 +476,46 @@ void getSystemHandler(const shared_ptr<Session> session) {
     json info = getSystemInfo();
     int64_t uptime_secs = static_cast<int64_t>(std::floor(getUptimeSeconds()));
     info["uptime"] = uptime_secs;
+    info["queuedQueries"] = json::object({{"copy", scheduler->queued(QueryLane::COPY)}, {"select", scheduler->queued(QueryLane::SELECT)}});
+    info["runningQueries"] = json::object({{"copy", scheduler->running(QueryLane::COPY)}, {"select", scheduler->running(QueryLane::SELECT)}});
+    BufferPoolStats pool = bufferPoolStats();
+    info["bufferPool"] = json::object({{"budgetBytes", pool.budget}, {"usedBytes", pool.bytes}, {"chunks", pool.chunks},
+        {"hits", pool.hits}, {"misses", pool.misses}, {"evictions", pool.evictions}});
     closeConnection(session, 200, info.dump());
 }
 
+size_t settingFromEnv(const char *name, size_t fallback) {
+    const char *value = std::getenv(name);
+    if (!value) return fallback;
+    try {
+        return std::stoull(value);
+    } catch (const std::exception &e) {
+        log_error(std::string("invalid value of ") + name + ": " + value);
+        return fallback;
+    }
+}
+
+static std::vector<std::string> catalogPartFiles() {
+    std::vector<std::string> paths;
+    for (const auto &kv : getTables()) {
+        TableDescriptor table = getTableDescriptor(kv.second);
+        if (!table) continue;
+        for (const auto &f : table->files) paths.push_back(partFilePath(table->location, f));
+    }
+    return paths;
+}
+
 int main(){
 
     startTime = std::chrono::steady_clock::now();
+    loadCatalog();
+    setBufferPoolBudget(settingFromEnv("BUFFER_POOL_BYTES", DEFAULT_BUFFER_POOL_BYTES));
+    warmPartFileCache(catalogPartFiles());
+
+    scheduler = std::make_unique<QueryScheduler>(
+        settingFromEnv("COPY_WORKERS", DEFAULT_COPY_WORKERS),
+        settingFromEnv("SELECT_WORKERS", DEFAULT_SELECT_WORKERS),
+        settingFromEnv("QUERY_QUEUE_DEPTH", DEFAULT_QUERY_QUEUE_DEPTH));
 
     auto tablesResource = make_shared<Resource>();
     tablesResource->set_path("/tables");
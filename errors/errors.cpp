@@ -1,12 +1,15 @@
 #include "errors.h"
 #include "../utils/utils.h"
+#include <mutex>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 
 static const filesystem::path basePath =  filesystem::current_path() / "errors/errors.json";
+static std::mutex errorsMutex;
 
 std::optional<QueryError> getQueryError(std::string id){
+    std::lock_guard<std::mutex> lock(errorsMutex);
     json data = readLocalFile(basePath);
     for (const auto &entry : data) {
         if (!entry.is_object()) continue;
@@ -29,6 +32,7 @@ std::optional<QueryError> getQueryError(std::string id){
 }
 
 void addError(std::string id, json multipleProblemsError){
+    std::lock_guard<std::mutex> lock(errorsMutex);
     json data = readLocalFile(basePath);
 
     json problems = json::array();
@@ -5,111 +5,179 @@
 #include <nlohmann/json.hpp>
 #include <fstream>
 #include <iostream>
+#include <iomanip>
 #include <filesystem>
+#include <mutex>
+#include <shared_mutex>
 
 #include "metastore.h"
 #include "../utils/utils.h"
+#include "../serialization/partFileCache.h"
+#include "../codec/zstdDictionary.h"
 
 using namespace std;
 
 static const filesystem::path basePath =  filesystem::current_path() / "metastore/metastore.json";
 
-std::optional<TableInfo> getTableInfoByName(const std::string& name) {
-    json meta = readLocalFile(basePath);
-    if (!meta.is_object()) {
-        meta = json::object();
-        meta["tables"] = json::object();
-    } else if (!meta.contains("tables") || !meta["tables"].is_object()) {
-        meta["tables"] = json::object();
+// The catalog lives in memory and metastore.json is only written. Readers get
+// shared pointers to immutable TableInfo snapshots; every change installs a new
+// snapshot, so a descriptor handed to a running query never changes under it.
+struct Catalog {
+    std::shared_mutex mutex;
+    std::once_flag loaded;
+    std::map<std::string, TableDescriptor> byName;
+    std::map<uint64_t, std::string> names;
+};
+
+static Catalog &catalog() {
+    static Catalog c;
+    return c;
+}
+
+static TableInfo tableFromJson(const std::string &name, const json &obj) {
+    TableInfo tableinfo;
+    tableinfo.name = name;
+    tableinfo.id = stoull(obj["id"].get<string>());
+    if (obj.contains("column_order") && obj["column_order"].is_array()) {
+        for (const auto &col_name_json : obj["column_order"]) {
+            std::string col_name = col_name_json.get<std::string>();
+            std::string col_type = obj["columns"].at(col_name).get<std::string>();
+            tableinfo.info.emplace_back(col_name, col_type);
+        }
+    } else {
+        for (auto &col : obj["columns"].items()) {
+            std::string col_name = col.key();
+            std::string col_type = col.value().get<string>();
+            tableinfo.info.emplace_back(col_name, col_type);
+        }
+    }
+    if (obj.contains("location") && obj["location"].is_string()) {
+        tableinfo.location = obj["location"].get<std::string>();
+    } else {
+        tableinfo.location = "";
     }
-    for (auto &kv : meta["tables"].items()) {
-        if (kv.key() == name){
-            const json &obj = kv.value();
-            TableInfo tableinfo;
-            tableinfo.name = name;
-            tableinfo.id = stoull(obj["id"].get<string>());
-            if (obj.contains("column_order") && obj["column_order"].is_array()) {
-                for (const auto &col_name_json : obj["column_order"]) {
-                    std::string col_name = col_name_json.get<std::string>();
-                    std::string col_type = obj["columns"].at(col_name).get<std::string>();
-                    tableinfo.info.emplace_back(col_name, col_type);
-                }
-            } else {
-                for (auto &col : obj["columns"].items()) {
-                    std::string col_name = col.key();
-                    std::string col_type = col.value().get<string>();
-                    tableinfo.info.emplace_back(col_name, col_type);
-                }
+    if (obj.contains("files") && obj["files"].is_array()) {
+        for (const auto &f : obj["files"]) {
+            if (f.is_string()) tableinfo.files.push_back(f.get<std::string>());
+        }
+    }
+    return tableinfo;
+}
+
+static json tableToJson(const TableInfo &table) {
+    json obj = json::object();
+    obj["id"] = std::to_string(table.id);
+    obj["columns"] = json::object();
+    obj["column_order"] = json::array();
+    for (const auto &col : table.info) {
+        obj["columns"][col.first] = col.second;
+        obj["column_order"].push_back(col.first);
+    }
+    obj["location"] = table.location;
+    obj["files"] = table.files;
+    return obj;
+}
+
+static void ensureLoaded() {
+    Catalog &c = catalog();
+    std::call_once(c.loaded, [&c] {
+        json meta = readLocalFile(basePath);
+        if (!meta.is_object() || !meta.contains("tables") || !meta["tables"].is_object()) return;
+        for (auto &kv : meta["tables"].items()) {
+            try {
+                auto table = std::make_shared<const TableInfo>(tableFromJson(kv.key(), kv.value()));
+                c.names[table->id] = table->name;
+                c.byName[table->name] = std::move(table);
+            } catch (const std::exception &e) {
+                log_error(std::string("loadCatalog: skipping invalid table entry ") + kv.key() + ": " + e.what());
             }
-            if (obj.contains("location") && obj["location"].is_string()) {
-                tableinfo.location = obj["location"].get<std::string>();
-            } else {
-                tableinfo.location = "";
+        }
+        log_info(std::string("loadCatalog: loaded ") + std::to_string(c.byName.size()) + " tables");
+    });
+}
+
+// Caller holds the exclusive lock. The file is replaced with rename(), so a
+// crash leaves either the old or the new catalog on disk, never a partial one.
+static void persistCatalog() {
+    Catalog &c = catalog();
+    json meta = json::object();
+    meta["tables"] = json::object();
+    for (const auto &kv : c.byName) meta["tables"][kv.first] = tableToJson(*kv.second);
+
+    try {
+        filesystem::create_directories(basePath.parent_path());
+        filesystem::path tmpPath = basePath;
+        tmpPath += ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::trunc);
+            if (!out.is_open()) {
+                log_error(std::string("persistCatalog: failed to open ") + tmpPath.string());
+                return;
             }
-            tableinfo.files.clear();
-            if (obj.contains("files") && obj["files"].is_array()) {
-                for (const auto &f : obj["files"]) {
-                    if (f.is_string()) tableinfo.files.push_back(f.get<std::string>());
-                }
+            out << std::setw(2) << meta << std::endl;
+            out.flush();
+            if (!out) {
+                log_error(std::string("persistCatalog: failed to write ") + tmpPath.string());
+                return;
             }
-            return tableinfo;
         }
+        filesystem::rename(tmpPath, basePath);
+    } catch (const std::exception &e) {
+        log_error(std::string("persistCatalog: ") + e.what());
     }
-    return nullopt;
 }
 
-std::optional<TableInfo> getTableInfo(uint64_t id) {
-    std::map<uint64_t, std::string> tables = getTables();
-    auto it = tables.find(id);
-    if (it == tables.end()) return std::nullopt;
-    return getTableInfoByName(it->second);
+void loadCatalog() {
+    ensureLoaded();
 }
 
-map<uint64_t, string> getTables(){
-    map<uint64_t, string> names;
-    json meta = readLocalFile(basePath);
-    if (!meta.is_object()) {
-        meta = json::object();
-        meta["tables"] = json::object();
-    } else if (!meta.contains("tables") || !meta["tables"].is_object()) {
-        meta["tables"] = json::object();
-    }
-    for (auto &kv : meta["tables"].items()) {
-        const std::string table_name = kv.key();
-        const json &obj = kv.value();
-        uint64_t id = stoull(obj["id"].get<string>());
-        names.insert({id, table_name});
-    }
-    return names;
+TableDescriptor getTableDescriptor(const std::string& name) {
+    ensureLoaded();
+    Catalog &c = catalog();
+    std::shared_lock<std::shared_mutex> lock(c.mutex);
+    auto it = c.byName.find(name);
+    if (it == c.byName.end()) return nullptr;
+    return it->second;
 }
 
-bool deleteTable(uint64_t id) {
-    map<uint64_t, string> tables = getTables();
-    auto it = tables.find(id);
-    if (it == tables.end()) return false;
-    const std::string name = it->second;
-
-    json meta = readLocalFile(basePath);
-    if (!meta.is_object()) {
-        meta = json::object();
-        meta["tables"] = json::object();
-    } else if (!meta.contains("tables") || !meta["tables"].is_object()) {
-        meta["tables"] = json::object();
-    }
-    if (!meta["tables"].contains(name)) return false;
-
-    const json &obj = meta["tables"][name];
+std::optional<TableInfo> getTableInfoByName(const std::string& name) {
+    TableDescriptor table = getTableDescriptor(name);
+    if (!table) return nullopt;
+    return *table;
+}
 
-    std::string location = obj["location"].get<std::string>();
+std::optional<TableInfo> getTableInfo(uint64_t id) {
+    ensureLoaded();
+    Catalog &c = catalog();
+    std::shared_lock<std::shared_mutex> lock(c.mutex);
+    auto it = c.names.find(id);
+    if (it == c.names.end()) return std::nullopt;
+    return *c.byName.at(it->second);
+}
 
-    std::vector<std::string> files;
+map<uint64_t, string> getTables(){
+    ensureLoaded();
+    Catalog &c = catalog();
+    std::shared_lock<std::shared_mutex> lock(c.mutex);
+    return c.names;
+}
 
-    for (const auto &f : obj["files"]) {
-        if (f.is_string()) files.push_back(f.get<std::string>());
+bool deleteTable(uint64_t id) {
+    ensureLoaded();
+    Catalog &c = catalog();
+    TableDescriptor table;
+    {
+        std::unique_lock<std::shared_mutex> lock(c.mutex);
+        auto it = c.names.find(id);
+        if (it == c.names.end()) return false;
+        table = c.byName.at(it->second);
+        c.byName.erase(it->second);
+        c.names.erase(it);
+        persistCatalog();
     }
-    removeFiles(location, files);
-    meta["tables"].erase(name);
-    saveFile(basePath, meta);
+    for (const auto &f : table->files) evictPartFile(partFilePath(table->location, f));
+    if (!table->location.empty()) removeDictionaries(table->location);
+    removeFiles(table->location, table->files);
     return true;
 }
 
@@ -122,15 +190,11 @@ CreateTableResult createTable(const json& json_info) {
     std::string table_name = it.key();
     const json &obj = it.value();
 
-    json meta = readLocalFile(basePath);
-    if (!meta.is_object()) {
-        meta = json::object();
-        meta["tables"] = json::object();
-    } else if (!meta.contains("tables") || !meta["tables"].is_object()) {
-        meta["tables"] = json::object();
-    }
+    ensureLoaded();
+    Catalog &c = catalog();
+    std::unique_lock<std::shared_mutex> lock(c.mutex);
 
-    if (meta["tables"].contains(table_name)) {
+    if (c.byName.count(table_name)) {
         Problem p; p.error = "Table with name " + table_name + " already exists !";
         problems.push_back(p);
         result.problem = problems;
@@ -147,13 +211,14 @@ CreateTableResult createTable(const json& json_info) {
         return result;
     }
 
-    json new_entry = json::object();
-    new_entry["id"] = generateID();
+    TableInfo table;
+    table.name = table_name;
+    std::string id = generateID();
+    table.id = stoull(id);
 
-    new_entry["columns"] = json::object();
-    for (auto &c : obj["columns"].items()) {
-        const std::string col_name = c.key();
-        const json &col_type_json = c.value();
+    for (auto &col : obj["columns"].items()) {
+        const std::string col_name = col.key();
+        const json &col_type_json = col.value();
         if (!col_type_json.is_string()) {
             Problem p; p.error = "column " + col_name + " has invalid type, it should be VARCHAR or INT64";
             problems.push_back(p);
@@ -165,43 +230,31 @@ CreateTableResult createTable(const json& json_info) {
             problems.push_back(p);
             continue;
         }
-        new_entry["columns"][col_name] = col_type;
+        table.info.emplace_back(col_name, col_type);
     }
     if (!problems.empty()) {
         result.problem = problems;
         return result;
     }
-    new_entry["location"] = "";
-    new_entry["files"] = json::array();
 
-    meta["tables"][table_name] = new_entry;
-    saveFile(basePath, meta);
+    c.names[table.id] = table_name;
+    c.byName[table_name] = std::make_shared<const TableInfo>(std::move(table));
+    persistCatalog();
 
-    result.tableId = new_entry["id"];
+    result.tableId = id;
     return result;
 }
 
 void addLocationAndFiles(uint64_t id, const std::string &location, const std::vector<std::string> &files) {
+    ensureLoaded();
+    Catalog &c = catalog();
+    std::unique_lock<std::shared_mutex> lock(c.mutex);
+    auto it = c.names.find(id);
+    if (it == c.names.end()) return;
 
-    json data = readLocalFile(basePath);
-    if (!data.is_object()) {
-        data = json::object();
-        data["tables"] = json::object();
-    } else if (!data.contains("tables") || !data["tables"].is_object()) {
-        data["tables"] = json::object();
-    }
-    std::map<uint64_t, std::string> tables = getTables();
-    auto it = tables.find(id);
-    if (it == tables.end()) return;
-    const std::string name = it->second;
-
-    data["tables"][name]["location"] = location;
-    if (!data["tables"][name].contains("files") || !data["tables"][name]["files"].is_array()) {
-        data["tables"][name]["files"] = json::array();
-    }
-    for (const auto &f : files) data["tables"][name]["files"].push_back(f);
-    saveFile(basePath, data);
+    TableInfo updated = *c.byName.at(it->second);
+    updated.location = location;
+    updated.files.insert(updated.files.end(), files.begin(), files.end());
+    c.byName[it->second] = std::make_shared<const TableInfo>(std::move(updated));
+    persistCatalog();
 }
-
-
-
@@ -6,6 +6,7 @@
 #include <optional>
 #include <cstdint>
 #include <map>
+#include <memory>
 
 #include <nlohmann/json.hpp>
 #include "../types.h"
@@ -20,6 +21,14 @@ struct TableInfo {
     std::vector<std::string> files;
 };
 
+using TableDescriptor = std::shared_ptr<const TableInfo>;
+
+// Reads metastore.json into the in-memory catalog. Called at startup; every
+// other function loads the catalog on first use as well.
+void loadCatalog();
+
+TableDescriptor getTableDescriptor(const std::string& name);
+
 std::map<uint64_t, std::string> getTables(); 
 
 std::optional<TableInfo> getTableInfo(uint64_t id);
@@ -4,12 +4,16 @@
 #include <iostream>
 #include <iomanip>
 #include "../utils/utils.h"
+#include <mutex>
 
 using namespace std;
 
 static const filesystem::path basePath =  filesystem::current_path() / "queries/queries.json";
+// Queries run on scheduler workers, so every read-modify-write of the file is serialised.
+static std::mutex queriesMutex;
 
 void initQuery(std::string id){
+    std::lock_guard<std::mutex> lock(queriesMutex);
     json results = readLocalFile(basePath);
 
     json new_entry = json::object();
@@ -22,6 +26,7 @@ void initQuery(std::string id){
 }
 
 void modifyStatus(std::string id, QueryStatus status) {
+    std::lock_guard<std::mutex> lock(queriesMutex);
     json results = readLocalFile(basePath);
 
     auto it = std::find_if(results.begin(), results.end(),
@@ -38,6 +43,7 @@ void modifyStatus(std::string id, QueryStatus status) {
 }
 
 std::optional<QueryResponse> getQueryResponse(const std::string &id) {
+    std::lock_guard<std::mutex> lock(queriesMutex);
     json results = readLocalFile(basePath);
 
     for (const auto &entry : results) {
@@ -71,6 +77,7 @@ std::optional<QueryResponse> getQueryResponse(const std::string &id) {
 }
 
 json getQueries(){
+    std::lock_guard<std::mutex> lock(queriesMutex);
     json results = readLocalFile(basePath);
     json out = json::array();
 
@@ -97,6 +104,7 @@ json getQueries(){
 }
 
 void changeStatus(std::string id, QueryStatus status) {
+    std::lock_guard<std::mutex> lock(queriesMutex);
     json results = readLocalFile(basePath);
 
     for (auto &entry : results) {
@@ -112,6 +120,7 @@ void changeStatus(std::string id, QueryStatus status) {
 }
 
 void addQueryDefinition(std::string id, QueryToJson query) {
+    std::lock_guard<std::mutex> lock(queriesMutex);
     json results = readLocalFile(basePath);
     for (auto &entry : results) {
         if (!entry.is_object()) continue;
@@ -125,6 +134,7 @@ void addQueryDefinition(std::string id, QueryToJson query) {
 }
 
 void addQueryDefinitionRaw(std::string id, const json &def) {
+    std::lock_guard<std::mutex> lock(queriesMutex);
     json results = readLocalFile(basePath);
     for (auto &entry : results) {
         if (!entry.is_object()) continue;
@@ -135,4 +145,18 @@ void addQueryDefinitionRaw(std::string id, const json &def) {
             saveFile(basePath, results);
         }
     }
+}
+
+void addQueryStatistics(std::string id, const json &statistics) {
+    std::lock_guard<std::mutex> lock(queriesMutex);
+    json results = readLocalFile(basePath);
+    for (auto &entry : results) {
+        if (!entry.is_object()) continue;
+
+        std::string entryQid = entry.value("queryId", std::string());
+        if (entryQid == id) {
+            entry["statistics"] = statistics;
+            saveFile(basePath, results);
+        }
+    }
 }
\ No newline at end of file
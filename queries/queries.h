@@ -18,3 +18,4 @@ void addQueryDefinition(std::string id, QueryToJson query);
 
 void addQueryDefinitionRaw(std::string id, const json &def);
 
+void addQueryStatistics(std::string id, const json &statistics);
@@ -114,6 +114,9 @@ static Value evalColumnExpressionInternal(const ColumnExpression &expr, const Re
             }
             return Value{ValueType::INT64, 0, std::string(), false};
         }
+
+        case ExprType::AGGREGATE:
+            throw std::runtime_error("Aggregates are evaluated only by HashAggregator");
     }
     return Value{ValueType::INT64, 0, std::string(), false};
 }
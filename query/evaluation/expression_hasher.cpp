@@ -63,6 +63,12 @@ size_t hashExpression(const ColumnExpression &expr) {
             break;
         }
 
+        case ExprType::AGGREGATE: {
+            mixHash(h, (size_t)expr.aggregate.function);
+            if (expr.aggregate.argument) mixHash(h, hashExpression(*expr.aggregate.argument));
+            break;
+        }
+
         case ExprType::FUNCTION: {
             mixHash(h, (size_t)expr.function.name);
             for (const auto &arg : expr.function.args) {
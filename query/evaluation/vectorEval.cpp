@@ -0,0 +1,408 @@
+#include "vectorEval.h"
+#include "expression_hasher.h"
+#include "../../codec/fsst.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+Value ColumnVector::valueAt(size_t i) const {
+    switch (type) {
+        case ValueType::INT64:
+            return Value{ValueType::INT64, intAt(i), std::string(), false};
+        case ValueType::VARCHAR:
+            return Value{ValueType::VARCHAR, 0, std::string(stringAt(i)), false};
+        case ValueType::BOOL:
+            return Value{ValueType::BOOL, 0, std::string(), boolAt(i)};
+    }
+    return Value{ValueType::INT64, 0, std::string(), false};
+}
+
+static std::shared_ptr<ColumnVector> makeVector(ValueType type, size_t rows, bool constant) {
+    auto v = std::make_shared<ColumnVector>();
+    v->type = type;
+    v->rows = rows;
+    v->constant = constant;
+    size_t n = constant ? 1 : rows;
+    switch (type) {
+        case ValueType::INT64:
+            v->intStorage.resize(n);
+            v->ints = v->intStorage.data();
+            break;
+        case ValueType::VARCHAR:
+            v->stringStorage.resize(n);
+            break;
+        case ValueType::BOOL:
+            v->boolStorage.resize(n);
+            v->bools = v->boolStorage.data();
+            break;
+    }
+    return v;
+}
+
+static void finalizeStrings(ColumnVector &v) {
+    v.stringViews.resize(v.stringStorage.size());
+    for (size_t i = 0; i < v.stringStorage.size(); ++i) v.stringViews[i] = v.stringStorage[i];
+    v.strings = v.stringViews.data();
+}
+
+template<typename In, typename Out, typename Op>
+static void applyBinary(const In *a, bool aConst, const In *b, bool bConst, Out *dst, size_t n, Op op) {
+    if (aConst && bConst) {
+        dst[0] = op(a[0], b[0]);
+    } else if (aConst) {
+        const In x = a[0];
+        for (size_t i = 0; i < n; ++i) dst[i] = op(x, b[i]);
+    } else if (bConst) {
+        const In y = b[0];
+        for (size_t i = 0; i < n; ++i) dst[i] = op(a[i], y);
+    } else {
+        for (size_t i = 0; i < n; ++i) dst[i] = op(a[i], b[i]);
+    }
+}
+
+template<typename Op>
+static ColumnVectorPtr intArithmetic(const ColumnVector &l, const ColumnVector &r, size_t rows, Op op) {
+    auto out = makeVector(ValueType::INT64, rows, l.constant && r.constant);
+    applyBinary(l.ints, l.constant, r.ints, r.constant, out->intStorage.data(), rows, op);
+    return out;
+}
+
+template<typename Op>
+static ColumnVectorPtr compareVectors(const ColumnVector &l, const ColumnVector &r, size_t rows, Op op) {
+    auto out = makeVector(ValueType::BOOL, rows, l.constant && r.constant);
+    uint8_t *dst = out->boolStorage.data();
+    auto cmp = [&op](const auto &a, const auto &b) -> uint8_t { return op(a, b) ? 1 : 0; };
+    switch (l.type) {
+        case ValueType::INT64:
+            applyBinary(l.ints, l.constant, r.ints, r.constant, dst, rows, cmp);
+            break;
+        case ValueType::VARCHAR:
+            applyBinary(l.strings, l.constant, r.strings, r.constant, dst, rows, cmp);
+            break;
+        case ValueType::BOOL:
+            applyBinary(l.bools, l.constant, r.bools, r.constant, dst, rows, cmp);
+            break;
+    }
+    return out;
+}
+
+// Compares a dictionary-encoded column with a string literal without looking
+// at the strings: the dictionary is sorted, so every comparison selects a
+// range of codes. Returns nullptr when the operands do not qualify.
+static ColumnVectorPtr compareCodes(Operator op, const ColumnVector &l, const ColumnVector &r, size_t rows) {
+    bool flipped = !l.dictionary;
+    const ColumnVector &col = flipped ? r : l;
+    const ColumnVector &lit = flipped ? l : r;
+    if (!col.dictionary || col.constant || !lit.constant || lit.type != ValueType::VARCHAR) return nullptr;
+    if (flipped) {
+        if (op == Operator::LESS_THAN) op = Operator::GREATER_THAN;
+        else if (op == Operator::GREATER_THAN) op = Operator::LESS_THAN;
+        else if (op == Operator::LESS_EQUAL) op = Operator::GREATER_EQUAL;
+        else if (op == Operator::GREATER_EQUAL) op = Operator::LESS_EQUAL;
+    }
+
+    const std::vector<std::string> &dict = *col.dictionary;
+    std::string_view value = lit.stringAt(0);
+    uint32_t lower = static_cast<uint32_t>(std::lower_bound(dict.begin(), dict.end(), value) - dict.begin());
+    uint32_t upper = static_cast<uint32_t>(std::upper_bound(dict.begin(), dict.end(), value) - dict.begin());
+    uint32_t from = 0, to = static_cast<uint32_t>(dict.size());
+    bool inside = true;
+    switch (op) {
+        case Operator::EQUAL: from = lower; to = upper; break;
+        case Operator::NOT_EQUAL: from = lower; to = upper; inside = false; break;
+        case Operator::LESS_THAN: to = lower; break;
+        case Operator::LESS_EQUAL: to = upper; break;
+        case Operator::GREATER_THAN: from = upper; break;
+        case Operator::GREATER_EQUAL: from = lower; break;
+        default: return nullptr;
+    }
+
+    auto out = makeVector(ValueType::BOOL, rows, false);
+    uint8_t *dst = out->boolStorage.data();
+    const uint32_t width = to - from;
+    for (size_t i = 0; i < rows; ++i) dst[i] = ((col.codes[i] - from) < width) == inside ? 1 : 0;
+    return out;
+}
+
+template<typename Op>
+static ColumnVectorPtr logical(const ColumnVector &l, const ColumnVector &r, size_t rows, Op op) {
+    auto out = makeVector(ValueType::BOOL, rows, l.constant && r.constant);
+    applyBinary(l.bools, l.constant, r.bools, r.constant, out->boolStorage.data(), rows, op);
+    return out;
+}
+
+template<typename Fn>
+static ColumnVectorPtr mapStrings(const std::vector<ColumnVectorPtr> &args, size_t rows, Fn fn) {
+    bool constant = true;
+    for (const auto &a : args) constant = constant && a->constant;
+    auto out = makeVector(ValueType::VARCHAR, rows, constant);
+    size_t n = constant ? 1 : rows;
+    for (size_t i = 0; i < n; ++i) out->stringStorage[i] = fn(i);
+    finalizeStrings(*out);
+    return out;
+}
+
+VectorEvaluator::VectorEvaluator(const BatchInput &input, const std::vector<uint32_t> *selection)
+    : input(input), selection(selection), numRows(selection ? selection->size() : input.num_rows) {}
+
+ColumnVectorPtr VectorEvaluator::eval(const ColumnExpression &expr) {
+    size_t h = hashExpression(expr);
+    auto it = cache.find(h);
+    if (it != cache.end()) return it->second;
+    ColumnVectorPtr v = evalInternal(expr);
+    cache.emplace(h, v);
+    return v;
+}
+
+ColumnVectorPtr VectorEvaluator::evalColumnRef(const ColumnReference &ref) {
+    if (ref.type == ValueType::INT64) {
+        if (ref.index >= input.intColumns.size() || !input.intColumns[ref.index])
+            throw std::runtime_error("Column index out of range in evaluation");
+        const std::vector<int64_t> &col = *input.intColumns[ref.index];
+        auto v = std::make_shared<ColumnVector>();
+        v->type = ValueType::INT64;
+        v->rows = numRows;
+        if (!selection) {
+            v->ints = col.data();
+        } else {
+            v->intStorage.resize(numRows);
+            for (size_t i = 0; i < numRows; ++i) v->intStorage[i] = col[(*selection)[i]];
+            v->ints = v->intStorage.data();
+        }
+        return v;
+    }
+    if (ref.type == ValueType::VARCHAR) {
+        if (ref.index >= input.stringColumns.size() || !input.stringColumns[ref.index])
+            throw std::runtime_error("Column index out of range in evaluation");
+        const StringColumn &col = *input.stringColumns[ref.index];
+        auto v = std::make_shared<ColumnVector>();
+        v->type = ValueType::VARCHAR;
+        v->rows = numRows;
+        v->stringViews.resize(numRows);
+        if (col.dictionary) {
+            const std::vector<std::string> &dict = *col.dictionary;
+            v->dictionary = &dict;
+            if (!selection) {
+                v->codes = col.codes.data();
+            } else {
+                v->codeStorage.resize(numRows);
+                for (size_t i = 0; i < numRows; ++i) v->codeStorage[i] = col.codes[(*selection)[i]];
+                v->codes = v->codeStorage.data();
+            }
+            for (size_t i = 0; i < numRows; ++i) v->stringViews[i] = dict[v->codes[i]];
+        } else if (col.symbols) {
+            // Only the rows in the selection are decompressed.
+            std::string_view data = *col.data;
+            std::vector<size_t> ends(numRows);
+            for (size_t i = 0; i < numRows; ++i) {
+                size_t row = selection ? (*selection)[i] : i;
+                if (!fsstDecompress(*col.symbols, data.substr(col.offsets[row], col.offsets[row + 1] - col.offsets[row]), v->decodedStorage))
+                    throw std::runtime_error("Corrupt FSST value in evaluation");
+                ends[i] = v->decodedStorage.size();
+            }
+            std::string_view decoded = v->decodedStorage;
+            for (size_t i = 0; i < numRows; ++i) {
+                size_t begin = i == 0 ? 0 : ends[i - 1];
+                v->stringViews[i] = decoded.substr(begin, ends[i] - begin);
+            }
+        } else if (col.data) {
+            std::string_view data = *col.data;
+            for (size_t i = 0; i < numRows; ++i) {
+                size_t row = selection ? (*selection)[i] : i;
+                v->stringViews[i] = data.substr(col.offsets[row], col.offsets[row + 1] - col.offsets[row]);
+            }
+        } else {
+            for (size_t i = 0; i < numRows; ++i) v->stringViews[i] = col.column[selection ? (*selection)[i] : i];
+        }
+        v->strings = v->stringViews.data();
+        return v;
+    }
+    throw std::runtime_error("Unsupported column type in evaluation");
+}
+
+// (In)equality of an FSST-compressed column with a string literal is decided
+// on the compressed values: equal strings compress to equal codes, so the
+// literal is compressed once with the chunk's symbol table and compared
+// bytewise. Returns nullptr when the operands do not qualify.
+ColumnVectorPtr VectorEvaluator::compareCompressed(const BinaryExpr &expr) {
+    if (expr.op != Operator::EQUAL && expr.op != Operator::NOT_EQUAL) return nullptr;
+    const ColumnExpression *ref = expr.left.get();
+    const ColumnExpression *lit = expr.right.get();
+    if (ref->type != ExprType::COLUMN_REF) std::swap(ref, lit);
+    if (ref->type != ExprType::COLUMN_REF || lit->type != ExprType::LITERAL) return nullptr;
+    if (ref->columnRef.type != ValueType::VARCHAR || lit->literal.value.type != ValueType::VARCHAR) return nullptr;
+    if (ref->columnRef.index >= input.stringColumns.size() || !input.stringColumns[ref->columnRef.index]) return nullptr;
+    const StringColumn &col = *input.stringColumns[ref->columnRef.index];
+    if (!col.symbols) return nullptr;
+
+    std::string codes;
+    fsstCompress(*col.symbols, lit->literal.value.stringValue, codes);
+    const char *data = col.data->data();
+    const bool equal = expr.op == Operator::EQUAL;
+    auto out = makeVector(ValueType::BOOL, numRows, false);
+    uint8_t *dst = out->boolStorage.data();
+    for (size_t i = 0; i < numRows; ++i) {
+        size_t row = selection ? (*selection)[i] : i;
+        size_t len = col.offsets[row + 1] - col.offsets[row];
+        bool match = len == codes.size() && std::memcmp(data + col.offsets[row], codes.data(), len) == 0;
+        dst[i] = match == equal ? 1 : 0;
+    }
+    return out;
+}
+
+ColumnVectorPtr VectorEvaluator::evalInternal(const ColumnExpression &expr) {
+    switch (expr.type) {
+        case ExprType::LITERAL: {
+            const Value &lit = expr.literal.value;
+            auto v = makeVector(lit.type, numRows, true);
+            switch (lit.type) {
+                case ValueType::INT64: v->intStorage[0] = lit.intValue; break;
+                case ValueType::VARCHAR: v->stringStorage[0] = lit.stringValue; finalizeStrings(*v); break;
+                case ValueType::BOOL: v->boolStorage[0] = lit.boolValue ? 1 : 0; break;
+            }
+            return v;
+        }
+
+        case ExprType::COLUMN_REF:
+            return evalColumnRef(expr.columnRef);
+
+        case ExprType::UNARY_OP: {
+            ColumnVectorPtr operand = eval(*expr.unary.operand);
+            size_t n = operand->constant ? 1 : numRows;
+            if (expr.unary.op == Operator::NOT) {
+                auto out = makeVector(ValueType::BOOL, numRows, operand->constant);
+                for (size_t i = 0; i < n; ++i) out->boolStorage[i] = operand->bools[i] ? 0 : 1;
+                return out;
+            }
+            auto out = makeVector(ValueType::INT64, numRows, operand->constant);
+            for (size_t i = 0; i < n; ++i) out->intStorage[i] = -operand->ints[i];
+            return out;
+        }
+
+        case ExprType::BINARY_OP: {
+            if (ColumnVectorPtr v = compareCompressed(expr.binary)) return v;
+            ColumnVectorPtr l = eval(*expr.binary.left);
+            ColumnVectorPtr r = eval(*expr.binary.right);
+            if (l->dictionary || r->dictionary) {
+                if (ColumnVectorPtr v = compareCodes(expr.binary.op, *l, *r, numRows)) return v;
+            }
+
+            switch (expr.binary.op) {
+                case Operator::ADD:
+                    return intArithmetic(*l, *r, numRows, [](int64_t a, int64_t b) { return a + b; });
+                case Operator::SUBTRACT:
+                    return intArithmetic(*l, *r, numRows, [](int64_t a, int64_t b) { return a - b; });
+                case Operator::MULTIPLY:
+                    return intArithmetic(*l, *r, numRows, [](int64_t a, int64_t b) { return a * b; });
+                case Operator::DIVIDE:
+                    return intArithmetic(*l, *r, numRows, [](int64_t a, int64_t b) { return a / b; });
+                case Operator::AND:
+                    return logical(*l, *r, numRows, [](uint8_t a, uint8_t b) -> uint8_t { return a & b; });
+                case Operator::OR:
+                    return logical(*l, *r, numRows, [](uint8_t a, uint8_t b) -> uint8_t { return a | b; });
+                case Operator::EQUAL:
+                    return compareVectors(*l, *r, numRows, std::equal_to<>());
+                case Operator::NOT_EQUAL:
+                    return compareVectors(*l, *r, numRows, std::not_equal_to<>());
+                case Operator::LESS_THAN:
+                    return compareVectors(*l, *r, numRows, std::less<>());
+                case Operator::LESS_EQUAL:
+                    return compareVectors(*l, *r, numRows, std::less_equal<>());
+                case Operator::GREATER_THAN:
+                    return compareVectors(*l, *r, numRows, std::greater<>());
+                case Operator::GREATER_EQUAL:
+                    return compareVectors(*l, *r, numRows, std::greater_equal<>());
+                default:
+                    break;
+            }
+            throw std::runtime_error("Unsupported binary operator in evaluation");
+        }
+
+        case ExprType::FUNCTION: {
+            const FunctionExpr &f = expr.function;
+            std::vector<ColumnVectorPtr> args;
+            args.reserve(f.args.size());
+            for (const auto &a : f.args) {
+                if (!a) throw std::runtime_error("Function argument missing");
+                args.push_back(eval(*a));
+            }
+
+            switch (f.name) {
+                case FunctionName::STRLEN: {
+                    if (args.size() != 1) throw std::runtime_error("STRLEN missing arg");
+                    const ColumnVector &s = *args[0];
+                    auto out = makeVector(ValueType::INT64, numRows, s.constant);
+                    size_t n = s.constant ? 1 : numRows;
+                    for (size_t i = 0; i < n; ++i) out->intStorage[i] = (int64_t)s.strings[i].size();
+                    return out;
+                }
+                case FunctionName::CONCAT: {
+                    if (args.size() < 2) throw std::runtime_error("CONCAT missing args");
+                    const ColumnVector &a = *args[0];
+                    const ColumnVector &b = *args[1];
+                    return mapStrings(args, numRows, [&](size_t i) {
+                        std::string_view x = a.stringAt(i), y = b.stringAt(i);
+                        std::string s;
+                        s.reserve(x.size() + y.size());
+                        s.append(x);
+                        s.append(y);
+                        return s;
+                    });
+                }
+                case FunctionName::UPPER:
+                case FunctionName::LOWER: {
+                    if (args.empty()) throw std::runtime_error(f.name == FunctionName::UPPER ? "UPPER missing arg" : "LOWER missing arg");
+                    const ColumnVector &a = *args[0];
+                    bool upper = f.name == FunctionName::UPPER;
+                    return mapStrings(args, numRows, [&](size_t i) {
+                        std::string s(a.stringAt(i));
+                        if (upper) for (auto &c : s) c = std::toupper(c);
+                        else for (auto &c : s) c = std::tolower(c);
+                        return s;
+                    });
+                }
+                case FunctionName::REPLACE: {
+                    if (args.size() != 3) throw std::runtime_error("REPLACE missing args");
+                    const ColumnVector &src = *args[0];
+                    const ColumnVector &search = *args[1];
+                    const ColumnVector &repl = *args[2];
+                    return mapStrings(args, numRows, [&](size_t i) {
+                        std::string s(src.stringAt(i));
+                        std::string_view pat = search.stringAt(i);
+                        std::string_view rep = repl.stringAt(i);
+                        if (!pat.empty()) {
+                            size_t pos = 0;
+                            while ((pos = s.find(pat, pos)) != std::string::npos) {
+                                s.replace(pos, pat.size(), rep);
+                                pos += rep.size();
+                            }
+                        }
+                        return s;
+                    });
+                }
+            }
+            throw std::runtime_error("Unsupported function in evaluation");
+        }
+
+        case ExprType::AGGREGATE:
+            throw std::runtime_error("Aggregates are evaluated only by HashAggregator");
+    }
+    throw std::runtime_error("Unsupported expression in evaluation");
+}
+
+std::vector<uint32_t> selectionFromBools(const ColumnVector &mask) {
+    std::vector<uint32_t> selection;
+    if (mask.constant) {
+        if (mask.boolAt(0)) {
+            selection.resize(mask.rows);
+            for (size_t i = 0; i < mask.rows; ++i) selection[i] = static_cast<uint32_t>(i);
+        }
+        return selection;
+    }
+    selection.reserve(mask.rows);
+    for (size_t i = 0; i < mask.rows; ++i) {
+        if (mask.bools[i]) selection.push_back(static_cast<uint32_t>(i));
+    }
+    return selection;
+}
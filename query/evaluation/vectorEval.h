@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../../types.h"
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+
+struct ColumnVector {
+    ValueType type = ValueType::INT64;
+    size_t rows = 0;
+    bool constant = false;
+
+    const int64_t *ints = nullptr;
+    const std::string_view *strings = nullptr;
+    const uint8_t *bools = nullptr;
+
+    std::vector<int64_t> intStorage;
+    std::vector<std::string_view> stringViews;
+    std::vector<std::string> stringStorage;
+    std::vector<uint8_t> boolStorage;
+
+    // Set for a column read from dictionary-encoded chunks: strings[i] is
+    // (*dictionary)[codes[i]], and comparisons with a literal run on codes.
+    const std::vector<std::string> *dictionary = nullptr;
+    const uint32_t *codes = nullptr;
+    std::vector<uint32_t> codeStorage;
+    // Values decompressed from FSST chunks; stringViews point into it.
+    std::string decodedStorage;
+
+    int64_t intAt(size_t i) const { return ints[constant ? 0 : i]; }
+    std::string_view stringAt(size_t i) const { return strings[constant ? 0 : i]; }
+    bool boolAt(size_t i) const { return bools[constant ? 0 : i] != 0; }
+    Value valueAt(size_t i) const;
+};
+
+using ColumnVectorPtr = std::shared_ptr<const ColumnVector>;
+
+struct BatchInput {
+    size_t num_rows = 0;
+    std::vector<const std::vector<int64_t>*> intColumns;
+    std::vector<const StringColumn*> stringColumns;
+};
+
+class VectorEvaluator {
+public:
+    VectorEvaluator(const BatchInput &input, const std::vector<uint32_t> *selection = nullptr);
+
+    ColumnVectorPtr eval(const ColumnExpression &expr);
+
+    size_t rows() const { return numRows; }
+
+private:
+    ColumnVectorPtr evalInternal(const ColumnExpression &expr);
+    ColumnVectorPtr evalColumnRef(const ColumnReference &ref);
+    ColumnVectorPtr compareCompressed(const BinaryExpr &expr);
+
+    const BatchInput &input;
+    const std::vector<uint32_t> *selection;
+    size_t numRows;
+    std::unordered_map<size_t, ColumnVectorPtr> cache;
+};
+
+std::vector<uint32_t> selectionFromBools(const ColumnVector &mask);
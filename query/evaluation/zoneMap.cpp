@@ -0,0 +1,150 @@
+#include "zoneMap.h"
+
+static ZoneMatch negateMatch(ZoneMatch m) {
+    if (m == ZoneMatch::NEVER) return ZoneMatch::ALWAYS;
+    if (m == ZoneMatch::ALWAYS) return ZoneMatch::NEVER;
+    return ZoneMatch::MAYBE;
+}
+
+static Operator flipComparison(Operator op) {
+    switch (op) {
+        case Operator::LESS_THAN: return Operator::GREATER_THAN;
+        case Operator::LESS_EQUAL: return Operator::GREATER_EQUAL;
+        case Operator::GREATER_THAN: return Operator::LESS_THAN;
+        case Operator::GREATER_EQUAL: return Operator::LESS_EQUAL;
+        default: return op;
+    }
+}
+
+static bool isComparison(Operator op) {
+    return op == Operator::EQUAL || op == Operator::NOT_EQUAL ||
+           op == Operator::LESS_THAN || op == Operator::LESS_EQUAL ||
+           op == Operator::GREATER_THAN || op == Operator::GREATER_EQUAL;
+}
+
+static bool constantValue(const ColumnExpression &expr, Value &out) {
+    if (expr.type == ExprType::LITERAL) {
+        out = expr.literal.value;
+        return true;
+    }
+    if (expr.type == ExprType::UNARY_OP && expr.unary.op == Operator::MINUS && expr.unary.operand &&
+        expr.unary.operand->type == ExprType::LITERAL && expr.unary.operand->literal.value.type == ValueType::INT64) {
+        out = expr.unary.operand->literal.value;
+        out.intValue = -out.intValue;
+        return true;
+    }
+    return false;
+}
+
+static ZoneMatch compareInt(const ChunkStats &s, Operator op, int64_t lit) {
+    switch (op) {
+        case Operator::EQUAL:
+            if (lit < s.intMin || lit > s.intMax) return ZoneMatch::NEVER;
+            if (s.intMin == lit && s.intMax == lit) return ZoneMatch::ALWAYS;
+            return ZoneMatch::MAYBE;
+        case Operator::NOT_EQUAL:
+            return negateMatch(compareInt(s, Operator::EQUAL, lit));
+        case Operator::LESS_THAN:
+            if (s.intMax < lit) return ZoneMatch::ALWAYS;
+            if (s.intMin >= lit) return ZoneMatch::NEVER;
+            return ZoneMatch::MAYBE;
+        case Operator::LESS_EQUAL:
+            if (s.intMax <= lit) return ZoneMatch::ALWAYS;
+            if (s.intMin > lit) return ZoneMatch::NEVER;
+            return ZoneMatch::MAYBE;
+        case Operator::GREATER_THAN:
+            if (s.intMin > lit) return ZoneMatch::ALWAYS;
+            if (s.intMax <= lit) return ZoneMatch::NEVER;
+            return ZoneMatch::MAYBE;
+        case Operator::GREATER_EQUAL:
+            if (s.intMin >= lit) return ZoneMatch::ALWAYS;
+            if (s.intMax < lit) return ZoneMatch::NEVER;
+            return ZoneMatch::MAYBE;
+        default:
+            return ZoneMatch::MAYBE;
+    }
+}
+
+// VARCHAR stats keep only STATS_PREFIX_LEN bytes of min/max. Truncation is monotonic,
+// so comparing the literal's prefix against them still gives safe bounds.
+static ZoneMatch compareString(const ChunkStats &s, Operator op, const std::string &lit) {
+    std::string p = lit.substr(0, STATS_PREFIX_LEN);
+    switch (op) {
+        case Operator::EQUAL:
+            if (p < s.strMin || p > s.strMax) return ZoneMatch::NEVER;
+            return ZoneMatch::MAYBE;
+        case Operator::NOT_EQUAL:
+            return negateMatch(compareString(s, Operator::EQUAL, lit));
+        case Operator::LESS_THAN:
+        case Operator::LESS_EQUAL:
+            if (s.strMax < p) return ZoneMatch::ALWAYS;
+            if (s.strMin > p) return ZoneMatch::NEVER;
+            return ZoneMatch::MAYBE;
+        case Operator::GREATER_THAN:
+        case Operator::GREATER_EQUAL:
+            if (s.strMin > p) return ZoneMatch::ALWAYS;
+            if (s.strMax < p) return ZoneMatch::NEVER;
+            return ZoneMatch::MAYBE;
+        default:
+            return ZoneMatch::MAYBE;
+    }
+}
+
+static ZoneMatch evalComparison(const ColumnExpression &column, Operator op, const ColumnExpression &constant, const ZoneMap &zones) {
+    Value lit;
+    if (column.type != ExprType::COLUMN_REF || !constantValue(constant, lit)) return ZoneMatch::MAYBE;
+
+    auto it = zones.find(column.columnRef.index);
+    if (it == zones.end() || !it->second.valid) return ZoneMatch::MAYBE;
+
+    if (column.columnRef.type == ValueType::INT64 && lit.type == ValueType::INT64) {
+        return compareInt(it->second, op, lit.intValue);
+    }
+    if (column.columnRef.type == ValueType::VARCHAR && lit.type == ValueType::VARCHAR) {
+        return compareString(it->second, op, lit.stringValue);
+    }
+    return ZoneMatch::MAYBE;
+}
+
+ZoneMatch evalZoneMap(const ColumnExpression &expr, const ZoneMap &zones) {
+    switch (expr.type) {
+        case ExprType::LITERAL:
+            if (expr.literal.value.type != ValueType::BOOL) return ZoneMatch::MAYBE;
+            return expr.literal.value.boolValue ? ZoneMatch::ALWAYS : ZoneMatch::NEVER;
+
+        case ExprType::UNARY_OP:
+            if (expr.unary.op == Operator::NOT && expr.unary.operand) {
+                return negateMatch(evalZoneMap(*expr.unary.operand, zones));
+            }
+            return ZoneMatch::MAYBE;
+
+        case ExprType::BINARY_OP: {
+            if (!expr.binary.left || !expr.binary.right) return ZoneMatch::MAYBE;
+            const ColumnExpression &l = *expr.binary.left;
+            const ColumnExpression &r = *expr.binary.right;
+
+            if (expr.binary.op == Operator::AND) {
+                ZoneMatch a = evalZoneMap(l, zones);
+                if (a == ZoneMatch::NEVER) return ZoneMatch::NEVER;
+                ZoneMatch b = evalZoneMap(r, zones);
+                if (b == ZoneMatch::NEVER) return ZoneMatch::NEVER;
+                return (a == ZoneMatch::ALWAYS && b == ZoneMatch::ALWAYS) ? ZoneMatch::ALWAYS : ZoneMatch::MAYBE;
+            }
+            if (expr.binary.op == Operator::OR) {
+                ZoneMatch a = evalZoneMap(l, zones);
+                if (a == ZoneMatch::ALWAYS) return ZoneMatch::ALWAYS;
+                ZoneMatch b = evalZoneMap(r, zones);
+                if (b == ZoneMatch::ALWAYS) return ZoneMatch::ALWAYS;
+                return (a == ZoneMatch::NEVER && b == ZoneMatch::NEVER) ? ZoneMatch::NEVER : ZoneMatch::MAYBE;
+            }
+            if (!isComparison(expr.binary.op)) return ZoneMatch::MAYBE;
+
+            if (l.type == ExprType::COLUMN_REF) return evalComparison(l, expr.binary.op, r, zones);
+            if (r.type == ExprType::COLUMN_REF) return evalComparison(r, flipComparison(expr.binary.op), l, zones);
+            return ZoneMatch::MAYBE;
+        }
+
+        default:
+            return ZoneMatch::MAYBE;
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "../../types.h"
+#include <unordered_map>
+
+using ZoneMap = std::unordered_map<size_t, ChunkStats>;
+
+enum class ZoneMatch {
+    NEVER,
+    MAYBE,
+    ALWAYS
+};
+
+ZoneMatch evalZoneMap(const ColumnExpression &expr, const ZoneMap &zones);
@@ -0,0 +1,412 @@
+#include "hashAggregate.h"
+#include "runFile.h"
+#include "../evaluation/expression_hasher.h"
+#include "../../utils/utils.h"
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <unistd.h>
+
+static constexpr uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+static constexpr size_t SPILL_PARTITIONS = 16;
+static constexpr size_t MIN_SLOTS = 1024;
+
+AggregatePlan buildAggregatePlan(const SelectQuery &query) {
+    AggregatePlan plan;
+    std::vector<size_t> keyHashes;
+    for (const auto &g : query.groupByClauses) {
+        plan.keys.push_back(g.get());
+        keyHashes.push_back(hashExpression(*g));
+    }
+    for (const auto &c : query.columnClauses) {
+        if (c->type == ExprType::AGGREGATE) {
+            const ColumnExpression *arg = c->aggregate.argument.get();
+            plan.arguments.push_back(arg);
+            plan.aggregates.push_back(AggregateSpec{c->aggregate.function, arg ? arg->resultType : ValueType::INT64});
+            plan.outputs.emplace_back(false, plan.aggregates.size() - 1);
+            continue;
+        }
+        size_t h = hashExpression(*c);
+        size_t key = 0;
+        while (key < keyHashes.size() && keyHashes[key] != h) key++;
+        plan.outputs.emplace_back(true, key);
+    }
+    return plan;
+}
+
+static bool keepsValue(AggregateFunction f) {
+    return f == AggregateFunction::MIN || f == AggregateFunction::MAX;
+}
+
+static ValueType stateType(const AggregateSpec &spec) {
+    return keepsValue(spec.function) ? spec.type : ValueType::INT64;
+}
+
+template<typename Col>
+static void appendKeyPart(std::string &out, ValueType type, const Col &col, size_t row) {
+    switch (type) {
+        case ValueType::INT64: {
+            int64_t v = col.intAt(row);
+            out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+            break;
+        }
+        case ValueType::VARCHAR: {
+            std::string_view v = col.stringAt(row);
+            uint32_t len = static_cast<uint32_t>(v.size());
+            out.append(reinterpret_cast<const char *>(&len), sizeof(len));
+            out.append(v.data(), v.size());
+            break;
+        }
+        case ValueType::BOOL:
+            out.push_back(col.boolAt(row) ? 1 : 0);
+            break;
+    }
+}
+
+template<typename Col>
+static void appendCell(ColumnData &out, const Col &col, size_t row) {
+    switch (out.type) {
+        case ValueType::INT64: out.appendInt(col.intAt(row)); break;
+        case ValueType::VARCHAR: out.appendString(col.stringAt(row)); break;
+        case ValueType::BOOL: out.appendBool(col.boolAt(row)); break;
+    }
+}
+
+HashAggregator::HashAggregator(const std::vector<ValueType> &keyTypes, const std::vector<AggregateSpec> &aggregates, size_t memoryBudget)
+    : keyTypes(keyTypes), aggregates(aggregates), memoryBudget(memoryBudget),
+      intStates(aggregates.size()), stringStates(aggregates.size()), boolStates(aggregates.size()),
+      partitions(SPILL_PARTITIONS) {
+    clear();
+}
+
+HashAggregator::~HashAggregator() {
+    for (const auto &files : partitions) {
+        for (const auto &f : files) std::remove(f.c_str());
+    }
+}
+
+void HashAggregator::clear() {
+    slots.clear();
+    mask = 0;
+    keyArena.clear();
+    keyEnds.clear();
+    groupHashes.clear();
+    keyColumns.assign(keyTypes.size(), ColumnData());
+    for (size_t k = 0; k < keyTypes.size(); ++k) keyColumns[k].type = keyTypes[k];
+    counts.clear();
+    for (auto &v : intStates) v.clear();
+    for (auto &v : stringStates) v.clear();
+    for (auto &v : boolStates) v.clear();
+    stringBytes = 0;
+}
+
+void HashAggregator::grow() {
+    size_t size = std::max(MIN_SLOTS, slots.size() * 2);
+    slots.assign(size, Slot{0, EMPTY_SLOT});
+    mask = size - 1;
+    for (uint32_t g = 0; g < groupHashes.size(); ++g) {
+        size_t i = groupHashes[g] & mask;
+        while (slots[i].group != EMPTY_SLOT) i = (i + 1) & mask;
+        slots[i] = Slot{groupHashes[g], g};
+    }
+}
+
+uint32_t HashAggregator::findOrInsert(uint64_t hash, std::string_view key, bool &inserted) {
+    if ((keyEnds.size() + 1) * 2 > slots.size()) grow();
+    size_t i = hash & mask;
+    while (true) {
+        Slot &slot = slots[i];
+        if (slot.group == EMPTY_SLOT) {
+            uint32_t group = static_cast<uint32_t>(keyEnds.size());
+            slot = Slot{hash, group};
+            keyArena.append(key.data(), key.size());
+            keyEnds.push_back(keyArena.size());
+            groupHashes.push_back(hash);
+            counts.push_back(0);
+            inserted = true;
+            return group;
+        }
+        if (slot.hash == hash) {
+            uint64_t begin = slot.group ? keyEnds[slot.group - 1] : 0;
+            std::string_view stored(keyArena.data() + begin, keyEnds[slot.group] - begin);
+            if (stored == key) {
+                inserted = false;
+                return slot.group;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+// New groups start with the value of the row that created them, so MIN/MAX
+// need no "empty" marker.
+#define INIT_STATES(COLS)                                                              \
+    for (size_t a = 0; a < aggregates.size(); ++a) {                                   \
+        switch (stateType(aggregates[a])) {                                            \
+            case ValueType::INT64:                                                     \
+                intStates[a].push_back(keepsValue(aggregates[a].function) ? COLS[a].intAt(r) : 0); \
+                break;                                                                 \
+            case ValueType::VARCHAR:                                                   \
+                stringStates[a].emplace_back(COLS[a].stringAt(r));                     \
+                stringBytes += stringStates[a].back().size();                          \
+                break;                                                                 \
+            case ValueType::BOOL:                                                      \
+                boolStates[a].push_back(COLS[a].boolAt(r) ? 1 : 0);                    \
+                break;                                                                 \
+        }                                                                              \
+    }
+
+void HashAggregator::update(const std::vector<ColumnVectorPtr> &keys, const std::vector<ColumnVectorPtr> &arguments, size_t rows) {
+    std::vector<uint32_t> groups(rows);
+    struct ArgView {
+        const std::vector<ColumnVectorPtr> &args;
+        const ColumnVector &operator[](size_t a) const { return *args[a]; }
+    } args{arguments};
+
+    for (size_t r = 0; r < rows; ++r) {
+        scratch.clear();
+        for (size_t k = 0; k < keyTypes.size(); ++k) appendKeyPart(scratch, keyTypes[k], *keys[k], r);
+        uint64_t hash = std::hash<std::string_view>{}(scratch);
+        bool inserted = false;
+        uint32_t g = findOrInsert(hash, scratch, inserted);
+        if (inserted) {
+            for (size_t k = 0; k < keyTypes.size(); ++k) appendCell(keyColumns[k], *keys[k], r);
+            INIT_STATES(args)
+        }
+        groups[r] = g;
+    }
+
+    for (size_t r = 0; r < rows; ++r) counts[groups[r]]++;
+
+    for (size_t a = 0; a < aggregates.size(); ++a) {
+        const AggregateSpec &spec = aggregates[a];
+        switch (spec.function) {
+            case AggregateFunction::COUNT: {
+                auto &state = intStates[a];
+                for (size_t r = 0; r < rows; ++r) state[groups[r]]++;
+                break;
+            }
+            case AggregateFunction::SUM:
+            case AggregateFunction::AVG: {
+                auto &state = intStates[a];
+                const ColumnVector &col = args[a];
+                if (col.constant) {
+                    int64_t v = col.ints[0];
+                    for (size_t r = 0; r < rows; ++r) state[groups[r]] += v;
+                } else {
+                    for (size_t r = 0; r < rows; ++r) state[groups[r]] += col.ints[r];
+                }
+                break;
+            }
+            case AggregateFunction::MIN:
+            case AggregateFunction::MAX: {
+                bool isMin = spec.function == AggregateFunction::MIN;
+                const ColumnVector &col = args[a];
+                switch (spec.type) {
+                    case ValueType::INT64: {
+                        auto &state = intStates[a];
+                        for (size_t r = 0; r < rows; ++r) {
+                            int64_t v = col.intAt(r);
+                            int64_t &s = state[groups[r]];
+                            if (isMin ? v < s : v > s) s = v;
+                        }
+                        break;
+                    }
+                    case ValueType::VARCHAR: {
+                        auto &state = stringStates[a];
+                        for (size_t r = 0; r < rows; ++r) {
+                            std::string_view v = col.stringAt(r);
+                            std::string &s = state[groups[r]];
+                            if (isMin ? v < s : v > s) {
+                                stringBytes += v.size() - s.size();
+                                s.assign(v);
+                            }
+                        }
+                        break;
+                    }
+                    case ValueType::BOOL: {
+                        auto &state = boolStates[a];
+                        for (size_t r = 0; r < rows; ++r) {
+                            uint8_t v = col.boolAt(r) ? 1 : 0;
+                            uint8_t &s = state[groups[r]];
+                            s = isMin ? (s & v) : (s | v);
+                        }
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    if (memoryBytes() > memoryBudget) spill();
+}
+
+void HashAggregator::mergeStates(const MixBatch &states) {
+    size_t nk = keyTypes.size();
+    size_t na = aggregates.size();
+    struct StateView {
+        const MixBatch &batch;
+        size_t offset;
+        const ColumnData &operator[](size_t a) const { return batch.columns[offset + a]; }
+    } cols{states, nk};
+    const ColumnData &rowCounts = states.columns[nk + na];
+
+    for (size_t r = 0; r < states.num_rows; ++r) {
+        scratch.clear();
+        for (size_t k = 0; k < nk; ++k) appendKeyPart(scratch, keyTypes[k], states.columns[k], r);
+        uint64_t hash = std::hash<std::string_view>{}(scratch);
+        bool inserted = false;
+        uint32_t g = findOrInsert(hash, scratch, inserted);
+        if (inserted) {
+            for (size_t k = 0; k < nk; ++k) keyColumns[k].appendFrom(states.columns[k], r);
+            INIT_STATES(cols)
+        }
+        counts[g] += rowCounts.intAt(r);
+
+        for (size_t a = 0; a < na; ++a) {
+            const AggregateSpec &spec = aggregates[a];
+            const ColumnData &col = cols[a];
+            if (!keepsValue(spec.function)) {
+                intStates[a][g] += col.intAt(r);
+                continue;
+            }
+            bool isMin = spec.function == AggregateFunction::MIN;
+            switch (spec.type) {
+                case ValueType::INT64: {
+                    int64_t v = col.intAt(r);
+                    int64_t &s = intStates[a][g];
+                    if (isMin ? v < s : v > s) s = v;
+                    break;
+                }
+                case ValueType::VARCHAR: {
+                    std::string_view v = col.stringAt(r);
+                    std::string &s = stringStates[a][g];
+                    if (isMin ? v < s : v > s) {
+                        stringBytes += v.size() - s.size();
+                        s.assign(v);
+                    }
+                    break;
+                }
+                case ValueType::BOOL: {
+                    uint8_t v = col.boolAt(r) ? 1 : 0;
+                    uint8_t &s = boolStates[a][g];
+                    s = isMin ? (s & v) : (s | v);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+#undef INIT_STATES
+
+MixBatch HashAggregator::stateBatch() const {
+    size_t groups = keyEnds.size();
+    MixBatch out;
+    out.num_rows = groups;
+    out.columns = keyColumns;
+    for (size_t a = 0; a < aggregates.size(); ++a) {
+        ColumnData col;
+        col.type = stateType(aggregates[a]);
+        col.reserve(groups);
+        for (size_t g = 0; g < groups; ++g) {
+            switch (col.type) {
+                case ValueType::INT64: col.appendInt(intStates[a][g]); break;
+                case ValueType::VARCHAR: col.appendString(stringStates[a][g]); break;
+                case ValueType::BOOL: col.appendBool(boolStates[a][g] != 0); break;
+            }
+        }
+        out.columns.push_back(std::move(col));
+    }
+    ColumnData rowCounts;
+    rowCounts.type = ValueType::INT64;
+    rowCounts.ints = counts;
+    rowCounts.count = groups;
+    out.columns.push_back(std::move(rowCounts));
+    return out;
+}
+
+size_t HashAggregator::memoryBytes() const {
+    size_t bytes = slots.size() * sizeof(Slot) + keyArena.capacity()
+        + (keyEnds.capacity() + groupHashes.capacity() + counts.capacity()) * sizeof(uint64_t) + stringBytes;
+    for (const auto &col : keyColumns) bytes += col.memoryBytes();
+    for (size_t a = 0; a < aggregates.size(); ++a) {
+        bytes += intStates[a].capacity() * sizeof(int64_t) + stringStates[a].capacity() * sizeof(std::string) + boolStates[a].capacity();
+    }
+    return bytes;
+}
+
+void HashAggregator::spill() {
+    if (keyEnds.empty()) return;
+    MixBatch states = stateBatch();
+    std::vector<ValueType> types;
+    for (const auto &col : states.columns) types.push_back(col.type);
+
+    std::vector<RunWriter> writers(SPILL_PARTITIONS);
+    for (size_t p = 0; p < SPILL_PARTITIONS; ++p) {
+        char tmpl[] = "batches/aggXXXXXX";
+        int fd = mkstemp(tmpl);
+        if (fd == -1) throw std::runtime_error("mkstemp failed in HashAggregator::spill");
+        close(fd);
+        if (!writers[p].open(tmpl, types)) throw std::runtime_error(std::string("cannot open aggregate partition ") + tmpl);
+        partitions[p].push_back(tmpl);
+    }
+    for (size_t g = 0; g < states.num_rows; ++g) {
+        writers[groupHashes[g] >> 60].appendRow(states, g);
+    }
+    for (auto &w : writers) w.close();
+
+    spillCount++;
+    log_info(std::string("HashAggregator: spilled ") + std::to_string(states.num_rows) + " groups to disk");
+    clear();
+}
+
+void HashAggregator::merge(HashAggregator &other) {
+    if (spillCount > 0 || other.spillCount > 0) {
+        spill();
+        other.spill();
+        for (size_t p = 0; p < SPILL_PARTITIONS; ++p) {
+            partitions[p].insert(partitions[p].end(), other.partitions[p].begin(), other.partitions[p].end());
+            other.partitions[p].clear();
+        }
+        spillCount += other.spillCount;
+        other.spillCount = 0;
+        return;
+    }
+    if (!other.keyEnds.empty()) mergeStates(other.stateBatch());
+    other.clear();
+    if (memoryBytes() > memoryBudget) spill();
+}
+
+MixBatch HashAggregator::finish() {
+    if (spillCount == 0) return stateBatch();
+
+    spill();
+    MixBatch result;
+    result.num_rows = 0;
+    for (size_t p = 0; p < SPILL_PARTITIONS; ++p) {
+        HashAggregator partition(keyTypes, aggregates, std::numeric_limits<size_t>::max());
+        for (const auto &path : partitions[p]) {
+            RunReader reader;
+            MixBatch block;
+            if (!reader.open(path)) {
+                log_error(std::string("HashAggregator: cannot open partition ") + path);
+                continue;
+            }
+            while (reader.nextBlock(block)) partition.mergeStates(block);
+        }
+        for (const auto &path : partitions[p]) std::remove(path.c_str());
+        partitions[p].clear();
+
+        MixBatch states = partition.stateBatch();
+        if (result.columns.empty()) result.columns.resize(states.columns.size());
+        for (size_t c = 0; c < states.columns.size(); ++c) {
+            result.columns[c].type = states.columns[c].type;
+            for (size_t r = 0; r < states.num_rows; ++r) result.columns[c].appendFrom(states.columns[c], r);
+        }
+        result.num_rows += states.num_rows;
+    }
+    spillCount = 0;
+    return result;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../../types.h"
+#include "../evaluation/vectorEval.h"
+
+struct AggregateSpec {
+    AggregateFunction function;
+    ValueType type;
+};
+
+// Split of a GROUP BY query: the expressions evaluated per input row (group
+// keys and aggregate arguments) and, for every output column, whether it
+// comes from a key or from an aggregate.
+struct AggregatePlan {
+    std::vector<const ColumnExpression*> keys;
+    std::vector<const ColumnExpression*> arguments;
+    std::vector<AggregateSpec> aggregates;
+    std::vector<std::pair<bool, size_t>> outputs;
+};
+
+AggregatePlan buildAggregatePlan(const SelectQuery &query);
+
+// Open-addressing hash table of groups with their partial aggregate states.
+// When the table outgrows its memory budget, all groups are written to hash
+// partitions on disk and the table starts over; finish() merges each
+// partition separately. Partials built by different threads are combined
+// with merge().
+//
+// States are exchanged as MixBatch rows: key columns, then one column per
+// aggregate (COUNT: count, SUM/AVG: sum, MIN/MAX: value), then the row count.
+class HashAggregator {
+public:
+    HashAggregator(const std::vector<ValueType> &keyTypes, const std::vector<AggregateSpec> &aggregates, size_t memoryBudget);
+    ~HashAggregator();
+
+    HashAggregator(const HashAggregator&) = delete;
+    HashAggregator &operator=(const HashAggregator&) = delete;
+
+    void update(const std::vector<ColumnVectorPtr> &keys, const std::vector<ColumnVectorPtr> &arguments, size_t rows);
+
+    void merge(HashAggregator &other);
+
+    // Returns the final state rows of all groups.
+    MixBatch finish();
+
+    size_t spilledPartitions() const { return spillCount; }
+
+private:
+    uint32_t findOrInsert(uint64_t hash, std::string_view key, bool &inserted);
+    void grow();
+    void mergeStates(const MixBatch &states);
+    MixBatch stateBatch() const;
+    size_t memoryBytes() const;
+    void spill();
+    void clear();
+
+    std::vector<ValueType> keyTypes;
+    std::vector<AggregateSpec> aggregates;
+    size_t memoryBudget;
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t group;
+    };
+    std::vector<Slot> slots;
+    size_t mask = 0;
+
+    std::string keyArena;
+    std::vector<uint64_t> keyEnds;
+    std::vector<uint64_t> groupHashes;
+    std::vector<ColumnData> keyColumns;
+    std::vector<int64_t> counts;
+    std::vector<std::vector<int64_t>> intStates;
+    std::vector<std::vector<std::string>> stringStates;
+    std::vector<std::vector<uint8_t>> boolStates;
+    size_t stringBytes = 0;
+
+    std::string scratch;
+    std::vector<std::vector<std::string>> partitions;
+    size_t spillCount = 0;
+};
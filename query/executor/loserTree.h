@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Tournament tree of losers over k sorted sources. `less(a, b)` compares the
+// current heads of sources a and b, `exhausted(a)` tells whether source a has
+// no more rows. After consuming the head of top(), advance that source and call
+// replay(); only the log2(k) nodes on its path are compared again.
+template<typename Less, typename Exhausted>
+class LoserTree {
+public:
+    LoserTree(size_t k, Less less, Exhausted exhausted)
+        : k(k), less(less), exhausted(exhausted), tree(k > 0 ? k : 1, 0) {
+        if (k > 1) tree[0] = build(1);
+    }
+
+    size_t top() const { return tree[0]; }
+
+    bool empty() const { return k == 0 || exhausted(tree[0]); }
+
+    void replay() {
+        size_t winner = tree[0];
+        for (size_t node = (winner + k) / 2; node >= 1; node /= 2) {
+            if (beats(tree[node], winner)) std::swap(tree[node], winner);
+        }
+        tree[0] = winner;
+    }
+
+private:
+    bool beats(size_t a, size_t b) const {
+        if (exhausted(a)) return false;
+        if (exhausted(b)) return true;
+        return less(a, b);
+    }
+
+    size_t build(size_t node) {
+        if (node >= k) return node - k;
+        size_t l = build(2 * node);
+        size_t r = build(2 * node + 1);
+        if (beats(r, l)) {
+            tree[node] = l;
+            return r;
+        }
+        tree[node] = r;
+        return l;
+    }
+
+    size_t k;
+    Less less;
+    Exhausted exhausted;
+    std::vector<size_t> tree;
+};
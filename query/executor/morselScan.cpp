@@ -0,0 +1,102 @@
+#include "morselScan.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+size_t scanThreads(const SelectQuery &query, size_t morsels) {
+    size_t threads = query.parallelism > 0 ? query.parallelism : std::thread::hardware_concurrency();
+    return std::max<size_t>(1, std::min(threads, morsels));
+}
+
+void runMorsels(size_t count, size_t threads, const MorselProducer &produce, const MorselConsumer &consume) {
+    threads = std::max<size_t>(1, std::min(threads, count));
+    if (threads == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            MixBatch out;
+            if (produce(0, i, out) && consume && !consume(out)) return;
+        }
+        return;
+    }
+
+    struct Slot {
+        bool done = false;
+        bool produced = false;
+        MixBatch batch;
+    };
+    std::vector<Slot> slots(consume ? count : 0);
+    size_t window = consume ? 2 * threads : count;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t next = 0;
+    size_t consumed = 0;
+    bool stop = false;
+    std::exception_ptr failure;
+
+    auto fail = [&](std::exception_ptr e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failure) failure = e;
+        stop = true;
+        changed.notify_all();
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < threads; ++w) {
+        workers.emplace_back([&, w] {
+            while (true) {
+                size_t i;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&] { return stop || next >= count || next < consumed + window; });
+                    if (stop || next >= count) return;
+                    i = next++;
+                }
+                MixBatch out;
+                bool produced = false;
+                try {
+                    produced = produce(w, i, out);
+                } catch (...) {
+                    fail(std::current_exception());
+                    return;
+                }
+                if (!consume) continue;
+                std::lock_guard<std::mutex> lock(mutex);
+                slots[i].done = true;
+                slots[i].produced = produced;
+                slots[i].batch = std::move(out);
+                changed.notify_all();
+            }
+        });
+    }
+
+    if (consume) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (consumed < count) {
+            changed.wait(lock, [&] { return stop || slots[consumed].done; });
+            if (stop) break;
+            Slot slot = std::move(slots[consumed]);
+            lock.unlock();
+            bool more = true;
+            try {
+                more = !slot.produced || consume(slot.batch);
+            } catch (...) {
+                lock.lock();
+                if (!failure) failure = std::current_exception();
+                stop = true;
+                break;
+            }
+            lock.lock();
+            consumed++;
+            if (!more) stop = true;
+            changed.notify_all();
+            if (stop) break;
+        }
+        stop = true;
+        changed.notify_all();
+    }
+
+    for (auto &t : workers) t.join();
+    if (failure) std::rethrow_exception(failure);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "../../types.h"
+#include <functional>
+
+// Produces the output of one morsel (one batch of one part file) on a worker
+// thread; returns false when the morsel yields nothing (pruned or failed).
+using MorselProducer = std::function<bool(size_t worker, size_t morsel, MixBatch &out)>;
+
+// Receives morsel outputs on the calling thread; returning false stops the scan.
+using MorselConsumer = std::function<bool(MixBatch &batch)>;
+
+// Runs `produce` for morsels 0..count-1 on up to `threads` workers. Workers
+// claim morsels from a shared cursor in file order, and the outputs are handed
+// to `consume` in that same order, so downstream operators see exactly what a
+// sequential scan would. Workers stay at most a small window ahead of the
+// consumer to bound buffered batches. Without a consumer the morsels are only
+// produced (e.g. into per-worker state). The first exception thrown by a
+// worker stops the scan and is rethrown here.
+void runMorsels(size_t count, size_t threads, const MorselProducer &produce, const MorselConsumer &consume);
+
+// Number of scan workers for a query: its `parallelism` if given, otherwise
+// one per hardware thread, never more than the number of morsels.
+size_t scanThreads(const SelectQuery &query, size_t morsels);
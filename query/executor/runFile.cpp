@@ -0,0 +1,283 @@
+#include "runFile.h"
+#include <zstd.h>
+#include <cstring>
+#include <filesystem>
+
+static constexpr int RUN_COMPRESSION_LEVEL = 1;
+static constexpr size_t RUN_IO_BUFFER = 1024 * 1024;
+
+template<typename T>
+static void putRaw(std::vector<char> &buf, const T *data, size_t count) {
+    size_t at = buf.size();
+    buf.resize(at + count * sizeof(T));
+    if (count) std::memcpy(buf.data() + at, data, count * sizeof(T));
+}
+
+template<typename T>
+static void putValue(std::vector<char> &buf, T value) {
+    putRaw(buf, &value, 1);
+}
+
+template<typename T>
+static const char *getRaw(const char *p, T *data, size_t count) {
+    if (count) std::memcpy(data, p, count * sizeof(T));
+    return p + count * sizeof(T);
+}
+
+bool RunWriter::open(const std::string &path, const std::vector<ValueType> &columnTypes, bool compressBlocks, bool append) {
+    std::error_code ec;
+    uintmax_t existing = append ? std::filesystem::file_size(path, ec) : 0;
+    if (ec) existing = 0;
+    if (existing > 0) {
+        uint32_t end = 1;
+        std::ifstream tail(path, std::ios::binary);
+        tail.seekg(static_cast<std::streamoff>(existing - sizeof(end)));
+        tail.read((char *)&end, sizeof(end));
+        tail.close();
+        if (end == 0) std::filesystem::resize_file(path, existing - sizeof(end), ec);
+        out.open(path, std::ios::binary | std::ios::app);
+    } else {
+        out.open(path, std::ios::binary | std::ios::trunc);
+    }
+    if (!out.is_open()) return false;
+    types = columnTypes;
+    compress = compressBlocks;
+
+    block.columns.clear();
+    block.columns.resize(types.size());
+    for (size_t c = 0; c < types.size(); ++c) block.columns[c].type = types[c];
+    block.num_rows = 0;
+    blockBytes = 0;
+    if (existing > 0) return true;
+
+    uint32_t magic = run_magic;
+    uint32_t count = static_cast<uint32_t>(types.size());
+    out.write((char *)&magic, sizeof(magic));
+    out.write((char *)&count, sizeof(count));
+    for (ValueType t : types) {
+        uint8_t code = static_cast<uint8_t>(t);
+        out.write((char *)&code, sizeof(code));
+    }
+    return true;
+}
+
+void RunWriter::appendRow(const MixBatch &batch, size_t row) {
+    for (size_t c = 0; c < block.columns.size() && c < batch.columns.size(); ++c) {
+        const ColumnData &src = batch.columns[c];
+        if (row >= src.size()) continue;
+        block.columns[c].appendFrom(src, row);
+        blockBytes += src.type == ValueType::VARCHAR ? src.stringAt(row).size() + sizeof(uint32_t) : sizeof(int64_t);
+    }
+    block.num_rows++;
+    if (block.num_rows >= BATCH_SIZE || blockBytes >= RUN_BLOCK_BYTES) flushBlock();
+}
+
+void RunWriter::flushBlock() {
+    if (block.num_rows == 0) return;
+    uint32_t rows = static_cast<uint32_t>(block.num_rows);
+
+    payload.clear();
+    for (auto &col : block.columns) {
+        uint8_t present = col.size() == rows ? 1 : 0;
+        putValue(payload, present);
+        if (present) {
+            switch (col.type) {
+                case ValueType::INT64:
+                    putRaw(payload, col.ints.data(), rows);
+                    break;
+                case ValueType::VARCHAR:
+                    for (size_t r = 0; r < rows; ++r) putValue(payload, static_cast<uint32_t>(col.stringAt(r).size()));
+                    putRaw(payload, col.bytes.data(), col.bytes.size());
+                    break;
+                case ValueType::BOOL:
+                    putRaw(payload, col.bits.data(), col.bits.size());
+                    break;
+            }
+        }
+        ValueType type = col.type;
+        col = ColumnData();
+        col.type = type;
+    }
+
+    uint32_t rawSize = static_cast<uint32_t>(payload.size());
+    uint32_t storedSize = rawSize;
+    uint8_t compressed = 0;
+    const char *data = payload.data();
+    if (compress) {
+        stored.resize(ZSTD_compressBound(payload.size()));
+        size_t res = ZSTD_compress(stored.data(), stored.size(), payload.data(), payload.size(), RUN_COMPRESSION_LEVEL);
+        if (!ZSTD_isError(res) && res < payload.size()) {
+            storedSize = static_cast<uint32_t>(res);
+            compressed = 1;
+            data = stored.data();
+        }
+    }
+
+    out.write((char *)&rows, sizeof(rows));
+    out.write((char *)&rawSize, sizeof(rawSize));
+    out.write((char *)&storedSize, sizeof(storedSize));
+    out.write((char *)&compressed, sizeof(compressed));
+    out.write(data, storedSize);
+
+    block.num_rows = 0;
+    blockBytes = 0;
+}
+
+void RunWriter::flush() {
+    flushBlock();
+    out.flush();
+}
+
+void RunWriter::close() {
+    if (!out.is_open()) return;
+    flushBlock();
+    uint32_t end = 0;
+    out.write((char *)&end, sizeof(end));
+    out.close();
+}
+
+bool RunReader::open(const std::string &path) {
+    buffer.resize(RUN_IO_BUFFER);
+    in.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    std::error_code ec;
+    end = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    in.open(path, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    uint32_t magic = 0;
+    uint32_t count = 0;
+    in.read((char *)&magic, sizeof(magic));
+    in.read((char *)&count, sizeof(count));
+    if (!in || magic != run_magic) return false;
+    types.resize(count);
+    for (uint32_t c = 0; c < count; ++c) {
+        uint8_t code = 0;
+        in.read((char *)&code, sizeof(code));
+        types[c] = static_cast<ValueType>(code);
+    }
+    return static_cast<bool>(in);
+}
+
+bool RunReader::readHeader() {
+    if (pending) return header.rows > 0;
+    header = BlockHeader();
+    in.read((char *)&header.rows, sizeof(header.rows));
+    if (!in || header.rows == 0) {
+        header.rows = 0;
+        return false;
+    }
+    in.read((char *)&header.rawSize, sizeof(header.rawSize));
+    in.read((char *)&header.storedSize, sizeof(header.storedSize));
+    in.read((char *)&header.compressed, sizeof(header.compressed));
+    uint64_t payloadBytes = header.compressed ? header.storedSize : header.rawSize;
+    if (!in || static_cast<uint64_t>(in.tellg()) + payloadBytes > end) {
+        header.rows = 0;
+        return false;
+    }
+    pending = true;
+    return true;
+}
+
+bool RunReader::hasNextBlock() {
+    return readHeader();
+}
+
+size_t RunReader::skipRows(size_t rows) {
+    size_t skipped = 0;
+    while (readHeader() && skipped + header.rows <= rows) {
+        in.seekg(header.compressed ? header.storedSize : header.rawSize, std::ios::cur);
+        skipped += header.rows;
+        pending = false;
+    }
+    return skipped;
+}
+
+bool RunReader::nextBlock(MixBatch &block) {
+    if (!readHeader()) return false;
+    pending = false;
+    return readPayload(block, SIZE_MAX);
+}
+
+bool RunReader::nextBlockColumn(MixBatch &block, size_t column) {
+    if (!readHeader()) return false;
+    pending = false;
+    return readPayload(block, column);
+}
+
+// With `only` set to a column index, the other columns are stepped over
+// without being copied out of the payload.
+bool RunReader::readPayload(MixBatch &block, size_t only) {
+    uint32_t rows = header.rows;
+    uint32_t rawSize = header.rawSize;
+    uint32_t storedSize = header.storedSize;
+
+    payload.resize(rawSize);
+    if (header.compressed) {
+        stored.resize(storedSize);
+        in.read(stored.data(), storedSize);
+        size_t res = ZSTD_decompress(payload.data(), payload.size(), stored.data(), storedSize);
+        if (ZSTD_isError(res) || res != rawSize) return false;
+    } else {
+        in.read(payload.data(), rawSize);
+    }
+    if (!in) return false;
+
+    block.num_rows = rows;
+    block.columns.clear();
+    block.columns.resize(types.size());
+    const char *p = payload.data();
+    for (size_t c = 0; c < types.size(); ++c) {
+        ColumnData &col = block.columns[c];
+        col.type = types[c];
+        uint8_t present = 0;
+        p = getRaw(p, &present, 1);
+        if (!present) continue;
+        if (only != SIZE_MAX && c != only) {
+            switch (col.type) {
+                case ValueType::INT64:
+                    p += rows * sizeof(int64_t);
+                    break;
+                case ValueType::VARCHAR: {
+                    uint64_t bytes = 0;
+                    for (size_t r = 0; r < rows; ++r) {
+                        uint32_t len = 0;
+                        p = getRaw(p, &len, 1);
+                        bytes += len;
+                    }
+                    p += bytes;
+                    break;
+                }
+                case ValueType::BOOL:
+                    p += (rows + 63) / 64 * sizeof(uint64_t);
+                    break;
+            }
+            continue;
+        }
+        col.count = rows;
+        switch (col.type) {
+            case ValueType::INT64:
+                col.ints.resize(rows);
+                p = getRaw(p, col.ints.data(), rows);
+                break;
+            case ValueType::VARCHAR: {
+                col.offsets.resize(rows);
+                uint64_t end = 0;
+                for (size_t r = 0; r < rows; ++r) {
+                    uint32_t len = 0;
+                    p = getRaw(p, &len, 1);
+                    end += len;
+                    col.offsets[r] = end;
+                }
+                col.bytes.assign(p, end);
+                p += end;
+                break;
+            }
+            case ValueType::BOOL:
+                col.bits.resize((rows + 63) / 64);
+                p = getRaw(p, col.bits.data(), col.bits.size());
+                break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../../types.h"
+#include <fstream>
+
+// Block file used for external sort runs, aggregation spills and query results:
+//   header: run_magic | column count u32 | column types u8[]
+//   blocks: row_count u32 | raw_size u32 | stored_size u32 | compressed u8 | payload
+//   end:    row_count 0
+// The payload stores each column of the block one after another: a present
+// flag, then INT64 values, VARCHAR lengths followed by bytes, or BOOL bit words.
+
+class RunWriter {
+public:
+    // With append set, blocks are added to an existing file of the same column
+    // types (its end marker is dropped); otherwise the file is recreated.
+    bool open(const std::string &path, const std::vector<ValueType> &types, bool compress = true, bool append = false);
+
+    void appendRow(const MixBatch &batch, size_t row);
+
+    // Ends the current block and hands it to the file, so readers opening the
+    // file from now on see it.
+    void flush();
+
+    void close();
+
+private:
+    void flushBlock();
+
+    std::ofstream out;
+    std::vector<ValueType> types;
+    bool compress = true;
+    MixBatch block;
+    size_t blockBytes = 0;
+    std::vector<char> payload;
+    std::vector<char> stored;
+};
+
+class RunReader {
+public:
+    // Only blocks completely written when the file is opened are visible, so a
+    // file that is still being appended to can be read safely.
+    bool open(const std::string &path);
+
+    const std::vector<ValueType> &columnTypes() const { return types; }
+
+    // Replaces `block` with the next block of the run; false once the run is exhausted.
+    bool nextBlock(MixBatch &block);
+
+    // Like nextBlock, but only `column` is decoded; the other columns of the
+    // block are skipped and left empty.
+    bool nextBlockColumn(MixBatch &block, size_t column);
+
+    // Skips whole blocks as long as they fit in `rows` without decoding them;
+    // returns the number of rows skipped.
+    size_t skipRows(size_t rows);
+
+    bool hasNextBlock();
+
+private:
+    bool readHeader();
+    bool readPayload(MixBatch &block, size_t only);
+
+    struct BlockHeader {
+        uint32_t rows = 0;
+        uint32_t rawSize = 0;
+        uint32_t storedSize = 0;
+        uint8_t compressed = 0;
+    };
+    BlockHeader header;
+    bool pending = false;
+    uint64_t end = 0;
+
+    std::ifstream in;
+    std::vector<char> buffer;
+    std::vector<ValueType> types;
+    std::vector<char> stored;
+    std::vector<char> payload;
+};
@@ -5,21 +5,21 @@
 #include <unordered_map>
 
 #include "../evaluation/evalColumnExpression.h"
-#include "../evaluation/expression_cache.h"
-#include "../evaluation/expression_hasher.h"
+#include "../evaluation/vectorEval.h"
+#include "runFile.h"
+#include "loserTree.h"
+#include "sortKeys.h"
 #include "../../metastore/metastore.h"
-#include "../evaluation/evalColumnExpression.h"
 #include <fstream>
 #include <sstream>
 #include <vector>
-#include <queue>
+#include <thread>
+#include <atomic>
 #include <cstdio>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <nlohmann/json.hpp>
-using json = nlohmann::ordered_json;
 #include "../../utils/utils.h"
 
 const size_t MEMORY_LIMIT = (size_t)4 * 1024 * 1024;
@@ -32,29 +32,28 @@ SELECT_TABLE_ERROR executeSelectBatch(const SelectQuery &query, const Batch &bat
     return SELECT_TABLE_ERROR::NONE;
 }
 
-SELECT_TABLE_ERROR transformBatch(const SelectQuery &query, const Batch &batch, MixBatch &outBatch) {
-    TableInfo info;
-    if (query.tableName.empty()) {
-        info.name = std::string();
-        info.id = 0;
-        info.info.clear();
-        info.location.clear();
-        info.files.clear();
-    } else {
-        auto infoOpt = getTableInfoByName(query.tableName);
-        if (!infoOpt) return SELECT_TABLE_ERROR::TABLE_NOT_EXISTS;
-        info = *infoOpt;
-    }
+// Binds the referenced columns of a scanned batch to their positions in the
+// planned table schema.
+static SELECT_TABLE_ERROR bindBatchInput(const SelectQuery &query, const Batch &batch, BatchInput &input) {
+    if (!query.table) return SELECT_TABLE_ERROR::TABLE_NOT_EXISTS;
+    const TableInfo &info = *query.table;
+
+    std::vector<const IntColumn*> intCols;
+    std::vector<const StringColumn*> strCols;
+    for (const auto &c : batch.intColumns) intCols.push_back(&c);
+    for (const auto &c : batch.sharedIntColumns) intCols.push_back(c.get());
+    for (const auto &c : batch.stringColumns) strCols.push_back(&c);
+    for (const auto &c : batch.sharedStringColumns) strCols.push_back(c.get());
 
     std::unordered_map<std::string, size_t> intIndex;
     std::unordered_map<std::string, size_t> strIndex;
-    for (size_t i = 0; i < batch.intColumns.size(); ++i) intIndex[batch.intColumns[i].name] = i;
-    for (size_t i = 0; i < batch.stringColumns.size(); ++i) strIndex[batch.stringColumns[i].name] = i;
+    for (size_t i = 0; i < intCols.size(); ++i) intIndex[intCols[i]->name] = i;
+    for (size_t i = 0; i < strCols.size(); ++i) strIndex[strCols[i]->name] = i;
 
 
     bool hasNames = false;
-    for (const auto &c : batch.intColumns) if (!c.name.empty()) { hasNames = true; break; }
-    if (!hasNames) for (const auto &c : batch.stringColumns) if (!c.name.empty()) { hasNames = true; break; }
+    for (const auto *c : intCols) if (!c->name.empty()) { hasNames = true; break; }
+    if (!hasNames) for (const auto *c : strCols) if (!c->name.empty()) { hasNames = true; break; }
     if (!hasNames) {
         intIndex.clear();
         strIndex.clear();
@@ -70,6 +69,46 @@ SELECT_TABLE_ERROR transformBatch(const SelectQuery &query, const Batch &batch,
         }
     }
 
+    size_t baseCols = info.info.size();
+    std::vector<std::pair<size_t, const std::vector<int64_t>*>> intInputs;
+    std::vector<std::pair<size_t, const StringColumn*>> strInputs;
+    for (size_t c : query.referencedColumns) {
+        if (c >= baseCols) continue;
+        const auto &col = info.info[c];
+        const std::string &name = col.first;
+        const std::string &typeStr = col.second;
+        bool isInt = typeStr == "INT64";
+        bool found = isInt ? intIndex.count(name) > 0 : strIndex.count(name) > 0;
+        if (!found) {
+            std::string msg = std::string("transformBatch: missing ") + (isInt ? "int" : "string") + " column '" + name + "' in input batch for table " + query.tableName;
+            log_error(msg);
+            std::string available = "available int columns: ";
+            for (const auto &p : intIndex) available += p.first + ",";
+            log_error(available);
+            std::string availableStr = "available str columns: ";
+            for (const auto &p : strIndex) availableStr += p.first + ",";
+            log_error(availableStr);
+            return SELECT_TABLE_ERROR::TABLE_NOT_EXISTS;
+        }
+        if (isInt) intInputs.emplace_back(c, &intCols[intIndex[name]]->column);
+        else strInputs.emplace_back(c, strCols[strIndex[name]]);
+    }
+
+    input.num_rows = batch.num_rows;
+    input.intColumns.assign(baseCols, nullptr);
+    input.stringColumns.assign(baseCols, nullptr);
+    for (const auto &in : intInputs) input.intColumns[in.first] = in.second;
+    for (const auto &in : strInputs) input.stringColumns[in.first] = in.second;
+
+    return SELECT_TABLE_ERROR::NONE;
+}
+
+SELECT_TABLE_ERROR transformBatch(const SelectQuery &query, const Batch &batch, MixBatch &outBatch) {
+    BatchInput input;
+    SELECT_TABLE_ERROR bound = bindBatchInput(query, batch, input);
+    if (bound != SELECT_TABLE_ERROR::NONE) return bound;
+    const TableInfo &info = *query.table;
+
     size_t baseCols = info.info.size();
     size_t projCols = query.columnClauses.size();
     size_t whereCol = query.whereClause ? 1 : 0;
@@ -90,104 +129,127 @@ SELECT_TABLE_ERROR transformBatch(const SelectQuery &query, const Batch &batch,
     for (size_t c = 0; c < projCols; ++c) outBatch.columns[baseCols + c].type = ValueType::INT64;
     if (whereCol) outBatch.columns[baseCols + projCols].type = ValueType::BOOL;
 
-    std::unordered_map<size_t, int> exprCount;
-    std::unordered_map<size_t, const ColumnExpression*> exprMap;
+    VectorEvaluator full(input);
+    std::vector<uint32_t> selection;
+    bool filtered = false;
     if (query.whereClause) {
-        size_t h = hashExpression(*query.whereClause);
-        exprCount[h]++;
-        exprMap.emplace(h, query.whereClause.get());
-    }
-    for (const auto &pc : query.columnClauses) {
-        size_t h = hashExpression(*pc);
-        exprCount[h]++;
-        exprMap.emplace(h, pc.get());
+        ColumnVectorPtr mask = full.eval(*query.whereClause);
+        if (mask->type != ValueType::BOOL) return SELECT_TABLE_ERROR::INVALID_WHERE;
+        selection = selectionFromBools(*mask);
+        filtered = selection.size() != batch.num_rows;
     }
-    std::vector<size_t> precomputeHashes;
-    for (const auto &kv : exprCount) {
-        if (kv.second > 1) {
-            precomputeHashes.push_back(kv.first);
+
+    std::unique_ptr<VectorEvaluator> selected;
+    if (filtered) selected = std::make_unique<VectorEvaluator>(input, &selection);
+    VectorEvaluator &evaluator = filtered ? *selected : full;
+    size_t outRows = evaluator.rows();
+
+    for (size_t p = 0; p < projCols; ++p) {
+        ColumnVectorPtr vec = evaluator.eval(*query.columnClauses[p]);
+        auto &out = outBatch.columns[baseCols + p];
+        out.type = vec->type;
+        out.reserve(outRows);
+        switch (vec->type) {
+            case ValueType::INT64:
+                if (vec->constant) out.ints.assign(outRows, vec->ints[0]);
+                else out.ints.assign(vec->ints, vec->ints + outRows);
+                out.count = outRows;
+                break;
+            case ValueType::VARCHAR:
+                for (size_t r = 0; r < outRows; ++r) out.appendString(vec->stringAt(r));
+                break;
+            case ValueType::BOOL:
+                for (size_t r = 0; r < outRows; ++r) out.appendBool(vec->boolAt(r));
+                break;
         }
     }
 
-    for (size_t rowIdx = 0; rowIdx < batch.num_rows; ++rowIdx) {
-        ResultRow rawRow;
-        rawRow.values.reserve(baseCols);
+    if (whereCol) {
+        auto &out = outBatch.columns[baseCols + projCols];
+        out.reserve(outRows);
+        for (size_t r = 0; r < outRows; ++r) out.appendBool(true);
+    }
 
-        for (size_t c = 0; c < baseCols; ++c) {
-            const auto &col = info.info[c];
-            const std::string &name = col.first;
-            const std::string &typeStr = col.second;
-            if (typeStr == "INT64") {
-                auto it = intIndex.find(name);
-                if (it == intIndex.end()) {
-                    std::string msg = std::string("transformBatch: missing int column '") + name + "' in input batch for table " + query.tableName;
-                    log_error(msg);
-                    std::string available = "available int columns: ";
-                    for (const auto &p : intIndex) available += p.first + ",";
-                    log_error(available);
-                    std::string availableStr = "available str columns: ";
-                    for (const auto &p : strIndex) availableStr += p.first + ",";
-                    log_error(availableStr);
-                    return SELECT_TABLE_ERROR::TABLE_NOT_EXISTS;
-                }
-                const auto &vec = batch.intColumns[it->second].column;
-                rawRow.values.push_back(Value{ValueType::INT64, vec[rowIdx], std::string(), false});
-            } else {
-                auto it = strIndex.find(name);
-                if (it == strIndex.end()) {
-                    std::string msg = std::string("transformBatch: missing string column '") + name + "' in input batch for table " + query.tableName;
-                    log_error(msg);
-                    std::string available = "available int columns: ";
-                    for (const auto &p : intIndex) available += p.first + ",";
-                    log_error(available);
-                    std::string availableStr = "available str columns: ";
-                    for (const auto &p : strIndex) availableStr += p.first + ",";
-                    log_error(availableStr);
-                    return SELECT_TABLE_ERROR::TABLE_NOT_EXISTS;
-                }
-                const auto &vec = batch.stringColumns[it->second].column;
-                rawRow.values.push_back(Value{ValueType::VARCHAR, 0, vec[rowIdx], false});
-            }
-        }
+    outBatch.num_rows = outRows;
 
-        ExpressionCache cache;
+    return SELECT_TABLE_ERROR::NONE;
+}
 
-        for (size_t h : precomputeHashes) {
-            auto it = exprMap.find(h);
-            if (it == exprMap.end()) continue;
-            const ColumnExpression *expr = it->second;
-            (void)evalColumnExpression(*expr, rawRow, &cache);
-        }
+SELECT_TABLE_ERROR aggregateBatch(const SelectQuery &query, const AggregatePlan &plan, const Batch &batch, HashAggregator &aggregator) {
+    BatchInput input;
+    SELECT_TABLE_ERROR bound = bindBatchInput(query, batch, input);
+    if (bound != SELECT_TABLE_ERROR::NONE) return bound;
 
-        bool wherePass = true;
-        if (query.whereClause) {
-            size_t wh = hashExpression(*query.whereClause);
-            Value wv = evalColumnExpression(*query.whereClause, rawRow, &cache);
-            if (wv.type != ValueType::BOOL) return SELECT_TABLE_ERROR::INVALID_WHERE;
-            wherePass = wv.boolValue;
-        }
+    VectorEvaluator full(input);
+    std::vector<uint32_t> selection;
+    bool filtered = false;
+    if (query.whereClause) {
+        ColumnVectorPtr mask = full.eval(*query.whereClause);
+        if (mask->type != ValueType::BOOL) return SELECT_TABLE_ERROR::INVALID_WHERE;
+        selection = selectionFromBools(*mask);
+        filtered = selection.size() != batch.num_rows;
+    }
 
-        if (!wherePass) continue;
+    std::unique_ptr<VectorEvaluator> selected;
+    if (filtered) selected = std::make_unique<VectorEvaluator>(input, &selection);
+    VectorEvaluator &evaluator = filtered ? *selected : full;
+    if (evaluator.rows() == 0) return SELECT_TABLE_ERROR::NONE;
 
-        for (size_t c = 0; c < baseCols; ++c) outBatch.columns[c].data.push_back(rawRow.values[c]);
+    std::vector<ColumnVectorPtr> keys;
+    for (const auto *k : plan.keys) keys.push_back(evaluator.eval(*k));
+    std::vector<ColumnVectorPtr> arguments;
+    for (const auto *a : plan.arguments) arguments.push_back(a ? evaluator.eval(*a) : nullptr);
 
-        for (size_t p = 0; p < projCols; ++p) {
-            size_t ph = hashExpression(*query.columnClauses[p]);
-            Value v = evalColumnExpression(*query.columnClauses[p], rawRow, &cache);
-            outBatch.columns[baseCols + p].type = v.type;
-            outBatch.columns[baseCols + p].data.push_back(v);
-        }
+    aggregator.update(keys, arguments, evaluator.rows());
+    return SELECT_TABLE_ERROR::NONE;
+}
 
-        if (whereCol) {
-            size_t wh = hashExpression(*query.whereClause);
-            Value wv = evalColumnExpression(*query.whereClause, rawRow, &cache);
-            outBatch.columns[baseCols + projCols].data.push_back(wv);
-        }
+MixBatch aggregateResult(const SelectQuery &query, const AggregatePlan &plan, const MixBatch &states, size_t baseCols) {
+    size_t nk = plan.keys.size();
+    size_t na = plan.aggregates.size();
+    size_t projCols = query.columnClauses.size();
 
-        outBatch.num_rows++;
+    MixBatch out;
+    out.columns.resize(baseCols + projCols);
+    for (size_t p = 0; p < projCols; ++p) out.columns[baseCols + p].type = query.columnClauses[p]->resultType;
+
+    // Aggregates without GROUP BY return one row even for empty input.
+    if (states.num_rows == 0) {
+        out.num_rows = nk == 0 ? 1 : 0;
+        if (nk == 0) {
+            for (size_t p = 0; p < projCols; ++p) {
+                ColumnData &col = out.columns[baseCols + p];
+                switch (col.type) {
+                    case ValueType::INT64: col.appendInt(0); break;
+                    case ValueType::VARCHAR: col.appendString(std::string_view()); break;
+                    case ValueType::BOOL: col.appendBool(false); break;
+                }
+            }
+        }
+        return out;
     }
 
-    return SELECT_TABLE_ERROR::NONE;
+    out.num_rows = states.num_rows;
+    const ColumnData &rowCounts = states.columns[nk + na];
+    for (size_t p = 0; p < projCols; ++p) {
+        ColumnData &col = out.columns[baseCols + p];
+        const auto &output = plan.outputs[p];
+        if (output.first) {
+            col = states.columns[output.second];
+            continue;
+        }
+        const ColumnData &state = states.columns[nk + output.second];
+        if (plan.aggregates[output.second].function != AggregateFunction::AVG) {
+            col = state;
+            continue;
+        }
+        col.reserve(states.num_rows);
+        for (size_t r = 0; r < states.num_rows; ++r) {
+            int64_t n = rowCounts.intAt(r);
+            col.appendInt(n ? state.intAt(r) / n : 0);
+        }
+    }
+    return out;
 }
 
 SELECT_TABLE_ERROR validateOrderByAndLimit(const std::vector<MixBatch> &batches,
@@ -204,6 +266,50 @@ SELECT_TABLE_ERROR validateOrderByAndLimit(const std::vector<MixBatch> &batches,
     return SELECT_TABLE_ERROR::NONE;
 }
 
+static std::vector<RowRef> collectRowRefs(const std::vector<MixBatch> &batches) {
+    size_t totalRows = 0;
+    for (const auto &b : batches) totalRows += b.num_rows;
+    std::vector<RowRef> refs;
+    refs.reserve(totalRows);
+    for (size_t b = 0; b < batches.size(); ++b) {
+        for (size_t r = 0; r < batches[b].num_rows; ++r) refs.push_back(RowRef{(uint32_t)b, (uint32_t)r});
+    }
+    return refs;
+}
+
+static std::string writeRun(const std::vector<MixBatch> &batches, std::vector<RowRef>::const_iterator begin, std::vector<RowRef>::const_iterator end) {
+    char tmpl[] = "batches/runXXXXXX";
+    int fd = mkstemp(tmpl);
+    if (fd == -1) throw std::runtime_error("mkstemp failed");
+    close(fd);
+    std::string path = std::string(tmpl);
+
+    std::vector<ValueType> types;
+    if (!batches.empty()) for (const auto &col : batches[0].columns) types.push_back(col.type);
+    RunWriter writer;
+    if (!writer.open(path, types)) throw std::runtime_error("cannot open run file " + path);
+    for (auto it = begin; it != end; ++it) writer.appendRow(batches[it->batch], it->row);
+    writer.close();
+    return path;
+}
+
+static MixBatch gatherRows(const std::vector<MixBatch> &batches, const std::vector<RowRef> &refs, size_t take) {
+    size_t numCols = batches[0].columns.size();
+    MixBatch out;
+    out.num_rows = take;
+    out.columns.resize(numCols);
+    for (size_t c = 0; c < numCols; ++c) {
+        ColumnData &col = out.columns[c];
+        col.type = batches[0].columns[c].type;
+        col.reserve(take);
+        for (size_t r = 0; r < take; ++r) {
+            const ColumnData &src = batches[refs[r].batch].columns[c];
+            if (refs[r].row < src.size()) col.appendFrom(src, refs[r].row);
+        }
+    }
+    return out;
+}
+
 SELECT_TABLE_ERROR orderAndLimitResult(std::vector<MixBatch> &batches,
                          const std::vector<OrderByExpression> &orderBy,
                          const std::optional<size_t> &limit) {
@@ -211,314 +317,189 @@ SELECT_TABLE_ERROR orderAndLimitResult(std::vector<MixBatch> &batches,
     auto v = validateOrderByAndLimit(batches, orderBy, limit);
     if (v != SELECT_TABLE_ERROR::NONE) return v;
 
-    using json = nlohmann::ordered_json;
-
     if (batches.empty()) return SELECT_TABLE_ERROR::NONE;
 
     size_t totalRows = 0;
-    for (const auto &b : batches) totalRows += b.num_rows;
+    size_t totalBytes = 0;
+    for (const auto &b : batches) {
+        totalRows += b.num_rows;
+        for (const auto &col : b.columns) totalBytes += col.memoryBytes();
+    }
     if (totalRows == 0) return SELECT_TABLE_ERROR::NONE;
 
-    size_t numCols = batches[0].columns.size();
-
-    size_t estPerInt = 8;
-    size_t estPerBool = 1;
-    size_t estPerVarchar = 24;
-
-    size_t estRowSize = 0;
-    for (size_t c = 0; c < numCols; ++c) {
-        switch (batches[0].columns[c].type) {
-            case ValueType::INT64: estRowSize += estPerInt; break;
-            case ValueType::VARCHAR: estRowSize += estPerVarchar; break;
-            case ValueType::BOOL: estRowSize += estPerBool; break;
-        }
-    }
-
-    size_t estimatedBytes = estRowSize * totalRows;
-    auto rowCompare = [&](const ResultRow &a, const ResultRow &b) {
-        for (const auto &o : orderBy) {
-            const Value &va = a.values[o.columnIndex];
-            const Value &vb = b.values[o.columnIndex];
-            int cmp = 0;
-            if (va.type == vb.type) {
-                switch (va.type) {
-                    case ValueType::INT64:   cmp = (va.intValue < vb.intValue) ? -1 : (va.intValue > vb.intValue ? 1 : 0); break;
-                    case ValueType::VARCHAR: cmp = va.stringValue.compare(vb.stringValue); break;
-                    case ValueType::BOOL:    cmp = (va.boolValue == vb.boolValue) ? 0 : (va.boolValue ? 1 : -1); break;
-                }
-            } else {
-                cmp = std::to_string(va.intValue).compare(std::to_string(vb.intValue));
-            }
-            if (cmp != 0) return o.ascending ? (cmp < 0) : (cmp > 0);
-        }
-        return false;
-    };
+    std::vector<RowRef> refs = collectRowRefs(batches);
+    size_t estimatedBytes = totalBytes * 2 + refs.size() * sizeof(RowRef);
 
     if (estimatedBytes <= MEMORY_LIMIT) {
-        std::vector<ResultRow> allRows;
-        allRows.reserve(totalRows);
-
-        for (const auto &b : batches) {
-            for (size_t r = 0; r < b.num_rows; ++r) {
-                ResultRow row;
-                row.values.reserve(numCols);
-                for (size_t c = 0; c < numCols; ++c) {
-                    if (r < b.columns[c].data.size()) row.values.push_back(b.columns[c].data[r]);
-                    else row.values.push_back(Value{ValueType::INT64, 0, std::string(), false});
-                }
-                allRows.push_back(std::move(row));
-            }
-        }
+        sortRowRefs(batches, orderBy, refs.begin(), refs.end());
 
-    if (!orderBy.empty()) std::sort(allRows.begin(), allRows.end(), rowCompare);
-    
-        size_t take = allRows.size();
+        size_t take = refs.size();
         if (limit.has_value() && take > limit.value()) take = limit.value();
 
-        MixBatch finalBatch;
-        finalBatch.num_rows = take;
-        finalBatch.columns.resize(numCols);
-        for (size_t c = 0; c < numCols; ++c) {
-            if (!allRows.empty()) finalBatch.columns[c].type = allRows[0].values[c].type;
-            finalBatch.columns[c].data.reserve(take);
-            for (size_t r = 0; r < take; ++r) finalBatch.columns[c].data.push_back(allRows[r].values[c]);
-        }
-
+        MixBatch finalBatch = gatherRows(batches, refs, take);
         batches.clear();
         batches.push_back(std::move(finalBatch));
         return SELECT_TABLE_ERROR::NONE;
     }
 
     log_info(std::string("orderAndLimitResult: using external merge-sort"));
-    auto serializeRow = [&](const ResultRow &row) {
-        json j = json::array();
-        for (const auto &v : row.values) {
-            switch (v.type) {
-                case ValueType::INT64: j.push_back(v.intValue); break;
-                case ValueType::VARCHAR: j.push_back(v.stringValue); break;
-                case ValueType::BOOL: j.push_back(v.boolValue); break;
-            }
-        }
-        return j.dump();
-    };
 
-    auto deserializeRow = [&](const std::string &line) {
-        json j = json::parse(line);
-        ResultRow row;
-        row.values.reserve(j.size());
-        for (size_t i = 0; i < j.size(); ++i) {
-            const auto &cell = j[i];
-            if (cell.is_string()) row.values.push_back(Value{ValueType::VARCHAR, 0, cell.get<std::string>(), false});
-            else if (cell.is_boolean()) row.values.push_back(Value{ValueType::BOOL, 0, std::string(), cell.get<bool>()});
-            else row.values.push_back(Value{ValueType::INT64, cell.get<int64_t>(), std::string(), false});
-        }
-        return row;
-    };
-
-    std::vector<std::string> runFiles;
-    std::vector<ResultRow> runRows;
-
-    size_t runRowLimit = std::max<size_t>(1, MEMORY_LIMIT / 4 / std::max<size_t>(1, estRowSize));
-
-    auto flushRun = [&](void) {
-        if (runRows.empty()) return;
-        if (!orderBy.empty()) std::sort(runRows.begin(), runRows.end(), rowCompare);
-        char tmpl[] = "batches/runXXXXXX";
-        int fd = mkstemp(tmpl);
-        if (fd == -1) throw std::runtime_error("mkstemp failed");
-        close(fd);
-        std::string path = std::string(tmpl);
-        std::ofstream ofs(path);
-        for (const auto &r : runRows) ofs << serializeRow(r) << '\n';
-        ofs.close();
-        runFiles.push_back(path);
-        runRows.clear();
-    };
-
-    for (const auto &b : batches) {
-        for (size_t r = 0; r < b.num_rows; ++r) {
-            ResultRow row;
-            row.values.reserve(numCols);
-            for (size_t c = 0; c < numCols; ++c) {
-                if (r < b.columns[c].data.size()) row.values.push_back(b.columns[c].data[r]);
-                else row.values.push_back(Value{ValueType::INT64, 0, std::string(), false});
+    size_t bytesPerRow = std::max<size_t>(1, totalBytes / totalRows);
+    size_t runRowLimit = std::max<size_t>(1, MEMORY_LIMIT / 4 / bytesPerRow);
+
+    size_t numRuns = (refs.size() + runRowLimit - 1) / runRowLimit;
+    std::vector<std::string> runFiles(numRuns);
+    size_t threads = std::max<size_t>(1, std::min<size_t>(numRuns, std::thread::hardware_concurrency()));
+    std::atomic<size_t> nextRun{0};
+    std::vector<std::string> errors(threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            try {
+                for (size_t run = nextRun++; run < numRuns; run = nextRun++) {
+                    auto first = refs.begin() + run * runRowLimit;
+                    auto last = refs.begin() + std::min(refs.size(), (run + 1) * runRowLimit);
+                    sortRowRefs(batches, orderBy, first, last, false);
+                    runFiles[run] = writeRun(batches, first, last);
+                }
+            } catch (const std::exception &e) {
+                errors[t] = e.what();
             }
-            runRows.push_back(std::move(row));
-            if (runRows.size() >= runRowLimit) flushRun();
-        }
-    }
-    flushRun();
-
-    struct HeapItem { ResultRow row; size_t fileIdx; };
-    auto cmpHeap = [&](const HeapItem &a, const HeapItem &b) { return rowCompare(b.row, a.row); };
-    std::priority_queue<HeapItem, std::vector<HeapItem>, decltype(cmpHeap)> heap(cmpHeap);
-
-    std::vector<std::ifstream> ifs;
-    ifs.reserve(runFiles.size());
-    for (const auto &p : runFiles) ifs.emplace_back(p);
-
-    for (size_t i = 0; i < ifs.size(); ++i) {
-        std::string line;
-        if (std::getline(ifs[i], line)) {
-            heap.push(HeapItem{deserializeRow(line), i});
-        }
+        });
     }
-
-    std::vector<ResultRow> merged;
-    merged.reserve(limit.value_or(1024));
-    while (!heap.empty() && (!limit.has_value() || merged.size() < limit.value())) {
-        auto top = heap.top(); heap.pop();
-        merged.push_back(std::move(top.row));
-        size_t idx = top.fileIdx;
-        std::string line;
-        if (std::getline(ifs[idx], line)) heap.push(HeapItem{deserializeRow(line), idx});
-    }
-
-    for (size_t i = 0; i < ifs.size(); ++i) {
-        ifs[i].close();
-        std::remove(runFiles[i].c_str());
-    }
-
-    size_t take = merged.size();
-    MixBatch finalBatch;
-    finalBatch.num_rows = take;
-    finalBatch.columns.resize(numCols);
-    if (!merged.empty()) for (size_t c = 0; c < numCols; ++c) finalBatch.columns[c].type = merged[0].values[c].type;
-    for (size_t c = 0; c < numCols; ++c) {
-        finalBatch.columns[c].data.reserve(take);
-        for (size_t r = 0; r < take; ++r) finalBatch.columns[c].data.push_back(merged[r].values[c]);
+    for (auto &w : workers) w.join();
+    for (const auto &e : errors) {
+        if (!e.empty()) throw std::runtime_error(e);
     }
 
+    MixBatch finalBatch = mergeRunFiles(runFiles, orderBy, limit);
     batches.clear();
     batches.push_back(std::move(finalBatch));
     return SELECT_TABLE_ERROR::NONE;
 }
 
 std::string spillBatchesToRun(const std::vector<MixBatch> &batches, const std::vector<OrderByExpression> &orderBy) {
-    size_t numCols = 0;
-    if (!batches.empty()) numCols = batches[0].columns.size();
-    std::vector<ResultRow> rows;
-    for (const auto &b : batches) {
-        for (size_t r = 0; r < b.num_rows; ++r) {
-            ResultRow row;
-            row.values.reserve(numCols);
-            for (size_t c = 0; c < numCols; ++c) {
-                if (r < b.columns[c].data.size()) row.values.push_back(b.columns[c].data[r]);
-                else row.values.push_back(Value{ValueType::INT64, 0, std::string(), false});
-            }
-            rows.push_back(std::move(row));
+    std::vector<RowRef> refs = collectRowRefs(batches);
+    sortRowRefs(batches, orderBy, refs.begin(), refs.end());
+    return writeRun(batches, refs.begin(), refs.end());
+}
+
+MixBatch mergeRunFiles(const std::vector<std::string> &runFiles, const std::vector<OrderByExpression> &orderBy, const std::optional<size_t> &limit) {
+    struct RunCursor {
+        std::unique_ptr<RunReader> reader;
+        MixBatch block;
+        size_t row = 0;
+    };
+    std::vector<RunCursor> runs;
+    runs.reserve(runFiles.size());
+    for (const auto &p : runFiles) {
+        RunCursor cursor;
+        cursor.reader = std::make_unique<RunReader>();
+        if (!cursor.reader->open(p)) {
+            log_error(std::string("mergeRunFiles: cannot open run file ") + p);
+            continue;
         }
+        if (cursor.reader->nextBlock(cursor.block)) runs.push_back(std::move(cursor));
     }
 
-    auto rowCompareLocal = [&](const ResultRow &a, const ResultRow &b) {
+    auto runLess = [&](size_t a, size_t b) {
+        const RunCursor &ra = runs[a];
+        const RunCursor &rb = runs[b];
         for (const auto &o : orderBy) {
-            const Value &va = a.values[o.columnIndex];
-            const Value &vb = b.values[o.columnIndex];
-            int cmp = 0;
-            if (va.type == vb.type) {
-                switch (va.type) {
-                    case ValueType::INT64:   cmp = (va.intValue < vb.intValue) ? -1 : (va.intValue > vb.intValue ? 1 : 0); break;
-                    case ValueType::VARCHAR: cmp = va.stringValue.compare(vb.stringValue); break;
-                    case ValueType::BOOL:    cmp = (va.boolValue == vb.boolValue) ? 0 : (va.boolValue ? 1 : -1); break;
-                }
-            } else cmp = std::to_string(va.intValue).compare(std::to_string(vb.intValue));
+            int cmp = compareCells(ra.block.columns[o.columnIndex], ra.row, rb.block.columns[o.columnIndex], rb.row);
             if (cmp != 0) return o.ascending ? (cmp < 0) : (cmp > 0);
         }
-        return false;
+        return a < b;
     };
+    auto exhausted = [&](size_t a) { return runs[a].row >= runs[a].block.num_rows; };
+    LoserTree<decltype(runLess), decltype(exhausted)> tree(runs.size(), runLess, exhausted);
 
-    if (!orderBy.empty()) std::sort(rows.begin(), rows.end(), rowCompareLocal);
+    MixBatch finalBatch;
+    finalBatch.num_rows = 0;
+    if (!runs.empty()) {
+        finalBatch.columns.resize(runs[0].block.columns.size());
+        for (size_t c = 0; c < finalBatch.columns.size(); ++c) finalBatch.columns[c].type = runs[0].block.columns[c].type;
+    }
 
-    char tmpl[] = "batches/runXXXXXX";
-    int fd = mkstemp(tmpl);
-    if (fd == -1) throw std::runtime_error("mkstemp failed in spillBatchesToRun");
-    close(fd);
-    std::string path = std::string(tmpl);
-    std::ofstream ofs(path);
-    for (const auto &r : rows) {
-        json j = json::array();
-        for (const auto &v : r.values) {
-            switch (v.type) {
-                case ValueType::INT64: j.push_back(v.intValue); break;
-                case ValueType::VARCHAR: j.push_back(v.stringValue); break;
-                case ValueType::BOOL: j.push_back(v.boolValue); break;
-            }
+    while (!tree.empty() && (!limit.has_value() || finalBatch.num_rows < limit.value())) {
+        RunCursor &run = runs[tree.top()];
+        for (size_t c = 0; c < finalBatch.columns.size(); ++c) {
+            const ColumnData &src = run.block.columns[c];
+            if (run.row < src.size()) finalBatch.columns[c].appendFrom(src, run.row);
+        }
+        finalBatch.num_rows++;
+        if (++run.row >= run.block.num_rows) {
+            if (run.reader->nextBlock(run.block)) run.row = 0;
         }
-        ofs << j.dump() << '\n';
+        tree.replay();
     }
-    ofs.close();
-    return path;
+
+    runs.clear();
+    for (const auto &p : runFiles) std::remove(p.c_str());
+
+    return finalBatch;
 }
 
-MixBatch mergeRunFiles(const std::vector<std::string> &runFiles, const std::vector<OrderByExpression> &orderBy, const std::optional<size_t> &limit) {
-    struct HeapItem { ResultRow row; size_t fileIdx; };
-    auto rowCompareLocal = [&](const ResultRow &a, const ResultRow &b) {
-        for (const auto &o : orderBy) {
-            const Value &va = a.values[o.columnIndex];
-            const Value &vb = b.values[o.columnIndex];
-            int cmp = 0;
-            if (va.type == vb.type) {
-                switch (va.type) {
-                    case ValueType::INT64:   cmp = (va.intValue < vb.intValue) ? -1 : (va.intValue > vb.intValue ? 1 : 0); break;
-                    case ValueType::VARCHAR: cmp = va.stringValue.compare(vb.stringValue); break;
-                    case ValueType::BOOL:    cmp = (va.boolValue == vb.boolValue) ? 0 : (va.boolValue ? 1 : -1); break;
-                }
-            } else cmp = std::to_string(va.intValue).compare(std::to_string(vb.intValue));
-            if (cmp != 0) return o.ascending ? (cmp < 0) : (cmp > 0);
-        }
-        return false;
-    };
+TopNOperator::TopNOperator(const std::vector<OrderByExpression> &orderBy, size_t limit)
+    : orderBy(orderBy), limit(limit) {
+    kept.num_rows = 0;
+}
 
-    auto cmpHeap = [&](const HeapItem &a, const HeapItem &b) { return rowCompareLocal(b.row, a.row); };
-    std::priority_queue<HeapItem, std::vector<HeapItem>, decltype(cmpHeap)> heap(cmpHeap);
-
-    std::vector<std::ifstream> ifs;
-    ifs.reserve(runFiles.size());
-    for (const auto &p : runFiles) ifs.emplace_back(p);
-
-    auto deserializeRowLocal = [&](const std::string &line) {
-        json j = json::parse(line);
-        ResultRow row;
-        row.values.reserve(j.size());
-        for (size_t i = 0; i < j.size(); ++i) {
-            const auto &cell = j[i];
-            if (cell.is_string()) row.values.push_back(Value{ValueType::VARCHAR, 0, cell.get<std::string>(), false});
-            else if (cell.is_boolean()) row.values.push_back(Value{ValueType::BOOL, 0, std::string(), cell.get<bool>()});
-            else row.values.push_back(Value{ValueType::INT64, cell.get<int64_t>(), std::string(), false});
-        }
-        return row;
-    };
-    for (size_t i = 0; i < ifs.size(); ++i) {
-        std::string line;
-        if (std::getline(ifs[i], line)) {
-            heap.push(HeapItem{deserializeRowLocal(line), i});
-        }
+int TopNOperator::compareToThreshold(const MixBatch &batch, size_t row) const {
+    for (const auto &o : orderBy) {
+        int cmp = compareCells(batch.columns[o.columnIndex], row, kept.columns[o.columnIndex], limit - 1);
+        if (cmp != 0) return o.ascending ? cmp : -cmp;
     }
+    return 0;
+}
 
-    std::vector<ResultRow> merged;
-    merged.reserve(limit.value_or(1024));
-    while (!heap.empty() && (!limit.has_value() || merged.size() < limit.value())) {
-        auto top = heap.top(); heap.pop();
-        merged.push_back(std::move(top.row));
-        size_t idx = top.fileIdx;
-        std::string line;
-        if (std::getline(ifs[idx], line)) heap.push(HeapItem{deserializeRowLocal(line), idx});
+void TopNOperator::consume(const MixBatch &batch) {
+    if (limit == 0 || batch.num_rows == 0) return;
+    if (kept.columns.empty()) {
+        kept.columns.resize(batch.columns.size());
+        for (size_t c = 0; c < batch.columns.size(); ++c) kept.columns[c].type = batch.columns[c].type;
     }
 
-    for (size_t i = 0; i < ifs.size(); ++i) {
-        ifs[i].close();
-        std::remove(runFiles[i].c_str());
+    for (size_t r = 0; r < batch.num_rows; ++r) {
+        if (full && compareToThreshold(batch, r) >= 0) continue;
+        for (size_t c = 0; c < batch.columns.size(); ++c) {
+            if (r < batch.columns[c].size()) kept.columns[c].appendFrom(batch.columns[c], r);
+        }
+        kept.num_rows++;
+        if (kept.num_rows >= std::max<size_t>(2 * limit, BATCH_SIZE)) compact();
     }
+}
 
-    MixBatch finalBatch;
-    if (merged.empty()) return finalBatch;
-    size_t numCols = merged[0].values.size();
-    finalBatch.num_rows = merged.size();
-    finalBatch.columns.resize(numCols);
-    for (size_t c = 0; c < numCols; ++c) finalBatch.columns[c].type = merged[0].values[c].type;
-    for (size_t c = 0; c < numCols; ++c) {
-        finalBatch.columns[c].data.reserve(merged.size());
-        for (size_t r = 0; r < merged.size(); ++r) finalBatch.columns[c].data.push_back(merged[r].values[c]);
+void TopNOperator::compact() {
+    std::vector<MixBatch> single;
+    single.push_back(std::move(kept));
+    std::vector<RowRef> refs = collectRowRefs(single);
+    sortRowRefs(single, orderBy, refs.begin(), refs.end());
+    size_t take = std::min(limit, refs.size());
+    kept = gatherRows(single, refs, take);
+    full = take == limit;
+}
+
+bool TopNOperator::canSkip(const ChunkStats &stats) const {
+    if (!full || !stats.valid || orderBy.empty()) return false;
+    const OrderByExpression &o = orderBy[0];
+    const ColumnData &col = kept.columns[o.columnIndex];
+    switch (col.type) {
+        case ValueType::INT64: {
+            int64_t threshold = col.intAt(limit - 1);
+            return o.ascending ? stats.intMin > threshold : stats.intMax < threshold;
+        }
+        case ValueType::VARCHAR: {
+            std::string threshold(col.stringAt(limit - 1).substr(0, STATS_PREFIX_LEN));
+            return o.ascending ? stats.strMin > threshold : stats.strMax < threshold;
+        }
+        case ValueType::BOOL:
+            return false;
     }
-    return finalBatch;
+    return false;
+}
+
+MixBatch TopNOperator::finish() {
+    if (kept.num_rows > 0) compact();
+    return std::move(kept);
 }
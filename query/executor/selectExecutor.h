@@ -2,15 +2,46 @@
 #pragma once
 
 #include "../../types.h"
+#include "hashAggregate.h"
 
 SELECT_TABLE_ERROR executeSelectBatch(const SelectQuery &query, const Batch &batch, std::vector<MixBatch> &outBatches);
 
 SELECT_TABLE_ERROR transformBatch(const SelectQuery &query, const Batch &batch, MixBatch &outBatch);
 
+// Evaluates WHERE, group keys and aggregate arguments of one batch and folds them into the aggregator.
+SELECT_TABLE_ERROR aggregateBatch(const SelectQuery &query, const AggregatePlan &plan, const Batch &batch, HashAggregator &aggregator);
+
+// Turns the final group states into a MixBatch laid out like transformBatch output.
+MixBatch aggregateResult(const SelectQuery &query, const AggregatePlan &plan, const MixBatch &states, size_t baseCols);
+
 SELECT_TABLE_ERROR orderAndLimitResult(std::vector<MixBatch> &batches, const std::vector<OrderByExpression> &orderBy, const std::optional<size_t> &limit);
 
 SELECT_TABLE_ERROR validateOrderByAndLimit(const std::vector<MixBatch> &batches, const std::vector<OrderByExpression> &orderBy, const std::optional<size_t> &limit);
 
 std::string spillBatchesToRun(const std::vector<MixBatch> &batches, const std::vector<OrderByExpression> &orderBy);
 
-MixBatch mergeRunFiles(const std::vector<std::string> &runFiles, const std::vector<OrderByExpression> &orderBy, const std::optional<size_t> &limit);
\ No newline at end of file
+MixBatch mergeRunFiles(const std::vector<std::string> &runFiles, const std::vector<OrderByExpression> &orderBy, const std::optional<size_t> &limit);
+
+// Bounded ORDER BY ... LIMIT n operator. Keeps the best n rows seen so far plus
+// a buffer of candidates; once n rows are known, rows that cannot beat the
+// current n-th row are dropped without being copied.
+class TopNOperator {
+public:
+    TopNOperator(const std::vector<OrderByExpression> &orderBy, size_t limit);
+
+    void consume(const MixBatch &batch);
+
+    // True when no row of a chunk with these stats on the first sort key can enter the result.
+    bool canSkip(const ChunkStats &stats) const;
+
+    MixBatch finish();
+
+private:
+    void compact();
+    int compareToThreshold(const MixBatch &batch, size_t row) const;
+
+    const std::vector<OrderByExpression> &orderBy;
+    size_t limit;
+    MixBatch kept;
+    bool full = false;
+};
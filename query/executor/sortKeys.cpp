@@ -0,0 +1,195 @@
+#include "sortKeys.h"
+#include "loserTree.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// Sorted item: the first 8 bytes of the normalized key as a big-endian integer
+// and the position of the row in the input slice.
+struct SortEntry {
+    uint64_t prefix;
+    uint32_t index;
+};
+
+int compareCells(const ColumnData &a, size_t ra, const ColumnData &b, size_t rb) {
+    switch (a.type) {
+        case ValueType::INT64: {
+            int64_t x = a.intAt(ra), y = b.intAt(rb);
+            return (x < y) ? -1 : (x > y ? 1 : 0);
+        }
+        case ValueType::VARCHAR:
+            return a.stringAt(ra).compare(b.stringAt(rb));
+        case ValueType::BOOL: {
+            bool x = a.boolAt(ra), y = b.boolAt(rb);
+            return (x == y) ? 0 : (x ? 1 : -1);
+        }
+    }
+    return 0;
+}
+
+// INT64: sign bit flipped, big-endian. VARCHAR: bytes with 0x00 escaped as
+// 0x00 0xFF, terminated by 0x00 0x00. BOOL: one byte. DESC inverts every byte.
+static void appendNormalizedKey(std::vector<uint8_t> &out, const ColumnData &col, size_t row, bool ascending) {
+    size_t start = out.size();
+    switch (col.type) {
+        case ValueType::INT64: {
+            uint64_t v = static_cast<uint64_t>(col.intAt(row)) ^ (1ULL << 63);
+            for (int shift = 56; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(v >> shift));
+            break;
+        }
+        case ValueType::VARCHAR: {
+            for (char ch : col.stringAt(row)) {
+                out.push_back(static_cast<uint8_t>(ch));
+                if (ch == '\0') out.push_back(0xFF);
+            }
+            out.push_back(0);
+            out.push_back(0);
+            break;
+        }
+        case ValueType::BOOL:
+            out.push_back(col.boolAt(row) ? 1 : 0);
+            break;
+    }
+    if (!ascending) {
+        for (size_t i = start; i < out.size(); ++i) out[i] = ~out[i];
+    }
+}
+
+static uint64_t loadPrefix(const uint8_t *p, size_t len) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; ++i) v = (v << 8) | (i < len ? p[i] : 0);
+    return v;
+}
+
+static size_t sortThreadCount(size_t rows) {
+    size_t hw = std::max<unsigned>(1, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(hw, rows / PARALLEL_SORT_MIN_ROWS));
+}
+
+// Stable LSD radix sort on the 8-byte prefix; byte positions on which all
+// keys agree are skipped.
+static void radixSort(std::vector<SortEntry> &entries) {
+    std::vector<SortEntry> tmp(entries.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {0};
+        for (const auto &e : entries) counts[(e.prefix >> shift) & 0xFF]++;
+        if (counts[(entries[0].prefix >> shift) & 0xFF] == entries.size()) continue;
+        size_t pos = 0;
+        for (size_t &c : counts) {
+            size_t n = c;
+            c = pos;
+            pos += n;
+        }
+        for (const auto &e : entries) tmp[counts[(e.prefix >> shift) & 0xFF]++] = e;
+        entries.swap(tmp);
+    }
+}
+
+// Sorts equal slices on separate threads, then splits the merge into key ranges
+// bounded by splitters sampled from the sorted slices and merges the ranges in parallel.
+template<typename Less>
+static void parallelSort(std::vector<SortEntry> &items, Less less, size_t threads) {
+    size_t n = items.size();
+    std::vector<size_t> bounds(threads + 1);
+    for (size_t t = 0; t <= threads; ++t) bounds[t] = n * t / threads;
+    {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] { std::sort(items.begin() + bounds[t], items.begin() + bounds[t + 1], less); });
+        }
+        for (auto &w : workers) w.join();
+    }
+
+    const size_t oversample = 16;
+    std::vector<SortEntry> samples;
+    for (size_t t = 0; t < threads; ++t) {
+        size_t len = bounds[t + 1] - bounds[t];
+        for (size_t i = 1; i <= oversample; ++i) samples.push_back(items[bounds[t] + len * i / (oversample + 1)]);
+    }
+    std::sort(samples.begin(), samples.end(), less);
+    std::vector<SortEntry> splitters;
+    for (size_t t = 1; t < threads; ++t) splitters.push_back(samples[samples.size() * t / threads]);
+
+    // cut[p][t]: where part p starts inside slice t
+    std::vector<std::vector<size_t>> cut(threads + 1, std::vector<size_t>(threads));
+    for (size_t t = 0; t < threads; ++t) {
+        cut[0][t] = bounds[t];
+        cut[threads][t] = bounds[t + 1];
+        for (size_t p = 1; p < threads; ++p) {
+            cut[p][t] = std::lower_bound(items.begin() + bounds[t], items.begin() + bounds[t + 1], splitters[p - 1], less) - items.begin();
+        }
+    }
+
+    std::vector<SortEntry> merged(n);
+    std::vector<size_t> outStart(threads + 1, 0);
+    for (size_t p = 0; p < threads; ++p) {
+        size_t len = 0;
+        for (size_t t = 0; t < threads; ++t) len += cut[p + 1][t] - cut[p][t];
+        outStart[p + 1] = outStart[p] + len;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t p = 0; p < threads; ++p) {
+        workers.emplace_back([&, p] {
+            std::vector<size_t> pos(cut[p]);
+            auto headLess = [&](size_t a, size_t b) { return less(items[pos[a]], items[pos[b]]); };
+            auto exhausted = [&](size_t a) { return pos[a] >= cut[p + 1][a]; };
+            LoserTree<decltype(headLess), decltype(exhausted)> tree(threads, headLess, exhausted);
+            size_t out = outStart[p];
+            while (!tree.empty()) {
+                size_t src = tree.top();
+                merged[out++] = items[pos[src]];
+                pos[src]++;
+                tree.replay();
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+    items.swap(merged);
+}
+
+void sortRowRefs(const std::vector<MixBatch> &batches, const std::vector<OrderByExpression> &orderBy,
+                 std::vector<RowRef>::iterator begin, std::vector<RowRef>::iterator end, bool parallel) {
+    if (orderBy.empty()) return;
+    size_t n = static_cast<size_t>(end - begin);
+    if (n < 2) return;
+
+    std::vector<uint8_t> keys;
+    std::vector<uint64_t> offsets(n + 1, 0);
+    std::vector<SortEntry> entries(n);
+    size_t maxLen = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const RowRef &ref = *(begin + i);
+        for (const auto &o : orderBy) appendNormalizedKey(keys, batches[ref.batch].columns[o.columnIndex], ref.row, o.ascending);
+        offsets[i + 1] = keys.size();
+        maxLen = std::max<size_t>(maxLen, offsets[i + 1] - offsets[i]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        entries[i] = SortEntry{loadPrefix(keys.data() + offsets[i], offsets[i + 1] - offsets[i]), static_cast<uint32_t>(i)};
+    }
+
+    if (maxLen <= 8) {
+        radixSort(entries);
+    } else {
+        auto less = [&](const SortEntry &a, const SortEntry &b) {
+            if (a.prefix != b.prefix) return a.prefix < b.prefix;
+            size_t la = offsets[a.index + 1] - offsets[a.index];
+            size_t lb = offsets[b.index + 1] - offsets[b.index];
+            if (la > 8 || lb > 8) {
+                size_t ta = la > 8 ? la - 8 : 0;
+                size_t tb = lb > 8 ? lb - 8 : 0;
+                int cmp = std::memcmp(keys.data() + offsets[a.index] + 8, keys.data() + offsets[b.index] + 8, std::min(ta, tb));
+                if (cmp != 0) return cmp < 0;
+                if (ta != tb) return ta < tb;
+            }
+            return a.index < b.index;
+        };
+        size_t threads = parallel ? sortThreadCount(n) : 1;
+        if (threads == 1) std::sort(entries.begin(), entries.end(), less);
+        else parallelSort(entries, less, threads);
+    }
+
+    std::vector<RowRef> sorted(n);
+    for (size_t i = 0; i < n; ++i) sorted[i] = *(begin + entries[i].index);
+    std::copy(sorted.begin(), sorted.end(), begin);
+}
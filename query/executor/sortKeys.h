@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../../types.h"
+
+struct RowRef {
+    uint32_t batch;
+    uint32_t row;
+};
+
+int compareCells(const ColumnData &a, size_t ra, const ColumnData &b, size_t rb);
+
+// Sorts row references by the ORDER BY keys. Every key is first encoded into a
+// memcmp-comparable byte string; rows equal on all keys keep their input order.
+void sortRowRefs(const std::vector<MixBatch> &batches, const std::vector<OrderByExpression> &orderBy,
+                 std::vector<RowRef>::iterator begin, std::vector<RowRef>::iterator end, bool parallel = true);
@@ -36,6 +36,18 @@ FunctionName parseFunction(const json& j) {
     throw std::runtime_error("Unknown function: " + fn);
 }
 
+AggregateFunction parseAggregate(const json& j) {
+    std::string fn = j.get<std::string>();
+
+    if (fn == "COUNT") return AggregateFunction::COUNT;
+    if (fn == "SUM") return AggregateFunction::SUM;
+    if (fn == "MIN") return AggregateFunction::MIN;
+    if (fn == "MAX") return AggregateFunction::MAX;
+    if (fn == "AVG") return AggregateFunction::AVG;
+
+    throw std::runtime_error("Unknown aggregate function: " + fn);
+}
+
 Value parseValue(const json& j) {
     Value v;
 
@@ -98,6 +110,15 @@ std::unique_ptr<ColumnExpression> parseColumnExpression(const json& j) {
         return expr;
     }
 
+    if (j.contains("aggregateFunction")) {
+        expr->type = ExprType::AGGREGATE;
+        expr->aggregate.function = parseAggregate(j["aggregateFunction"]);
+        if (j.contains("argument") && !j["argument"].is_null()) {
+            expr->aggregate.argument = parseColumnExpression(j["argument"]);
+        }
+        return expr;
+    }
+
     if (j.contains("leftOperand")) {
         expr->type = ExprType::BINARY_OP;
         expr->binary.op = parseOperator(j["operator"]);
@@ -146,6 +167,9 @@ SelectQuery parseSelect(const json& def) {
             case ExprType::UNARY_OP:
                 if (expr->unary.operand) return self(expr->unary.operand.get(), self);
                 return std::string();
+            case ExprType::AGGREGATE:
+                if (expr->aggregate.argument) return self(expr->aggregate.argument.get(), self);
+                return std::string();
             default:
                 return std::string();
         }
@@ -166,10 +190,26 @@ SelectQuery parseSelect(const json& def) {
         if (!t.empty()) sq.tableName = t;
     }
 
+    if (def.contains("groupByClauses")) {
+        for (const auto &g : def.at("groupByClauses")) {
+            sq.groupByClauses.push_back(parseColumnExpression(g));
+        }
+    }
+
+    for (const auto &g : sq.groupByClauses) {
+        if (!sq.tableName.empty()) break;
+        auto t = findTableInExpr(g.get(), findTableInExpr);
+        if (!t.empty()) sq.tableName = t;
+    }
+
     if (def.contains("limitClause")) {
         sq.limit = def.at("limitClause").at("limit").get<size_t>();
     }
 
+    if (def.contains("parallelism") && def["parallelism"].is_number_unsigned()) {
+        sq.parallelism = def["parallelism"].get<size_t>();
+    }
+
     if (def.contains("orderByClause") || def.contains("orderByClauses")) {
         const json &olist = def.contains("orderByClause") ? def.at("orderByClause") : def.at("orderByClauses");
         for (const auto &o : olist) {
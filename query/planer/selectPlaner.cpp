@@ -1,4 +1,6 @@
 #include "selectPlaner.h"
+#include "../evaluation/expression_hasher.h"
+#include <set>
 
 
 void planExpression(ColumnExpression &expr, const Schema &schema) {
@@ -114,6 +116,81 @@ void planExpression(ColumnExpression &expr, const Schema &schema) {
             return;
         }
     }
+
+    case ExprType::AGGREGATE: {
+        if (!expr.aggregate.argument) {
+            if (expr.aggregate.function != AggregateFunction::COUNT)
+                throw std::runtime_error("Only COUNT may omit its argument");
+            expr.resultType = ValueType::INT64;
+            return;
+        }
+        planExpression(*expr.aggregate.argument, schema);
+        auto argType = expr.aggregate.argument->resultType;
+
+        switch (expr.aggregate.function) {
+        case AggregateFunction::COUNT:
+            expr.resultType = ValueType::INT64;
+            return;
+        case AggregateFunction::SUM:
+        case AggregateFunction::AVG:
+            if (argType != ValueType::INT64)
+                throw std::runtime_error("SUM/AVG expects INT64");
+            expr.resultType = ValueType::INT64;
+            return;
+        case AggregateFunction::MIN:
+        case AggregateFunction::MAX:
+            expr.resultType = argType;
+            return;
+        }
+    }
+    }
+}
+
+
+bool containsAggregate(const ColumnExpression &expr) {
+    switch (expr.type) {
+    case ExprType::AGGREGATE:
+        return true;
+    case ExprType::COLUMN_REF:
+    case ExprType::LITERAL:
+        return false;
+    case ExprType::UNARY_OP:
+        return expr.unary.operand && containsAggregate(*expr.unary.operand);
+    case ExprType::BINARY_OP:
+        return (expr.binary.left && containsAggregate(*expr.binary.left)) ||
+               (expr.binary.right && containsAggregate(*expr.binary.right));
+    case ExprType::FUNCTION:
+        for (const auto &arg : expr.function.args) {
+            if (arg && containsAggregate(*arg)) return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+
+void collectReferencedColumns(const ColumnExpression &expr, std::set<size_t> &out) {
+    switch (expr.type) {
+    case ExprType::COLUMN_REF:
+        out.insert(expr.columnRef.index);
+        return;
+    case ExprType::LITERAL:
+        return;
+    case ExprType::UNARY_OP:
+        if (expr.unary.operand) collectReferencedColumns(*expr.unary.operand, out);
+        return;
+    case ExprType::BINARY_OP:
+        if (expr.binary.left) collectReferencedColumns(*expr.binary.left, out);
+        if (expr.binary.right) collectReferencedColumns(*expr.binary.right, out);
+        return;
+    case ExprType::FUNCTION:
+        for (const auto &arg : expr.function.args) {
+            if (arg) collectReferencedColumns(*arg, out);
+        }
+        return;
+    case ExprType::AGGREGATE:
+        if (expr.aggregate.argument) collectReferencedColumns(*expr.aggregate.argument, out);
+        return;
     }
 }
 
@@ -146,9 +223,26 @@ Schema buildSchema(const TableInfo &table) {
 
 SELECT_TABLE_ERROR planSelectQuery(
     SelectQuery &query,
-    const TableInfo &info
+    const TableDescriptor &table
 ) {
-    auto schema = buildSchema(info);
+    auto schema = buildSchema(*table);
+    query.table = table;
+
+    query.aggregate = !query.groupByClauses.empty();
+    for (const auto &expr : query.columnClauses) {
+        if (!expr) continue;
+        if (expr->type == ExprType::AGGREGATE) {
+            query.aggregate = true;
+            if (expr->aggregate.argument && containsAggregate(*expr->aggregate.argument))
+                return SELECT_TABLE_ERROR::INVALID_GROUP_BY;
+        } else if (containsAggregate(*expr)) {
+            return SELECT_TABLE_ERROR::INVALID_GROUP_BY;
+        }
+    }
+    for (const auto &expr : query.groupByClauses) {
+        if (containsAggregate(*expr)) return SELECT_TABLE_ERROR::INVALID_GROUP_BY;
+    }
+    if (query.whereClause && containsAggregate(*query.whereClause)) return SELECT_TABLE_ERROR::INVALID_WHERE;
 
     try {
         for (auto &expr : query.columnClauses) {
@@ -180,11 +274,32 @@ SELECT_TABLE_ERROR planSelectQuery(
             obe.columnIndex = baseCols + obe.columnIndex;
         }
 
+        // Every non-aggregate output column must be one of the group keys.
+        if (query.aggregate) {
+            std::set<size_t> keyHashes;
+            for (auto &expr : query.groupByClauses) {
+                planExpression(*expr, schema);
+                keyHashes.insert(hashExpression(*expr));
+            }
+            for (const auto &expr : query.columnClauses) {
+                if (expr->type != ExprType::AGGREGATE && !keyHashes.count(hashExpression(*expr)))
+                    return SELECT_TABLE_ERROR::INVALID_GROUP_BY;
+            }
+        }
+
         if (query.whereClause) {
             planExpression(*query.whereClause, schema);
             if (query.whereClause->resultType != ValueType::BOOL)
                 return SELECT_TABLE_ERROR::INVALID_WHERE;
         }
+
+        std::set<size_t> referenced;
+        for (const auto &expr : query.columnClauses) {
+            if (expr) collectReferencedColumns(*expr, referenced);
+        }
+        for (const auto &expr : query.groupByClauses) collectReferencedColumns(*expr, referenced);
+        if (query.whereClause) collectReferencedColumns(*query.whereClause, referenced);
+        query.referencedColumns.assign(referenced.begin(), referenced.end());
     } catch (const std::exception &e) {
         return SELECT_TABLE_ERROR::INVALID_WHERE;
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <unordered_map>
+#include <set>
 #include <string>
 #include <cstddef>
 #include "../selectQuery.h"
@@ -25,4 +26,10 @@ struct Schema {
 
 void planExpression(ColumnExpression &expr, const Schema &schema);
 
-SELECT_TABLE_ERROR planSelectQuery(SelectQuery &query, const TableInfo &info);
+bool containsAggregate(const ColumnExpression &expr);
+
+void collectReferencedColumns(const ColumnExpression &expr, std::set<size_t> &out);
+
+// Binds the query to the table snapshot it is planned against; the executor
+// reads the schema and part files only from query.table.
+SELECT_TABLE_ERROR planSelectQuery(SelectQuery &query, const TableDescriptor &table);
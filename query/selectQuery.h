@@ -7,6 +7,7 @@
 
 
 struct ColumnExpression;
+struct TableInfo;
 
 using ColumnExprPtr = std::unique_ptr<ColumnExpression>;
 
@@ -29,7 +30,16 @@ enum class ExprType {
     LITERAL,
     FUNCTION,
     BINARY_OP,
-    UNARY_OP
+    UNARY_OP,
+    AGGREGATE
+};
+
+enum class AggregateFunction {
+    COUNT,
+    SUM,
+    MIN,
+    MAX,
+    AVG
 };
 
 enum class Operator {
@@ -88,6 +98,12 @@ struct UnaryExpr {
     ColumnExprPtr operand;
 };
 
+// COUNT without an argument counts rows.
+struct AggregateExpr {
+    AggregateFunction function;
+    ColumnExprPtr argument;
+};
+
 struct ColumnExpression {
     ExprType type;
     ValueType resultType; 
@@ -96,6 +112,7 @@ struct ColumnExpression {
     FunctionExpr function;
     BinaryExpr binary;
     UnaryExpr unary;
+    AggregateExpr aggregate;
 };
 
 struct OrderByExpression {
@@ -113,6 +130,13 @@ struct SelectQuery {
     std::string tableName;
     std::vector<std::unique_ptr<ColumnExpression>> columnClauses;
     std::unique_ptr<ColumnExpression> whereClause;
+    std::vector<std::unique_ptr<ColumnExpression>> groupByClauses;
     std::vector<OrderByExpression> orderByClauses;
     std::optional<size_t> limit;
+    // Scan workers requested for this query; 0 uses one per hardware thread.
+    size_t parallelism = 0;
+    std::vector<size_t> referencedColumns;
+    bool aggregate = false;
+    // Catalog snapshot the query was planned against.
+    std::shared_ptr<const TableInfo> table;
 };
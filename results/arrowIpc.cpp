@@ -0,0 +1,244 @@
+#include "arrowIpc.h"
+#include <cstring>
+
+// FlatBuffers are built back to front like the reference builder does: every
+// object is written before the objects referring to it and is identified by
+// its distance from the end of the buffer.
+class FlatBuilder {
+public:
+    uint32_t size() const { return static_cast<uint32_t>(buf.size() - head); }
+
+    template<typename T>
+    void push(T value) {
+        reserve(sizeof(T));
+        head -= sizeof(T);
+        std::memcpy(buf.data() + head, &value, sizeof(T));
+    }
+
+    // Pads so that the size is a multiple of `alignment` once `len` more bytes are written.
+    void preAlign(size_t len, size_t alignment) {
+        minAlign = std::max(minAlign, alignment);
+        size_t pad = (~(size() + len) + 1) & (alignment - 1);
+        reserve(pad);
+        head -= pad;
+        std::memset(buf.data() + head, 0, pad);
+    }
+
+    template<typename T>
+    uint32_t scalar(T value) {
+        preAlign(sizeof(T), sizeof(T));
+        push(value);
+        return size();
+    }
+
+    void offset(uint32_t ref) {
+        preAlign(sizeof(uint32_t), sizeof(uint32_t));
+        push<uint32_t>(size() - ref + sizeof(uint32_t));
+    }
+
+    uint32_t string(std::string_view s) {
+        preAlign(s.size() + 1, sizeof(uint32_t));
+        push<uint8_t>(0);
+        reserve(s.size());
+        head -= s.size();
+        std::memcpy(buf.data() + head, s.data(), s.size());
+        push<uint32_t>(static_cast<uint32_t>(s.size()));
+        return size();
+    }
+
+    uint32_t offsetVector(const std::vector<uint32_t> &refs) {
+        preAlign(refs.size() * sizeof(uint32_t), sizeof(uint32_t));
+        for (size_t i = refs.size(); i-- > 0;) offset(refs[i]);
+        push<uint32_t>(static_cast<uint32_t>(refs.size()));
+        return size();
+    }
+
+    // Vector of structs made of two int64 fields (FieldNode and Buffer).
+    uint32_t pairVector(const std::vector<std::pair<int64_t, int64_t>> &items) {
+        preAlign(items.size() * 16, sizeof(uint32_t));
+        preAlign(items.size() * 16, 8);
+        for (size_t i = items.size(); i-- > 0;) {
+            push(items[i].second);
+            push(items[i].first);
+        }
+        push<uint32_t>(static_cast<uint32_t>(items.size()));
+        return size();
+    }
+
+    void startTable() {
+        fields.clear();
+        tableStart = size();
+    }
+
+    template<typename T>
+    void addScalar(uint16_t id, T value) { fields.emplace_back(id, scalar(value)); }
+
+    void addOffset(uint16_t id, uint32_t ref) {
+        offset(ref);
+        fields.emplace_back(id, size());
+    }
+
+    uint32_t endTable() {
+        preAlign(sizeof(int32_t), sizeof(int32_t));
+        push<int32_t>(0);
+        uint32_t table = size();
+        uint16_t count = 0;
+        for (const auto &f : fields) count = std::max<uint16_t>(count, f.first + 1);
+        std::vector<uint16_t> slots(count, 0);
+        for (const auto &f : fields) slots[f.first] = static_cast<uint16_t>(table - f.second);
+        for (size_t i = count; i-- > 0;) push(slots[i]);
+        push<uint16_t>(static_cast<uint16_t>(table - tableStart));
+        push<uint16_t>(static_cast<uint16_t>((count + 2) * sizeof(uint16_t)));
+        int32_t vtable = static_cast<int32_t>(size() - table);
+        std::memcpy(buf.data() + buf.size() - table, &vtable, sizeof(vtable));
+        return table;
+    }
+
+    std::string finish(uint32_t root) {
+        preAlign(sizeof(uint32_t), minAlign);
+        offset(root);
+        return std::string(reinterpret_cast<const char *>(buf.data() + head), size());
+    }
+
+private:
+    void reserve(size_t n) {
+        if (head >= n) return;
+        size_t used = size();
+        size_t capacity = std::max(buf.size() * 2, used + n + 256);
+        std::vector<uint8_t> bigger(capacity);
+        std::memcpy(bigger.data() + capacity - used, buf.data() + head, used);
+        buf.swap(bigger);
+        head = capacity - used;
+    }
+
+    std::vector<uint8_t> buf;
+    size_t head = 0;
+    size_t minAlign = 1;
+    uint32_t tableStart = 0;
+    std::vector<std::pair<uint16_t, uint32_t>> fields;
+};
+
+static constexpr int16_t METADATA_V5 = 4;
+static constexpr uint8_t HEADER_SCHEMA = 1;
+static constexpr uint8_t HEADER_RECORD_BATCH = 3;
+static constexpr uint8_t TYPE_INT = 2;
+static constexpr uint8_t TYPE_BOOL = 6;
+static constexpr uint8_t TYPE_LARGE_UTF8 = 20;
+
+static void padTo8(std::string &out) {
+    out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+static void appendMessage(std::string &out, FlatBuilder &fb, uint8_t headerType, uint32_t header, const std::string &body) {
+    fb.startTable();
+    fb.addScalar<int64_t>(3, static_cast<int64_t>(body.size()));
+    fb.addOffset(2, header);
+    fb.addScalar<int16_t>(0, METADATA_V5);
+    fb.addScalar<uint8_t>(1, headerType);
+    std::string metadata = fb.finish(fb.endTable());
+    padTo8(metadata);
+
+    uint32_t continuation = 0xFFFFFFFF;
+    int32_t length = static_cast<int32_t>(metadata.size());
+    out.append(reinterpret_cast<const char *>(&continuation), sizeof(continuation));
+    out.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    out += metadata;
+    out += body;
+}
+
+void appendArrowSchema(std::string &out, const std::vector<ValueType> &types) {
+    FlatBuilder fb;
+    std::vector<uint32_t> fields;
+    for (size_t c = 0; c < types.size(); ++c) {
+        uint32_t type;
+        uint8_t typeId;
+        fb.startTable();
+        if (types[c] == ValueType::INT64) {
+            fb.addScalar<int32_t>(0, 64);
+            fb.addScalar<uint8_t>(1, 1);
+            typeId = TYPE_INT;
+        } else {
+            typeId = types[c] == ValueType::BOOL ? TYPE_BOOL : TYPE_LARGE_UTF8;
+        }
+        type = fb.endTable();
+        uint32_t name = fb.string("col" + std::to_string(c));
+        uint32_t children = fb.offsetVector({});
+
+        fb.startTable();
+        fb.addOffset(0, name);
+        fb.addOffset(3, type);
+        fb.addOffset(5, children);
+        fb.addScalar<uint8_t>(1, 1);
+        fb.addScalar<uint8_t>(2, typeId);
+        fields.push_back(fb.endTable());
+    }
+    uint32_t fieldVector = fb.offsetVector(fields);
+    fb.startTable();
+    fb.addOffset(1, fieldVector);
+    uint32_t schema = fb.endTable();
+    appendMessage(out, fb, HEADER_SCHEMA, schema, std::string());
+}
+
+void appendArrowRecordBatch(std::string &out, const MixBatch &block, size_t from, size_t to) {
+    size_t rows = to - from;
+    std::string body;
+    std::vector<std::pair<int64_t, int64_t>> nodes;
+    std::vector<std::pair<int64_t, int64_t>> buffers;
+    auto addBuffer = [&](const char *data, size_t len) {
+        buffers.emplace_back(static_cast<int64_t>(body.size()), static_cast<int64_t>(len));
+        if (data) body.append(data, len);
+        else body.append(len, '\0');
+        padTo8(body);
+    };
+
+    for (const ColumnData &col : block.columns) {
+        if (col.size() < to) {
+            nodes.emplace_back(rows, rows);
+            addBuffer(nullptr, (rows + 7) / 8);
+            switch (col.type) {
+                case ValueType::INT64: addBuffer(nullptr, rows * sizeof(int64_t)); break;
+                case ValueType::VARCHAR: addBuffer(nullptr, (rows + 1) * sizeof(int64_t)); addBuffer(nullptr, 0); break;
+                case ValueType::BOOL: addBuffer(nullptr, (rows + 7) / 8); break;
+            }
+            continue;
+        }
+        nodes.emplace_back(rows, 0);
+        addBuffer(nullptr, 0);
+        switch (col.type) {
+            case ValueType::INT64:
+                addBuffer(reinterpret_cast<const char *>(col.ints.data() + from), rows * sizeof(int64_t));
+                break;
+            case ValueType::VARCHAR: {
+                uint64_t base = from == 0 ? 0 : col.offsets[from - 1];
+                std::vector<int64_t> offsets(rows + 1, 0);
+                for (size_t r = 0; r < rows; ++r) offsets[r + 1] = static_cast<int64_t>(col.offsets[from + r] - base);
+                addBuffer(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(int64_t));
+                addBuffer(col.bytes.data() + base, offsets[rows]);
+                break;
+            }
+            case ValueType::BOOL: {
+                std::string bits((rows + 7) / 8, '\0');
+                for (size_t r = 0; r < rows; ++r) {
+                    if (col.boolAt(from + r)) bits[r / 8] |= static_cast<char>(1 << (r % 8));
+                }
+                addBuffer(bits.data(), bits.size());
+                break;
+            }
+        }
+    }
+
+    FlatBuilder fb;
+    uint32_t bufferVector = fb.pairVector(buffers);
+    uint32_t nodeVector = fb.pairVector(nodes);
+    fb.startTable();
+    fb.addScalar<int64_t>(0, static_cast<int64_t>(rows));
+    fb.addOffset(1, nodeVector);
+    fb.addOffset(2, bufferVector);
+    uint32_t batch = fb.endTable();
+    appendMessage(out, fb, HEADER_RECORD_BATCH, batch, body);
+}
+
+void appendArrowEndOfStream(std::string &out) {
+    uint32_t marker[2] = {0xFFFFFFFF, 0};
+    out.append(reinterpret_cast<const char *>(marker), sizeof(marker));
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../types.h"
+#include <string>
+
+// Minimal writer of the Arrow IPC streaming format (metadata version V5), so
+// results can be loaded by pyarrow/pandas without parsing JSON. Columns map to
+// Int64, LargeUtf8 and Bool; fields are named col0, col1, ... because results
+// do not keep column names. Every message is appended to `out` already
+// encapsulated (continuation marker, metadata length, metadata, body).
+
+void appendArrowSchema(std::string &out, const std::vector<ValueType> &types);
+
+// Writes rows [from, to) of `block` as one record batch. Columns with fewer
+// values than the block (not produced for these rows) are written as nulls.
+void appendArrowRecordBatch(std::string &out, const MixBatch &block, size_t from, size_t to);
+
+void appendArrowEndOfStream(std::string &out);
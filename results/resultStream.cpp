@@ -0,0 +1,203 @@
+#include "resultStream.h"
+#include "results.h"
+#include "arrowIpc.h"
+#include "../utils/utils.h"
+#include <filesystem>
+
+static constexpr size_t STREAM_PIECE_BYTES = 64 * 1024;
+
+void appendJsonString(std::string &out, std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char ch : value) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out.push_back(hex[c >> 4]);
+                    out.push_back(hex[c & 0xf]);
+                } else {
+                    out.push_back(ch);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+bool ResultStream::open(const std::string &id, int rowLimit, size_t from, bool finished, ResultFormat resultFormat) {
+    format = resultFormat;
+    path = resultPath(id).string();
+    std::error_code ec;
+    bool exists = std::filesystem::exists(path, ec);
+    if (!exists && finished) return false;
+    offset = from;
+    // A running query creates its result file with the first batch.
+    if (!exists || std::filesystem::file_size(path, ec) == 0 || ec) {
+        hasNext = !finished;
+        return true;
+    }
+
+    RunReader counter;
+    if (!counter.open(path)) {
+        log_error(std::string("ResultStream: cannot read result file ") + path);
+        return false;
+    }
+    types = counter.columnTypes();
+    size_t total = counter.skipRows(SIZE_MAX);
+    size_t available = total > offset ? total - offset : 0;
+    rows = rowLimit > 0 ? std::min(available, static_cast<size_t>(rowLimit)) : available;
+    hasNext = !finished || offset + rows < total;
+    return true;
+}
+
+bool ResultStream::openReader() {
+    reader = std::make_unique<RunReader>();
+    if (!reader->open(path)) return false;
+    skip = offset - reader->skipRows(offset);
+    emitted = 0;
+    block = MixBatch();
+    blockRow = 0;
+    return true;
+}
+
+// Writes the values of the current column for rows still to be emitted,
+// stopping once out reaches limit.
+bool ResultStream::emitColumn(std::string &out, size_t limit) {
+    while (emitted < rows && out.size() < limit) {
+        if (blockRow >= block.num_rows) {
+            if (!reader->nextBlockColumn(block, column)) return false;
+            blockRow = std::min(skip, block.num_rows);
+            skip -= blockRow;
+            continue;
+        }
+        const ColumnData &col = block.columns[column];
+        size_t to = std::min(block.num_rows, blockRow + (rows - emitted));
+        for (size_t r = blockRow; r < to; ++r) {
+            if (emitted + (r - blockRow) > 0) out.push_back(',');
+            if (r >= col.size()) {
+                out += "null";
+                continue;
+            }
+            switch (col.type) {
+                case ValueType::INT64: out += std::to_string(col.intAt(r)); break;
+                case ValueType::VARCHAR: appendJsonString(out, col.stringAt(r)); break;
+                case ValueType::BOOL: out += col.boolAt(r) ? "true" : "false"; break;
+            }
+        }
+        emitted += to - blockRow;
+        blockRow = to;
+    }
+    return true;
+}
+
+// Arrow record batches follow the blocks of the file, so unlike JSON all
+// columns come from a single pass.
+bool ResultStream::nextArrow(std::string &out) {
+    size_t limit = out.size() + STREAM_PIECE_BYTES;
+    while (out.size() < limit) {
+        switch (phase) {
+            case Phase::BEGIN:
+                appendArrowSchema(out, types);
+                if (rows > 0 && !openReader()) {
+                    log_error(std::string("ResultStream: cannot read result file ") + path);
+                    error = true;
+                    return false;
+                }
+                phase = rows > 0 ? Phase::COLUMNS : Phase::END;
+                break;
+            case Phase::COLUMNS: {
+                if (!reader->nextBlock(block)) {
+                    log_error(std::string("ResultStream: result file ended early ") + path);
+                    error = true;
+                    return false;
+                }
+                size_t from = std::min(skip, block.num_rows);
+                size_t to = std::min(block.num_rows, from + (rows - emitted));
+                skip -= from;
+                if (to > from) appendArrowRecordBatch(out, block, from, to);
+                emitted += to - from;
+                if (emitted == rows) {
+                    reader.reset();
+                    phase = Phase::END;
+                }
+                break;
+            }
+            case Phase::END:
+                appendArrowEndOfStream(out);
+                phase = Phase::DONE;
+                break;
+            case Phase::DONE:
+                return false;
+        }
+    }
+    return phase != Phase::DONE;
+}
+
+bool ResultStream::next(std::string &out) {
+    if (format == ResultFormat::ARROW) return nextArrow(out);
+    size_t limit = out.size() + STREAM_PIECE_BYTES;
+    while (out.size() < limit) {
+        switch (phase) {
+            case Phase::BEGIN:
+                if (rows == 0 && !hasNext) {
+                    out += "[]";
+                    phase = Phase::DONE;
+                    break;
+                }
+                out += "[{\"rowCount\":" + std::to_string(rows) + ",\"columns\":[";
+                column = 0;
+                phase = rows > 0 && !types.empty() ? Phase::COLUMNS : Phase::END;
+                if (phase == Phase::END) {
+                    // A running query without rows in range yet; the columns
+                    // are known once its first batch has been written.
+                    for (size_t c = 0; c < types.size(); ++c) out += c == 0 ? "[]" : ",[]";
+                    out.push_back(']');
+                    break;
+                }
+                if (!openReader()) {
+                    log_error(std::string("ResultStream: cannot read result file ") + path);
+                    error = true;
+                    return false;
+                }
+                out.push_back('[');
+                break;
+            case Phase::COLUMNS:
+                if (!emitColumn(out, limit)) {
+                    log_error(std::string("ResultStream: result file ended early ") + path);
+                    error = true;
+                    return false;
+                }
+                if (emitted < rows) break;
+                out.push_back(']');
+                if (++column == types.size()) {
+                    reader.reset();
+                    out.push_back(']');
+                    phase = Phase::END;
+                    break;
+                }
+                if (!openReader()) {
+                    log_error(std::string("ResultStream: cannot read result file ") + path);
+                    error = true;
+                    return false;
+                }
+                out += ",[";
+                break;
+            case Phase::END:
+                if (hasNext) out += ",\"nextOffset\":" + std::to_string(offset + rows);
+                out += "}]";
+                phase = Phase::DONE;
+                break;
+            case Phase::DONE:
+                return false;
+        }
+    }
+    return phase != Phase::DONE;
+}
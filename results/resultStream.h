@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../types.h"
+#include "../query/executor/runFile.h"
+#include <memory>
+#include <string>
+
+// Writes the GET /result body straight from the result file, one piece at a
+// time, without building a json document. The body has the same shape as
+// prepareQueryResultResponse() wrapped in an array:
+//   [{"rowCount":N,"columns":[[...],...],"nextOffset":M}]
+// Columns are emitted one after another, each from its own pass over the
+// file, and only that column is decoded from every block, so at most one
+// block is held at a time. The row range is fixed in open(), so rows appended
+// later by a running query are not mixed in.
+//
+// With ResultFormat::ARROW the body is an Arrow IPC stream instead: the schema,
+// one record batch per block of the result file and the end-of-stream marker.
+// The file is then read once.
+enum class ResultFormat {
+    JSON,
+    ARROW
+};
+
+class ResultStream {
+public:
+    // Returns false when the query has no result. When `finished` is false the
+    // query may still add rows, so nextOffset is always reported.
+    bool open(const std::string &id, int rowLimit, size_t offset, bool finished, ResultFormat format = ResultFormat::JSON);
+
+    size_t rowCount() const { return rows; }
+
+    std::optional<size_t> nextOffset() const {
+        if (!hasNext) return std::nullopt;
+        return offset + rows;
+    }
+
+    // Appends the next piece of the body to `out`; returns false once the body
+    // is complete (or reading failed, see failed()).
+    bool next(std::string &out);
+
+    bool failed() const { return error; }
+
+private:
+    bool openReader();
+    bool emitColumn(std::string &out, size_t limit);
+    bool nextArrow(std::string &out);
+
+    enum class Phase { BEGIN, COLUMNS, END, DONE };
+    Phase phase = Phase::BEGIN;
+
+    ResultFormat format = ResultFormat::JSON;
+    std::string path;
+    std::vector<ValueType> types;
+    size_t offset = 0;
+    size_t rows = 0;
+    bool hasNext = false;
+    bool error = false;
+
+    size_t column = 0;
+    size_t emitted = 0;
+    size_t skip = 0;
+    std::unique_ptr<RunReader> reader;
+    MixBatch block;
+    size_t blockRow = 0;
+};
+
+void appendJsonString(std::string &out, std::string_view value);
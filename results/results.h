@@ -1,12 +1,41 @@
+#pragma once
+
 #include "../types.h"
-#include <optional>
+#include "../query/executor/runFile.h"
+
+std::filesystem::path resultPath(const std::string &id);
+
+// Appends a query's result to its file batch by batch. Every append ends a
+// block and flushes it, so GET /result sees the rows while the query is still
+// running.
+class ResultWriter {
+public:
+    explicit ResultWriter(std::string id) : id(std::move(id)) {}
+    ~ResultWriter();
+
+    ResultWriter(const ResultWriter&) = delete;
+    ResultWriter &operator=(const ResultWriter&) = delete;
+
+    // Writes the first maxRows rows of batch.
+    void append(const MixBatch &batch, size_t maxRows = SIZE_MAX);
 
-std::optional<QueryResult> getQueryResult(const std::string &id, int rowLimit = 0);
+    // Writes the end marker; types are used when nothing was appended.
+    void close(const std::vector<ValueType> &types);
+
+    size_t rowCount() const { return rows; }
+
+private:
+    bool open(const std::vector<ValueType> &types);
+
+    std::string id;
+    RunWriter writer;
+    bool opened = false;
+    bool closed = false;
+    size_t rows = 0;
+};
 
 void modifyResult(std::string id, std::vector<MixBatch>& batches);
 
 void initResult(std::string id);
 
 void removeResult(const std::string &id);
-
-void finalizeResult(const std::string &id, const std::vector<OrderByExpression> &orderBy, const std::optional<size_t> &limit);
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "bufferPool.h"
+#include "../codec/fsst.h"
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+struct ChunkKey {
+    uint64_t file;
+    uint64_t offset;
+
+    bool operator==(const ChunkKey &other) const { return file == other.file && offset == other.offset; }
+};
+
+struct ChunkKeyHash {
+    size_t operator()(const ChunkKey &key) const {
+        return std::hash<uint64_t>()(key.file * 0x9E3779B97F4A7C15ULL ^ key.offset);
+    }
+};
+
+using KeyList = std::list<ChunkKey>;
+
+struct PoolEntry {
+    std::shared_ptr<const DecodedChunk> chunk;
+    size_t bytes;
+    bool hot;
+    KeyList::iterator position;
+};
+
+struct BufferPool {
+    std::mutex mutex;
+    size_t budget = DEFAULT_BUFFER_POOL_BYTES;
+    std::unordered_map<ChunkKey, PoolEntry, ChunkKeyHash> entries;
+    KeyList probation;
+    KeyList hot;
+    size_t probationBytes = 0;
+    size_t hotBytes = 0;
+    KeyList ghosts;
+    std::unordered_map<ChunkKey, KeyList::iterator, ChunkKeyHash> ghostIndex;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+BufferPool &pool() {
+    static BufferPool p;
+    return p;
+}
+
+size_t chunkBytes(const DecodedChunk &chunk) {
+    if (const IntColumn *col = std::get_if<IntColumn>(&chunk)) {
+        return sizeof(IntColumn) + col->column.capacity() * sizeof(int64_t);
+    }
+    const StringColumn &col = std::get<StringColumn>(chunk);
+    size_t bytes = sizeof(StringColumn) + col.column.capacity() * sizeof(std::string);
+    for (const auto &s : col.column) {
+        if (s.capacity() >= sizeof(std::string)) bytes += s.capacity() + 1;
+    }
+    bytes += (col.codes.capacity() + col.offsets.capacity()) * sizeof(uint32_t);
+    if (col.data) bytes += sizeof(std::string) + col.data->capacity();
+    if (col.symbols) bytes += sizeof(SymbolTable);
+    if (col.dictionary) {
+        bytes += col.dictionary->capacity() * sizeof(std::string);
+        for (const auto &s : *col.dictionary) bytes += s.capacity() + 1;
+    }
+    return bytes;
+}
+
+void forget(BufferPool &p, std::unordered_map<ChunkKey, PoolEntry, ChunkKeyHash>::iterator it) {
+    PoolEntry &entry = it->second;
+    if (entry.hot) {
+        p.hot.erase(entry.position);
+        p.hotBytes -= entry.bytes;
+    } else {
+        p.probation.erase(entry.position);
+        p.probationBytes -= entry.bytes;
+    }
+    p.entries.erase(it);
+}
+
+void remember(BufferPool &p, const ChunkKey &key) {
+    p.ghosts.push_front(key);
+    p.ghostIndex[key] = p.ghosts.begin();
+    size_t limit = std::max<size_t>(p.entries.size(), 64);
+    while (p.ghostIndex.size() > limit) {
+        p.ghostIndex.erase(p.ghosts.back());
+        p.ghosts.pop_back();
+    }
+}
+
+// Evicts the oldest unpinned chunk of the queue; false when all are pinned.
+bool evictFrom(BufferPool &p, KeyList &queue) {
+    for (auto pos = queue.rbegin(); pos != queue.rend(); ++pos) {
+        auto it = p.entries.find(*pos);
+        if (it->second.chunk.use_count() > 1) continue;
+        ChunkKey key = it->first;
+        bool wasHot = it->second.hot;
+        forget(p, it);
+        if (!wasHot) remember(p, key);
+        p.evictions++;
+        return true;
+    }
+    return false;
+}
+
+void shrink(BufferPool &p) {
+    while (p.probationBytes + p.hotBytes > p.budget) {
+        bool fromProbation = p.hot.empty() || p.probationBytes > p.budget / 4;
+        if (fromProbation ? evictFrom(p, p.probation) || evictFrom(p, p.hot)
+                          : evictFrom(p, p.hot) || evictFrom(p, p.probation)) continue;
+        break;
+    }
+}
+
+}
+
+std::shared_ptr<const DecodedChunk> cachedChunk(uint64_t file, uint64_t offset, const std::function<DecodedChunk()> &load) {
+    BufferPool &p = pool();
+    ChunkKey key{file, offset};
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        auto it = p.entries.find(key);
+        if (it != p.entries.end()) {
+            PoolEntry &entry = it->second;
+            if (entry.hot) {
+                p.hot.splice(p.hot.begin(), p.hot, entry.position);
+            } else {
+                p.probation.erase(entry.position);
+                p.probationBytes -= entry.bytes;
+                p.hot.push_front(key);
+                p.hotBytes += entry.bytes;
+                entry.position = p.hot.begin();
+                entry.hot = true;
+            }
+            p.hits++;
+            return entry.chunk;
+        }
+        p.misses++;
+        if (p.budget == 0) return std::make_shared<const DecodedChunk>(load());
+    }
+
+    // Decoded without holding the lock; concurrent misses on the same chunk
+    // both decode it and the first one inserted wins.
+    auto chunk = std::make_shared<const DecodedChunk>(load());
+    size_t bytes = chunkBytes(*chunk);
+
+    std::lock_guard<std::mutex> lock(p.mutex);
+    auto it = p.entries.find(key);
+    if (it != p.entries.end()) return it->second.chunk;
+    if (bytes > p.budget) return chunk;
+
+    bool hot = false;
+    auto ghost = p.ghostIndex.find(key);
+    if (ghost != p.ghostIndex.end()) {
+        p.ghosts.erase(ghost->second);
+        p.ghostIndex.erase(ghost);
+        hot = true;
+    }
+    KeyList &queue = hot ? p.hot : p.probation;
+    queue.push_front(key);
+    (hot ? p.hotBytes : p.probationBytes) += bytes;
+    p.entries.emplace(key, PoolEntry{chunk, bytes, hot, queue.begin()});
+    shrink(p);
+    return chunk;
+}
+
+void dropFileChunks(uint64_t file) {
+    BufferPool &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    for (auto it = p.entries.begin(); it != p.entries.end();) {
+        auto next = std::next(it);
+        if (it->first.file == file) forget(p, it);
+        it = next;
+    }
+    for (auto it = p.ghostIndex.begin(); it != p.ghostIndex.end();) {
+        if (it->first.file == file) {
+            p.ghosts.erase(it->second);
+            it = p.ghostIndex.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void setBufferPoolBudget(size_t bytes) {
+    BufferPool &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.budget = bytes;
+    shrink(p);
+}
+
+BufferPoolStats bufferPoolStats() {
+    BufferPool &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    BufferPoolStats stats;
+    stats.budget = p.budget;
+    stats.bytes = p.probationBytes + p.hotBytes;
+    stats.chunks = p.entries.size();
+    stats.hits = p.hits;
+    stats.misses = p.misses;
+    stats.evictions = p.evictions;
+    return stats;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../types.h"
+#include <functional>
+#include <memory>
+#include <variant>
+
+using DecodedChunk = std::variant<IntColumn, StringColumn>;
+
+struct BufferPoolStats {
+    size_t budget = 0;
+    size_t bytes = 0;
+    size_t chunks = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+// Process-wide cache of decoded column chunks, keyed by part file (the id of
+// its cached metadata) and chunk offset, within a global byte budget.
+//
+// Eviction follows 2Q: a chunk loaded for the first time goes to a FIFO
+// probation queue limited to a quarter of the budget, and only a second
+// reference moves it to the LRU hot queue. Chunks evicted from probation are
+// remembered as ghosts, and a ghost that is requested again is loaded
+// straight into the hot queue. A single large scan therefore only cycles
+// through probation and does not flush the hot tables.
+//
+// The returned pointer pins the chunk: chunks still held by a reader are
+// never evicted, so the pool may exceed its budget while they are in use.
+std::shared_ptr<const DecodedChunk> cachedChunk(uint64_t file, uint64_t offset, const std::function<DecodedChunk()> &load);
+
+// Drops all chunks of a part file that was deleted or replaced.
+void dropFileChunks(uint64_t file);
+
+// A budget of 0 disables the pool.
+void setBufferPoolBudget(size_t bytes);
+
+BufferPoolStats bufferPoolStats();
@@ -1,145 +1,142 @@
 #include "deserializator.h"
 #include "../codec/codec_int.h"
 #include "../codec/codec_string.h"
+#include "partFileCache.h"
+#include "bufferPool.h"
+#include "../codec/zstdDictionary.h"
+#include <atomic>
+#include <filesystem>
 #include <iostream>
-#include <fstream>
 #include <algorithm>
 
-Batch deserializatorBatch(ifstream& in, const string& filepath) {
-    uint32_t read_batch_magic;
-    uint32_t batch_num_rows;
-    uint32_t int_len;
-    uint32_t string_len;
-
-    in.read((char*)(&read_batch_magic), sizeof(read_batch_magic));
-
-    if(read_batch_magic != batch_magic){
-        cerr << "Invalid batch_magic";
-        return Batch();
-    }
-
-    in.read((char*)(&batch_num_rows), sizeof(batch_num_rows));
-    in.read((char*)(&int_len), sizeof(int_len));
-    in.read((char*)(&string_len), sizeof(string_len));
- 
-    Batch batch;
-    batch.num_rows = batch_num_rows;
-    decodeIntColumns(in, batch.intColumns, int_len);
-    decodeStringColumns(in, batch.stringColumns, string_len);
-    return batch;
+uint32_t formatVersion(uint32_t magic) {
+    if (magic == file_magic) return 1;
+    if (magic == file_magic_v2) return 2;
+    if (magic == file_magic_v3) return 3;
+    if (magic == file_magic_v4) return 4;
+    if (magic == file_magic_v5) return 5;
+    if (magic == file_magic_v6) return 6;
+    return 0;
 }
 
-vector<Batch> deserializator(const string& filepath) {
-    vector<Batch> batches;
-    ifstream in(filepath, ios::binary);
-    if (!in) {
+static uint32_t readFileVersion(MappedFile &file, const string &filepath, FileAccess access) {
+    if (!file.open(filepath, access)) {
         cerr << "deserializator: cannot open file " << filepath << "\n";
-        return {};
+        return 0;
     }
-    uint32_t read_file_magic;
-    in.read((char *)&read_file_magic, sizeof(read_file_magic));
-    if(read_file_magic != file_magic){
+    ByteReader in(file.data(), file.size());
+    uint32_t version = formatVersion(in.read<uint32_t>());
+    if (version == 0) {
         cerr << "Invalid file_magic";
-        return {};
     }
+    loadDictionaries(std::filesystem::path(filepath).parent_path().string());
+    return version;
+}
+
+vector<Batch> deserializator(const string& filepath) {
+    vector<Batch> batches;
+    MappedFile file;
+    uint32_t version = readFileVersion(file, filepath, FileAccess::SEQUENTIAL);
+    if (version == 0) return {};
+    ByteReader in(file.data(), file.size(), sizeof(uint32_t));
     while (true) {
-        uint32_t token;
-        if (!in.read((char*)(&token), sizeof(token))) break;
-        if (token == batch_magic) {
-            uint32_t batch_num_rows = 0;
-            uint32_t int_len = 0;
-            uint32_t string_len = 0;
+        uint32_t token = in.read<uint32_t>();
+        if (!in.ok() || token != batch_magic) break;
+        uint32_t batch_num_rows = in.read<uint32_t>();
+        uint32_t int_len = in.read<uint32_t>();
+        uint32_t string_len = in.read<uint32_t>();
 
-            in.read((char*)(&batch_num_rows), sizeof(batch_num_rows));
-            in.read((char*)(&int_len), sizeof(int_len));
-            in.read((char*)(&string_len), sizeof(string_len));
+        Batch b;
+        b.num_rows = batch_num_rows;
+        decodeIntColumns(in, b.intColumns, int_len, version);
+        decodeStringColumns(in, b.stringColumns, string_len, version);
+        if (!in.ok()) break;
 
-            Batch b;
-            b.num_rows = batch_num_rows;
-            decodeIntColumns(in, b.intColumns, int_len);
-            decodeStringColumns(in, b.stringColumns, string_len);
+        batches.push_back(move(b));
+    }
+    return batches;
+}
 
-            batches.push_back(move(b));
-        } else {
-            break;
+static ChunkStats readStats(ByteReader &in, uint8_t kind) {
+    ChunkStats stats;
+    uint8_t valid = in.read<uint8_t>();
+    stats.rowCount = in.read<uint64_t>();
+    if (kind == INTEGER) {
+        stats.intMin = in.read<int64_t>();
+        stats.intMax = in.read<int64_t>();
+    } else {
+        for (string *prefix : {&stats.strMin, &stats.strMax}) {
+            uint8_t len = in.read<uint8_t>();
+            *prefix = string(in.bytes(len));
         }
     }
-    return batches;
+    stats.valid = valid != 0;
+    return stats;
 }
 
-const unordered_map<string, ColumnInfo> createMap(ifstream &in) {
+// The footer is read in place from the mapping: an index of (name, kind,
+// last chunk offset[, stats]) entries, its entry count and its start offset.
+// Version 1 files without an index are walked backwards entry by entry.
+const unordered_map<string, ColumnInfo> createMap(const MappedFile &file, uint32_t version, unordered_map<string, ChunkStats> *stats = nullptr) {
     unordered_map<string, ColumnInfo> map;
+    uint64_t file_size = file.size();
+    ByteReader in(file.data(), file.size());
 
-    in.clear();
-    in.seekg(0, ios::end);
-    streamoff file_size = in.tellg();
-
-    const streamoff min_entry_footer = static_cast<streamoff>(sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint16_t));
+    const uint64_t min_entry_footer = sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint16_t);
     if (file_size < min_entry_footer) return map;
 
-    if (file_size >= static_cast<streamoff>(sizeof(uint32_t) + sizeof(uint64_t))) {
-        uint64_t index_start = 0;
-        in.seekg(file_size - static_cast<streamoff>(sizeof(uint64_t)), ios::beg);
-        if (in.read((char*)(&index_start), sizeof(index_start))) {
-            uint32_t n = 0;
-            in.seekg(file_size - static_cast<streamoff>(sizeof(uint64_t) + sizeof(uint32_t)), ios::beg);
-            if (in.read((char*)(&n), sizeof(n))) {
-                if (index_start <= static_cast<uint64_t>(file_size) && index_start + static_cast<uint64_t>(min_entry_footer) <= static_cast<uint64_t>(file_size) - (sizeof(uint64_t) + sizeof(uint32_t))) {
-                    in.seekg(static_cast<streamoff>(index_start), ios::beg);
-                    bool ok = true;
-                    for (uint32_t i = 0; i < n; ++i) {
-                        uint16_t name_len = 0;
-                        in.read((char*)(&name_len), sizeof(name_len));
-                        string name;
-                        if (name_len > 0) {
-                            name.resize(name_len);
-                            in.read(&name[0], name_len);
-                        }
-                        uint8_t kind = 0;
-                        in.read((char*)(&kind), sizeof(kind));
-                        uint64_t offset = 0;
-                        in.read((char*)(&offset), sizeof(offset));
-                        map.emplace(move(name), ColumnInfo{offset, kind});
-                    }
-                    if (ok) {
-                        return map;
-                    }
-                    map.clear();
-                } 
+    if (file_size >= sizeof(uint32_t) + sizeof(uint64_t)) {
+        in.seek(file_size - sizeof(uint64_t));
+        uint64_t index_start = in.read<uint64_t>();
+        in.seek(file_size - sizeof(uint64_t) - sizeof(uint32_t));
+        uint32_t n = in.read<uint32_t>();
+        if (index_start <= file_size && index_start + min_entry_footer <= file_size - (sizeof(uint64_t) + sizeof(uint32_t))) {
+            in.seek(index_start);
+            bool ok = true;
+            for (uint32_t i = 0; i < n; ++i) {
+                uint16_t name_len = in.read<uint16_t>();
+                string name(in.bytes(name_len));
+                uint8_t kind = in.read<uint8_t>();
+                uint64_t offset = in.read<uint64_t>();
+                if (version >= 2) {
+                    ChunkStats column_stats = readStats(in, kind);
+                    if (stats) stats->emplace(name, move(column_stats));
+                }
+                if (!in.ok()) {
+                    ok = false;
+                    break;
+                }
+                map.emplace(move(name), ColumnInfo{offset, kind});
+            }
+            if (ok) {
+                return map;
             }
+            map.clear();
+            if (stats) stats->clear();
         }
     }
 
-    streamoff cur = file_size;
-    while (true) {
-        if (cur < min_entry_footer) {
-            break;
-        }
+    if (version >= 2) return map;
+
+    uint64_t cur = file_size;
+    while (cur >= min_entry_footer) {
+        cur -= sizeof(uint64_t);
+        in.seek(cur);
+        uint64_t offset = in.read<uint64_t>();
+        cur -= sizeof(uint8_t);
+        in.seek(cur);
+        uint8_t kind = in.read<uint8_t>();
 
-        cur -= static_cast<streamoff>(sizeof(uint64_t));
-        in.seekg(cur, ios::beg);
-        uint64_t offset = 0;
-        in.read((char*)(&offset), sizeof(offset));
-        cur -= static_cast<streamoff>(sizeof(uint8_t));
-        in.seekg(cur, ios::beg);
-        uint8_t kind = 0;
-        in.read((char*)(&kind), sizeof(kind));
-
-        cur -= static_cast<streamoff>(sizeof(uint16_t));
-        in.seekg(cur, ios::beg);
-        uint16_t name_len = 0;
-        in.read((char*)(&name_len), sizeof(name_len));
-
-        if (cur < static_cast<streamoff>(name_len)) {
+        cur -= sizeof(uint16_t);
+        in.seek(cur);
+        uint16_t name_len = in.read<uint16_t>();
+
+        if (cur < name_len) {
             break;
         }
-        cur -= static_cast<streamoff>(name_len);
-        in.seekg(cur, ios::beg);
-        string name;
-        if (name_len > 0) {
-            name.resize(name_len);
-            in.read(&name[0], name_len); 
-        }
+        cur -= name_len;
+        in.seek(cur);
+        string name(in.bytes(name_len));
 
         map.emplace(move(name), ColumnInfo{offset, kind});
     }
@@ -169,18 +166,10 @@ void showMap(unordered_map<string, ColumnInfo> &map) {
 
 vector<Batch> readColumn(const string& filepath, string column){
     vector<Batch> batches;
-    ifstream in(filepath, ios::binary);
-    if (!in) {
-        cerr << "deserializator: cannot open file " << filepath << "\n";
-        return {};
-    }
-    uint32_t read_file_magic;
-    in.read((char *)&read_file_magic, sizeof(read_file_magic));
-    if(read_file_magic != file_magic){
-        cerr << "Invalid file_magic";
-        return {};
-    }
-    unordered_map<string, ColumnInfo> map = createMap(in);
+    MappedFile file;
+    uint32_t version = readFileVersion(file, filepath, FileAccess::RANDOM);
+    if (version == 0) return {};
+    unordered_map<string, ColumnInfo> map = createMap(file, version);
     auto it = map.find(column);
     if (it == map.end()) {
         cerr << "readColumn: column not found: " << column << "\n";
@@ -193,12 +182,12 @@ vector<Batch> readColumn(const string& filepath, string column){
     uint64_t cur_offset = col_offset;
     if (cur_offset == 0) return {};
 
+    ByteReader in(file.data(), file.size());
     while (cur_offset != 0) {
-        in.clear();
-        in.seekg(static_cast<streamoff>(cur_offset), ios::beg);
+        in.seek(cur_offset);
 
         if (col_kind == INTEGER) {
-            auto p = decodeIntColumn(in);
+            auto p = decodeIntColumn(in, version);
             uint64_t prev = p.first;
             IntColumn col = move(p.second);
             Batch b;
@@ -207,7 +196,7 @@ vector<Batch> readColumn(const string& filepath, string column){
             batches.push_back(move(b));
             cur_offset = prev;
         } else if (col_kind == STRING) {
-            auto p = decodeStringColumn(in);
+            auto p = decodeStringColumn(in, version);
             uint64_t prev = p.first;
             StringColumn col = move(p.second);
             Batch b;
@@ -218,8 +207,110 @@ vector<Batch> readColumn(const string& filepath, string column){
         } else {
             break;
         }
+        if (!in.ok()) break;
     }
 
     reverse(batches.begin(), batches.end());
     return batches;
-}
\ No newline at end of file
+}
+
+static vector<uint64_t> readColumnOffsets(const MappedFile &file, uint64_t last_offset) {
+    vector<uint64_t> offsets;
+    ByteReader in(file.data(), file.size());
+    uint64_t cur_offset = last_offset;
+    while (cur_offset != 0) {
+        offsets.push_back(cur_offset);
+        in.seek(cur_offset);
+        uint64_t prev = in.read<uint64_t>();
+        if (!in.ok()) break;
+        if (prev >= cur_offset) break;
+        cur_offset = prev;
+    }
+    reverse(offsets.begin(), offsets.end());
+    return offsets;
+}
+
+bool loadPartFileMeta(const string& filepath, PartFileMeta& meta) {
+    static std::atomic<uint64_t> nextId{1};
+    meta.id = nextId++;
+    meta.file = std::make_shared<MappedFile>();
+    meta.version = readFileVersion(*meta.file, filepath, FileAccess::SEQUENTIAL);
+    if (meta.version == 0) return false;
+    meta.columns = createMap(*meta.file, meta.version, &meta.stats);
+    for (const auto &kv : meta.columns) {
+        meta.chunks.emplace(kv.first, readColumnOffsets(*meta.file, kv.second.first));
+    }
+    return true;
+}
+
+bool PartFileReader::open(const string& filepath, const vector<string>& columns) {
+    meta = openPartFile(filepath);
+    if (!meta) return false;
+
+    vector<string> wanted = columns;
+    rows_only = wanted.empty();
+    if (rows_only && !meta->columns.empty()) wanted.push_back(meta->columns.begin()->first);
+
+    chains.clear();
+    chains.reserve(wanted.size());
+    for (const auto &name : wanted) {
+        auto it = meta->columns.find(name);
+        if (it == meta->columns.end()) {
+            cerr << "PartFileReader: column not found: " << name << "\n";
+            return false;
+        }
+        chains.push_back(Chain{name, it->second.second, &meta->chunks.at(name)});
+    }
+
+    num_batches = chains.empty() ? 0 : chains[0].offsets->size();
+    for (const auto &chain : chains) {
+        if (chain.offsets->size() != num_batches) {
+            cerr << "PartFileReader: columns have different number of batches in " << filepath << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+ChunkStats PartFileReader::batchStats(size_t batch, const string& column) {
+    const MappedFile &file = *meta->file;
+    for (const auto &chain : chains) {
+        if (chain.name != column) continue;
+        ByteReader in(file.data(), file.size(), (*chain.offsets)[batch]);
+        if (chain.kind == INTEGER) return readIntColumnStats(in, meta->version).second;
+        return readStringColumnStats(in, meta->version).second;
+    }
+    return ChunkStats();
+}
+
+Batch PartFileReader::readBatch(size_t batch_idx, bool compactStrings) {
+    const MappedFile &file = *meta->file;
+    Batch batch;
+    batch.num_rows = 0;
+    for (const auto &chain : chains) {
+        uint64_t offset = (*chain.offsets)[batch_idx];
+        auto chunk = cachedChunk(meta->id, offset, [&]() -> DecodedChunk {
+            ByteReader in(file.data(), file.size(), offset);
+            if (chain.kind == INTEGER) return move(decodeIntColumn(in, meta->version).second);
+            return move(decodeStringColumn(in, meta->version, true).second);
+        });
+        if (chain.kind == INTEGER) {
+            batch.sharedIntColumns.emplace_back(chunk, &get<IntColumn>(*chunk));
+            batch.num_rows = batch.sharedIntColumns.back()->column.size();
+        } else if (compactStrings) {
+            batch.sharedStringColumns.emplace_back(chunk, &get<StringColumn>(*chunk));
+            batch.num_rows = batch.sharedStringColumns.back()->rowCount();
+        } else {
+            batch.stringColumns.push_back(get<StringColumn>(*chunk));
+            StringColumn &col = batch.stringColumns.back();
+            materializeStrings(col);
+            batch.num_rows = col.rowCount();
+        }
+    }
+    if (rows_only) {
+        batch.stringColumns.clear();
+        batch.sharedIntColumns.clear();
+        batch.sharedStringColumns.clear();
+    }
+    return batch;
+}
@@ -1,5 +1,58 @@
+#pragma once
+
 #include "../types.h"
+#include "mappedFile.h"
+#include <memory>
+#include <unordered_map>
 
 vector<Batch> deserializator(const string& filepath);
 
 vector<Batch> readColumn(const string& filepath, string column);
+
+// Everything a reader needs to know about a part file before touching column
+// data: the mapping, format version, column directory with file-level stats
+// and, per column, the offsets of its chunks in batch order. The id is unique
+// per load and keys the file's chunks in the buffer pool. Part files never
+// change once written, so this is shared through the part file cache.
+struct PartFileMeta {
+    uint64_t id = 0;
+    std::shared_ptr<MappedFile> file;
+    uint32_t version = 0;
+    unordered_map<string, ColumnInfo> columns;
+    unordered_map<string, ChunkStats> stats;
+    unordered_map<string, vector<uint64_t>> chunks;
+};
+
+bool loadPartFileMeta(const string& filepath, PartFileMeta& meta);
+
+// Reads selected columns of a part file batch by batch. The file is memory
+// mapped and chunks are decoded straight from the mapping; the mapping and
+// the decoded footer come from the part file cache.
+class PartFileReader {
+public:
+    bool open(const string& filepath, const vector<string>& columns);
+
+    size_t batchCount() const { return num_batches; }
+
+    const unordered_map<string, ChunkStats>& fileStats() const { return meta->stats; }
+
+    ChunkStats batchStats(size_t batch, const string& column);
+
+    // Integer chunks are shared with the buffer pool (sharedIntColumns), not
+    // copied. With compactStrings, string chunks are shared as well and stay
+    // as dictionary and codes or as one buffer with offsets; otherwise they
+    // are copied out with one string per row.
+    Batch readBatch(size_t batch, bool compactStrings = false);
+
+private:
+    struct Chain {
+        string name;
+        uint8_t kind;
+        const vector<uint64_t> *offsets;
+    };
+
+    std::shared_ptr<const PartFileMeta> meta;
+    bool rows_only = false;
+    vector<Chain> chains;
+    size_t num_batches = 0;
+};
\ No newline at end of file
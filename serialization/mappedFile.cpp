@@ -0,0 +1,44 @@
+#include "mappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+void MappedFile::close() {
+    if (base) munmap(base, length);
+    base = nullptr;
+    length = 0;
+}
+
+bool MappedFile::open(const std::string &path, FileAccess access) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0) {
+        void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        base = static_cast<char *>(mapped);
+    }
+    ::close(fd);
+    advise(access);
+    return true;
+}
+
+void MappedFile::advise(FileAccess access) {
+    if (!base) return;
+    madvise(base, length, access == FileAccess::SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+}
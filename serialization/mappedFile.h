@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+enum class FileAccess {
+    SEQUENTIAL,
+    RANDOM
+};
+
+// Read-only mapping of a whole file. The access pattern is passed to the
+// kernel with madvise, so scans get aggressive read-ahead while footer and
+// statistics lookups do not pull in pages they never touch.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    bool open(const std::string &path, FileAccess access);
+
+    void advise(FileAccess access);
+
+    const char *data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    void close();
+
+    char *base = nullptr;
+    size_t length = 0;
+};
+
+// Cursor over a byte range. Reads past the end fail (ok() turns false and
+// zeroes are returned) instead of touching memory outside the range.
+class ByteReader {
+public:
+    ByteReader(const char *data, size_t size, size_t pos = 0) : data(data), length(size), pos(pos) {}
+
+    void seek(size_t offset) { pos = offset; }
+    size_t position() const { return pos; }
+    bool ok() const { return good; }
+
+    template<typename T>
+    T read() {
+        T value{};
+        if (!has(sizeof(T))) return value;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    // View of the next n bytes; stays valid as long as the underlying range.
+    std::string_view bytes(size_t n) {
+        if (!has(n)) return std::string_view();
+        std::string_view view(data + pos, n);
+        pos += n;
+        return view;
+    }
+
+private:
+    bool has(size_t n) {
+        if (good && pos <= length && n <= length - pos) return true;
+        good = false;
+        return false;
+    }
+
+    const char *data;
+    size_t length;
+    size_t pos;
+    bool good = true;
+};
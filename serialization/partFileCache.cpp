@@ -0,0 +1,110 @@
+#include "partFileCache.h"
+#include "bufferPool.h"
+#include "../utils/utils.h"
+#include <filesystem>
+#include <list>
+#include <mutex>
+
+namespace {
+
+struct FileKey {
+    uintmax_t size = 0;
+    std::filesystem::file_time_type mtime;
+
+    bool operator==(const FileKey &other) const { return size == other.size && mtime == other.mtime; }
+};
+
+struct Entry {
+    FileKey key;
+    std::shared_ptr<const PartFileMeta> meta;
+    std::list<std::string>::iterator position;
+};
+
+struct PartFileCache {
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> recent;
+};
+
+PartFileCache &cache() {
+    static PartFileCache c;
+    return c;
+}
+
+std::string normalize(const std::string &path) {
+    return std::filesystem::path(path).lexically_normal().string();
+}
+
+bool statFile(const std::string &path, FileKey &key) {
+    std::error_code ec;
+    key.size = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    key.mtime = std::filesystem::last_write_time(path, ec);
+    return !ec;
+}
+
+}
+
+std::shared_ptr<const PartFileMeta> openPartFile(const std::string &path) {
+    std::string name = normalize(path);
+    FileKey key;
+    if (!statFile(name, key)) {
+        log_error(std::string("openPartFile: cannot open part file ") + name);
+        return nullptr;
+    }
+
+    PartFileCache &c = cache();
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        auto it = c.entries.find(name);
+        if (it != c.entries.end()) {
+            if (it->second.key == key) {
+                c.recent.splice(c.recent.begin(), c.recent, it->second.position);
+                return it->second.meta;
+            }
+            dropFileChunks(it->second.meta->id);
+            c.recent.erase(it->second.position);
+            c.entries.erase(it);
+        }
+    }
+
+    // Loaded without holding the lock; if two queries miss at once, the
+    // second result simply replaces the first.
+    auto meta = std::make_shared<PartFileMeta>();
+    if (!loadPartFileMeta(name, *meta)) return nullptr;
+
+    std::lock_guard<std::mutex> lock(c.mutex);
+    auto it = c.entries.find(name);
+    if (it != c.entries.end()) {
+        dropFileChunks(it->second.meta->id);
+        c.recent.erase(it->second.position);
+        c.entries.erase(it);
+    }
+    c.recent.push_front(name);
+    c.entries.emplace(name, Entry{key, meta, c.recent.begin()});
+    while (c.entries.size() > PART_FILE_CACHE_ENTRIES) {
+        dropFileChunks(c.entries.at(c.recent.back()).meta->id);
+        c.entries.erase(c.recent.back());
+        c.recent.pop_back();
+    }
+    return meta;
+}
+
+void evictPartFile(const std::string &path) {
+    std::string name = normalize(path);
+    PartFileCache &c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    auto it = c.entries.find(name);
+    if (it == c.entries.end()) return;
+    dropFileChunks(it->second.meta->id);
+    c.recent.erase(it->second.position);
+    c.entries.erase(it);
+}
+
+void warmPartFileCache(const std::vector<std::string> &paths) {
+    size_t loaded = 0;
+    for (const auto &path : paths) {
+        if (openPartFile(path)) loaded++;
+    }
+    log_info(std::string("warmPartFileCache: loaded ") + std::to_string(loaded) + " of " + std::to_string(paths.size()) + " part files");
+}
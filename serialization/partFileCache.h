@@ -0,0 +1,16 @@
+#pragma once
+
+#include "deserializator.h"
+
+// Process-wide LRU cache of part file metadata (mapping, footer, chunk
+// directory), shared by all queries. Entries are keyed by path and validated
+// against the file's size and modification time, so a replaced file is
+// reloaded; deleted tables are evicted explicitly.
+
+// Returns nullptr when the file cannot be opened or is not a part file.
+std::shared_ptr<const PartFileMeta> openPartFile(const std::string &path);
+
+void evictPartFile(const std::string &path);
+
+// Loads the given files ahead of the first query.
+void warmPartFileCache(const std::vector<std::string> &paths);
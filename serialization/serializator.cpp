@@ -1,6 +1,7 @@
 #include "serializator.h"
 #include "../codec/codec_int.h"
 #include "../codec/codec_string.h"
+#include "../codec/zstdDictionary.h"
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
@@ -39,11 +40,43 @@ static std::ofstream startFile(const std::string& filepath) {
         std::cerr << "serializator: cannot open file " << filepath << "\n";
         return std::ofstream();
     }
-    out.write((const char*)(&file_magic), sizeof(file_magic));
+    out.write((const char*)(&file_magic_v6), sizeof(file_magic_v6));
     return out;
 }
 
-static void saveMap(const std::unordered_map<std::string, ColumnInfo> &map, std::ofstream &out) {
+static void mergeStats(ChunkStats &into, const ChunkStats &stats, uint8_t kind) {
+    if (!stats.valid) return;
+    if (!into.valid) {
+        into = stats;
+        return;
+    }
+    into.rowCount += stats.rowCount;
+    if (kind == INTEGER) {
+        into.intMin = std::min(into.intMin, stats.intMin);
+        into.intMax = std::max(into.intMax, stats.intMax);
+    } else {
+        into.strMin = std::min(into.strMin, stats.strMin);
+        into.strMax = std::max(into.strMax, stats.strMax);
+    }
+}
+
+static void writeStats(const ChunkStats &stats, uint8_t kind, std::ofstream &out) {
+    uint8_t valid = stats.valid ? 1 : 0;
+    out.write((const char*)(&valid), sizeof(valid));
+    out.write((const char*)(&stats.rowCount), sizeof(stats.rowCount));
+    if (kind == INTEGER) {
+        out.write((const char*)(&stats.intMin), sizeof(stats.intMin));
+        out.write((const char*)(&stats.intMax), sizeof(stats.intMax));
+    } else {
+        for (const std::string *prefix : {&stats.strMin, &stats.strMax}) {
+            uint8_t len = static_cast<uint8_t>(prefix->size());
+            out.write((const char*)(&len), sizeof(len));
+            if (len) out.write(prefix->data(), len);
+        }
+    }
+}
+
+static void saveMap(const std::unordered_map<std::string, ColumnInfo> &map, const std::unordered_map<std::string, ChunkStats> &stats, std::ofstream &out) {
     uint64_t index_start = static_cast<uint64_t>(out.tellp());
 
     for (const auto &kv : map) {
@@ -56,6 +89,9 @@ static void saveMap(const std::unordered_map<std::string, ColumnInfo> &map, std:
 
         out.write((const char*)(&kind), sizeof(kind));
         out.write((const char*)(&offset), sizeof(offset));
+
+        auto it = stats.find(name);
+        writeStats(it != stats.end() ? it->second : ChunkStats(), kind, out);
     }
     
     uint32_t n = static_cast<uint32_t>(map.size());
@@ -75,7 +111,9 @@ uint32_t initFileCounter(const std::string& folderPath){
 
         std::string name = entry.path().filename().string();
         const std::string prefix = "part";
+        if (name.rfind(prefix, 0) != 0) continue;
         std::string suffix = name.substr(prefix.size());
+        if (suffix.empty() || !std::all_of(suffix.begin(), suffix.end(), [](unsigned char ch) { return std::isdigit(ch); })) continue;
         int idx = std::stoi(suffix);
         if (idx > max_found) { 
             max_found = idx;
@@ -94,8 +132,12 @@ static void clearMap(std::unordered_map<std::string, ColumnInfo> &map) {
 
 std::vector<std::string> serializator(std::vector<Batch> &batches, const std::string& folderPath, uint64_t PART_LIMIT) {
     uint32_t file_counter = initFileCounter(folderPath);
+    // Dictionaries are trained on the first COPY into a table and reused by
+    // later ones.
+    ColumnDictionaries dictionaries = file_counter == 0 ? trainDictionaries(folderPath, batches) : loadDictionaries(folderPath);
     std::vector<std::string> filesNames;
     std::unordered_map<std::string, ColumnInfo> last_offset;
+    std::unordered_map<std::string, ChunkStats> file_stats;
     if (!batches.empty()) last_offset = initMap(batches[0]);
     else last_offset = initMap(Batch());
 
@@ -103,7 +145,7 @@ std::vector<std::string> serializator(std::vector<Batch> &batches, const std::st
     std::ofstream out = startFile(nextFilePath(folderPath, name));
     filesNames.push_back(name);
 
-    uint64_t file_pos = sizeof(file_magic);
+    uint64_t file_pos = sizeof(file_magic_v6);
     for (uint32_t batch_idx = 0; batch_idx < batches.size(); ++batch_idx) {
         Batch &batch = batches[batch_idx];
         out.write((const char*)(&batch_magic), sizeof(batch_magic));
@@ -128,8 +170,10 @@ std::vector<std::string> serializator(std::vector<Batch> &batches, const std::st
             out.write((const char*)(&prev), sizeof(prev));
             file_pos += sizeof(prev);
 
-            uint64_t written = encodeSingleIntColumn(out, intColumn);
+            ChunkStats stats;
+            uint64_t written = encodeSingleIntColumn(out, intColumn, stats);
             file_pos += written;
+            mergeStats(file_stats[intColumn.name], stats, INTEGER);
 
             last_offset[intColumn.name] = ColumnInfo{cur_offset, INTEGER};
         }
@@ -143,27 +187,31 @@ std::vector<std::string> serializator(std::vector<Batch> &batches, const std::st
             out.write((const char*)(&prev), sizeof(prev));
             file_pos += sizeof(prev);
 
-            uint64_t written = encodeSingleStringColumn(out, stringColumn);
+            ChunkStats stats;
+            auto dictionary = dictionaries.find(stringColumn.name);
+            uint64_t written = encodeSingleStringColumn(out, stringColumn, stats, dictionary == dictionaries.end() ? nullptr : dictionary->second.get());
             file_pos += written;
+            mergeStats(file_stats[stringColumn.name], stats, STRING);
 
             last_offset[stringColumn.name] = ColumnInfo{cur_offset, STRING};
         }
         out.flush();
         uint64_t cur_size = file_pos;
         if (cur_size > PART_LIMIT) {
-            saveMap(last_offset, out);
+            saveMap(last_offset, file_stats, out);
             out.close();
 
             ++file_counter;
             clearMap(last_offset);
+            file_stats.clear();
             name = nameFile(file_counter);
             out = startFile(nextFilePath(folderPath, name));
             filesNames.push_back(name);
-            file_pos = sizeof(file_magic);
+            file_pos = sizeof(file_magic_v6);
         }
     }
     if (out) {
-        saveMap(last_offset, out);
+        saveMap(last_offset, file_stats, out);
         out.close();
     }
     return filesNames;
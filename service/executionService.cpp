@@ -3,12 +3,17 @@
 #include "../results/results.h"
 #include "../serialization/deserializator.h"
 #include "../query/executor/selectExecutor.h"
+#include "../query/executor/morselScan.h"
 #include "../query/planer/selectPlaner.h"
 #include "../query/selectQuery.h"
-#include "../query/evaluation/expression_cache.h"
-#include "../query/evaluation/evalColumnExpression.h"
+#include "../query/evaluation/vectorEval.h"
+#include "../query/evaluation/zoneMap.h"
 #include <csv.hpp>
 #include <random>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include <iostream>
 #include "../utils/utils.h"
 
@@ -268,6 +273,17 @@ QueryCreatedResponse copyCSV(CopyQuery q, string query_id) {
     return response;
 }
 
+// Keeps only the projected columns of a transformed batch.
+static MixBatch projectBatch(MixBatch &mb, size_t baseCols, size_t projCols) {
+    MixBatch pm;
+    pm.num_rows = mb.num_rows;
+    pm.columns.resize(projCols);
+    for (size_t p = 0; p < projCols; ++p) {
+        if (baseCols + p < mb.columns.size()) pm.columns[p] = std::move(mb.columns[baseCols + p]);
+    }
+    return pm;
+}
+
 SELECT_TABLE_ERROR selectTable(const SelectQuery &select_query, string queryId){
     SelectQuery &sq = const_cast<SelectQuery&>(select_query);
     auto exprUsesColumnRef = [&](const ColumnExpression &expr) {
@@ -275,6 +291,7 @@ SELECT_TABLE_ERROR selectTable(const SelectQuery &select_query, string queryId){
         visit = [&](const ColumnExpression &e) -> bool {
             switch (e.type) {
                 case ExprType::COLUMN_REF: return true;
+                case ExprType::AGGREGATE: return true;
                 case ExprType::LITERAL: return false;
                 case ExprType::UNARY_OP:
                     if (e.unary.operand) return visit(*e.unary.operand);
@@ -292,8 +309,7 @@ SELECT_TABLE_ERROR selectTable(const SelectQuery &select_query, string queryId){
         return visit(expr);
     };
 
-    TableInfo info;
-    bool haveTableInfo = false;
+    TableDescriptor table;
     if (sq.tableName.empty()) {
         bool usesCols = false;
         if (sq.whereClause) usesCols = usesCols || exprUsesColumnRef(*sq.whereClause);
@@ -307,24 +323,19 @@ SELECT_TABLE_ERROR selectTable(const SelectQuery &select_query, string queryId){
                 return SELECT_TABLE_ERROR::TABLE_NOT_EXISTS;
             }
         } else {
-            info.name = std::string();
-            info.id = 0;
-            info.info.clear();
-            info.location.clear();
-            info.files.clear();
-            haveTableInfo = true;
+            table = std::make_shared<const TableInfo>(TableInfo{0, std::string(), {}, std::string(), {}});
         }
     }
 
-    if (!haveTableInfo) {
-        std::optional<TableInfo> infoOpt = getTableInfoByName(sq.tableName);
-        if (!infoOpt) {
+    if (!table) {
+        table = getTableDescriptor(sq.tableName);
+        if (!table) {
             return SELECT_TABLE_ERROR::TABLE_NOT_EXISTS;
         }
-        info = *infoOpt;
     }
+    const TableInfo &info = *table;
 
-    auto planResult = planSelectQuery(sq, info);
+    auto planResult = planSelectQuery(sq, table);
 
     if (planResult != SELECT_TABLE_ERROR::NONE) {
         return planResult;
@@ -343,17 +354,17 @@ SELECT_TABLE_ERROR selectTable(const SelectQuery &select_query, string queryId){
         mb.num_rows = 1;
         mb.columns.resize(projCols);
 
-        ExpressionCache cache;
-        ResultRow row;
-        row.values.clear();
+        BatchInput input;
+        input.num_rows = 1;
+        VectorEvaluator evaluator(input);
 
         for (size_t p = 0; p < projCols; ++p) {
             const auto &exprPtr = select_query.columnClauses[p];
             if (!exprPtr) continue;
-            Value v = evalColumnExpression(*exprPtr, row, &cache);
+            Value v = evaluator.eval(*exprPtr)->valueAt(0);
             ColumnData cd;
             cd.type = exprPtr->resultType;
-            cd.data.push_back(v);
+            cd.append(v);
             mb.columns[p] = std::move(cd);
         }
 
@@ -364,49 +375,217 @@ SELECT_TABLE_ERROR selectTable(const SelectQuery &select_query, string queryId){
     }
 
 
-    auto estimateBatchesBytes = [](const std::vector<MixBatch> &batches) {
-        size_t bytes = 0;
-        for (const auto &b : batches) {
-            for (const auto &col : b.columns) {
-                bytes += sizeof(col);
-                bytes += col.data.size() * sizeof(decltype(col.data)::value_type);
-                if (col.type == ValueType::VARCHAR) {
-                    for (const auto &v : col.data) bytes += v.stringValue.size();
-                }
-            }
-            bytes += sizeof(b.num_rows);
-        }
+    auto estimateBatchBytes = [](const MixBatch &b) {
+        size_t bytes = sizeof(b);
+        for (const auto &col : b.columns) bytes += col.memoryBytes();
         return bytes;
     };
+    size_t accumulatedBytes = 0;
 
+    std::vector<std::string> scanColumns;
+    scanColumns.reserve(select_query.referencedColumns.size());
+    for (size_t c : select_query.referencedColumns) {
+        if (c < info.info.size()) scanColumns.push_back(info.info[c].first);
+    }
+
+    std::set<size_t> whereColumns;
+    if (select_query.whereClause) collectReferencedColumns(*select_query.whereClause, whereColumns);
+
+    std::unique_ptr<TopNOperator> topN;
+    std::string topNColumn;
+    if (!select_query.aggregate && !select_query.orderByClauses.empty() && select_query.limit.has_value()) {
+        topN = std::make_unique<TopNOperator>(select_query.orderByClauses, select_query.limit.value());
+        size_t first = select_query.orderByClauses[0].columnIndex;
+        if (first >= info.info.size() && first - info.info.size() < select_query.columnClauses.size()) {
+            const auto &expr = select_query.columnClauses[first - info.info.size()];
+            if (expr && expr->type == ExprType::COLUMN_REF && expr->columnRef.index < info.info.size()) {
+                topNColumn = info.info[expr->columnRef.index].first;
+            }
+        }
+    }
+
+    std::atomic<size_t> scannedBatches{0};
+    std::atomic<size_t> prunedBatches{0};
+    size_t prunedFiles = 0;
+
+    // Without ORDER BY any rows satisfy LIMIT, so the scan stops once enough rows passed WHERE.
+    bool stopEarly = !select_query.aggregate && select_query.orderByClauses.empty() && select_query.limit.has_value();
+    size_t collectedRows = 0;
+
+    // Without ORDER BY and aggregates the rows are final as soon as a batch is
+    // projected, so they go straight to the result file.
+    bool streamResult = !select_query.aggregate && select_query.orderByClauses.empty();
+    size_t baseCols = info.info.size();
+    size_t projCols = select_query.columnClauses.size();
+    std::vector<ValueType> resultTypes;
+    for (const auto &expr : select_query.columnClauses) resultTypes.push_back(expr->resultType);
+    ResultWriter resultWriter(queryId);
+
+    // Zone maps prune files and batches up front; the surviving batches are
+    // the morsels shared by the scan workers.
+    std::vector<std::pair<std::string, size_t>> morsels;
+    std::vector<ChunkStats> topNStats;
     for (const auto &f : info.files) {
-        std::string path = info.location;
-        if (!path.empty() && path.back() != '/' && path.back() != '\\') path.push_back('/');
-        path += f;
+        std::string path = partFilePath(info.location, f);
 
-        std::vector<Batch> batches = move(deserializator(path));
+        PartFileReader reader;
+        if (!reader.open(path, scanColumns)) {
+            log_error(std::string("selectTable: cannot read part file ") + path);
+            continue;
+        }
 
-        for (auto &batch : batches) {
-            SELECT_TABLE_ERROR r = executeSelectBatch(select_query, batch, accumulatedBatches);
+        if (select_query.whereClause) {
+            ZoneMap fileZones;
+            for (size_t c : whereColumns) {
+                auto it = reader.fileStats().find(info.info[c].first);
+                if (it != reader.fileStats().end()) fileZones.emplace(c, it->second);
+            }
+            if (evalZoneMap(*select_query.whereClause, fileZones) == ZoneMatch::NEVER) {
+                prunedFiles++;
+                prunedBatches += reader.batchCount();
+                continue;
+            }
+        }
+
+        for (size_t b = 0; b < reader.batchCount(); ++b) {
+            if (select_query.whereClause) {
+                ZoneMap batchZones;
+                for (size_t c : whereColumns) batchZones.emplace(c, reader.batchStats(b, info.info[c].first));
+                if (evalZoneMap(*select_query.whereClause, batchZones) == ZoneMatch::NEVER) {
+                    prunedBatches++;
+                    continue;
+                }
+            }
+            morsels.emplace_back(path, b);
+            if (topN && !topNColumn.empty()) topNStats.push_back(reader.batchStats(b, topNColumn));
+        }
+    }
+
+    size_t threads = scanThreads(select_query, morsels.size());
+    std::vector<std::unique_ptr<PartFileReader>> readers(threads);
+    std::vector<std::string> openPaths(threads);
+    auto readMorsel = [&](size_t worker, size_t m, Batch &batch) {
+        const auto &morsel = morsels[m];
+        if (openPaths[worker] != morsel.first) {
+            openPaths[worker].clear();
+            readers[worker] = std::make_unique<PartFileReader>();
+            if (!readers[worker]->open(morsel.first, scanColumns)) {
+                log_error(std::string("selectTable: cannot read part file ") + morsel.first);
+                return false;
+            }
+            openPaths[worker] = morsel.first;
+        }
+        batch = readers[worker]->readBatch(morsel.second, true);
+        scannedBatches++;
+        return true;
+    };
+
+    // Surviving batches are aggregated by the workers into private hash
+    // tables, which are merged once the scan is done.
+    if (select_query.aggregate) {
+        AggregatePlan plan = buildAggregatePlan(select_query);
+        std::vector<ValueType> keyTypes;
+        for (const auto *k : plan.keys) keyTypes.push_back(k->resultType);
+
+        std::vector<std::unique_ptr<HashAggregator>> partials;
+        for (size_t t = 0; t < threads; ++t) {
+            partials.push_back(std::make_unique<HashAggregator>(keyTypes, plan.aggregates, MEMORY_LIMIT / threads));
+        }
+        // A skipped morsel would leave every aggregate silently wrong, so the
+        // first failure fails the query; the remaining morsels are not read.
+        std::atomic<bool> aggregateFailed{false};
+        try {
+            runMorsels(morsels.size(), threads, [&](size_t worker, size_t m, MixBatch &) {
+                if (aggregateFailed) return false;
+                Batch batch;
+                if (!readMorsel(worker, m, batch)) {
+                    aggregateFailed = true;
+                    return false;
+                }
+                SELECT_TABLE_ERROR r = aggregateBatch(select_query, plan, batch, *partials[worker]);
+                if (r != SELECT_TABLE_ERROR::NONE) {
+                    log_error(std::string("selectTable: aggregateBatch returned error code ") + std::to_string((int)r));
+                    aggregateFailed = true;
+                }
+                return false;
+            }, nullptr);
+        } catch (const std::exception &e) {
+            log_error(std::string("selectTable: aggregation failed: ") + e.what());
+            return SELECT_TABLE_ERROR::INVALID_GROUP_BY;
+        }
+        if (aggregateFailed) return SELECT_TABLE_ERROR::INVALID_GROUP_BY;
+
+        for (size_t t = 1; t < threads; ++t) partials[0]->merge(*partials[t]);
+        size_t spilled = partials[0]->spilledPartitions();
+        MixBatch states = partials[0]->finish();
+        log_info(std::string("selectTable: aggregated ") + std::to_string(states.num_rows) + " groups, " + std::to_string(spilled) + " spills");
+        accumulatedBatches.push_back(aggregateResult(select_query, plan, states, info.info.size()));
+    } else if (!(stopEarly && select_query.limit.value() == 0)) {
+        // Workers decode, filter and project; the results are consumed here in
+        // file order, so Top-N, LIMIT and spilling behave as in a serial scan.
+        std::mutex topNMutex;
+        runMorsels(morsels.size(), threads, [&](size_t worker, size_t m, MixBatch &out) {
+            if (topN && !topNColumn.empty()) {
+                std::lock_guard<std::mutex> lock(topNMutex);
+                if (topN->canSkip(topNStats[m])) {
+                    prunedBatches++;
+                    return false;
+                }
+            }
+            Batch batch;
+            if (!readMorsel(worker, m, batch)) return false;
+            SELECT_TABLE_ERROR r = transformBatch(select_query, batch, out);
             if (r != SELECT_TABLE_ERROR::NONE) {
-                log_error(std::string("selectTable: executeSelectBatch returned error code ") + std::to_string((int)r));
+                log_error(std::string("selectTable: transformBatch returned error code ") + std::to_string((int)r));
+                return false;
             }
-            size_t est = estimateBatchesBytes(accumulatedBatches);
-            size_t accRows = 0;
-            for (const auto &b : accumulatedBatches) accRows += b.num_rows;
-            if (est > MEMORY_LIMIT) {
+            return true;
+        }, [&](MixBatch &mb) {
+            if (topN) {
+                std::lock_guard<std::mutex> lock(topNMutex);
+                topN->consume(mb);
+                return true;
+            }
+            if (streamResult) {
+                size_t take = mb.num_rows;
+                if (stopEarly) take = std::min(take, select_query.limit.value() - collectedRows);
+                resultWriter.append(projectBatch(mb, baseCols, projCols), take);
+                collectedRows += take;
+                return !(stopEarly && collectedRows >= select_query.limit.value());
+            }
+            accumulatedBytes += estimateBatchBytes(mb);
+            collectedRows += mb.num_rows;
+            accumulatedBatches.push_back(std::move(mb));
+            if (stopEarly && collectedRows >= select_query.limit.value()) return false;
+            if (accumulatedBytes > MEMORY_LIMIT) {
                 try {
                     std::string runPath = spillBatchesToRun(accumulatedBatches, select_query.orderByClauses);
                     runFiles.push_back(runPath);
                     accumulatedBatches.clear();
+                    accumulatedBytes = 0;
                 } catch (const std::exception &e) {
                     log_error(std::string("spillBatchesToRun failed: ") + e.what());
                 }
             }
-        }
+            return true;
+        });
     }
 
-    if (!runFiles.empty()) {
+    if (topN) {
+        MixBatch top = topN->finish();
+        if (top.num_rows > 0) accumulatedBatches.push_back(std::move(top));
+    }
+
+    json statistics = json::object();
+    statistics["scannedBatches"] = scannedBatches.load();
+    statistics["prunedBatches"] = prunedBatches.load();
+    statistics["prunedFiles"] = prunedFiles;
+    addQueryStatistics(queryId, statistics);
+    log_info(std::string("selectTable: scanned ") + std::to_string(scannedBatches.load()) + " batches, pruned " + std::to_string(prunedBatches.load()) + " batches and " + std::to_string(prunedFiles) + " files");
+
+    if (streamResult) {
+        resultWriter.close(resultTypes);
+    } else if (!runFiles.empty()) {
         if (!accumulatedBatches.empty()) {
             try {
                 std::string runPath = spillBatchesToRun(accumulatedBatches, select_query.orderByClauses);
@@ -417,42 +596,13 @@ SELECT_TABLE_ERROR selectTable(const SelectQuery &select_query, string queryId){
             }
         }
         MixBatch finalBatch = mergeRunFiles(runFiles, select_query.orderByClauses, select_query.limit);
-        std::vector<MixBatch> outVec;
-        outVec.push_back(std::move(finalBatch));
-        size_t baseCols = info.info.size();
-        size_t projCols = select_query.columnClauses.size();
-        std::vector<MixBatch> projectedOut;
-        projectedOut.reserve(outVec.size());
-        for (const auto &mb : outVec) {
-            MixBatch pm;
-            pm.num_rows = mb.num_rows;
-            pm.columns.resize(projCols);
-            for (size_t p = 0; p < projCols; ++p) {
-                if (baseCols + p < mb.columns.size()) pm.columns[p] = mb.columns[baseCols + p];
-                else pm.columns[p] = ColumnData();
-            }
-            projectedOut.push_back(std::move(pm));
-        }
-        modifyResult(queryId, projectedOut);
+        resultWriter.append(projectBatch(finalBatch, baseCols, projCols));
+        resultWriter.close(resultTypes);
     } else {
         SELECT_TABLE_ERROR ord = orderAndLimitResult(accumulatedBatches, select_query.orderByClauses, select_query.limit);
         if (ord != SELECT_TABLE_ERROR::NONE) return ord;
-        size_t tot = 0; for (const auto &b : accumulatedBatches) tot += b.num_rows;
-        size_t baseCols2 = info.info.size();
-        size_t projCols2 = select_query.columnClauses.size();
-        std::vector<MixBatch> projectedAcc;
-        projectedAcc.reserve(accumulatedBatches.size());
-        for (const auto &mb : accumulatedBatches) {
-            MixBatch pm;
-            pm.num_rows = mb.num_rows;
-            pm.columns.resize(projCols2);
-            for (size_t p = 0; p < projCols2; ++p) {
-                if (baseCols2 + p < mb.columns.size()) pm.columns[p] = mb.columns[baseCols2 + p];
-                else pm.columns[p] = ColumnData();
-            }
-            projectedAcc.push_back(std::move(pm));
-        }
-        modifyResult(queryId, projectedAcc);
+        for (auto &mb : accumulatedBatches) resultWriter.append(projectBatch(mb, baseCols, projCols));
+        resultWriter.close(resultTypes);
     }
 
     return SELECT_TABLE_ERROR::NONE;
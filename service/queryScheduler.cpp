@@ -0,0 +1,64 @@
+#include "queryScheduler.h"
+#include <algorithm>
+#include "../utils/utils.h"
+
+QueryScheduler::QueryScheduler(size_t copyWorkers, size_t selectWorkers, size_t queueDepth)
+    : queueDepth(queueDepth) {
+    Lane &copy = lanes[static_cast<size_t>(QueryLane::COPY)];
+    Lane &select = lanes[static_cast<size_t>(QueryLane::SELECT)];
+    for (size_t i = 0; i < std::max<size_t>(1, copyWorkers); ++i) copy.workers.emplace_back([this, &copy] { work(copy); });
+    for (size_t i = 0; i < std::max<size_t>(1, selectWorkers); ++i) select.workers.emplace_back([this, &select] { work(select); });
+}
+
+QueryScheduler::~QueryScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    for (auto &lane : lanes) {
+        lane.ready.notify_all();
+        for (auto &w : lane.workers) w.join();
+    }
+}
+
+bool QueryScheduler::submit(QueryLane lane, std::function<void()> job) {
+    Lane &l = lanes[static_cast<size_t>(lane)];
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || l.jobs.size() >= queueDepth) return false;
+        l.jobs.push_back(std::move(job));
+    }
+    l.ready.notify_one();
+    return true;
+}
+
+size_t QueryScheduler::queued(QueryLane lane) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lanes[static_cast<size_t>(lane)].jobs.size();
+}
+
+size_t QueryScheduler::running(QueryLane lane) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lanes[static_cast<size_t>(lane)].running;
+}
+
+void QueryScheduler::work(Lane &lane) {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            lane.ready.wait(lock, [&] { return stopping || !lane.jobs.empty(); });
+            if (lane.jobs.empty()) return;
+            job = std::move(lane.jobs.front());
+            lane.jobs.pop_front();
+            lane.running++;
+        }
+        try {
+            job();
+        } catch (const std::exception &e) {
+            log_error(std::string("QueryScheduler: query failed with exception: ") + e.what());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        lane.running--;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class QueryLane {
+    COPY,
+    SELECT
+};
+
+// Runs submitted queries on a fixed pool of worker threads. COPY and SELECT
+// queries have separate lanes (own workers and own bounded queue), so bulk
+// loads never delay short SELECTs.
+class QueryScheduler {
+public:
+    QueryScheduler(size_t copyWorkers, size_t selectWorkers, size_t queueDepth);
+    ~QueryScheduler();
+
+    QueryScheduler(const QueryScheduler&) = delete;
+    QueryScheduler &operator=(const QueryScheduler&) = delete;
+
+    // Returns false when the lane already has queueDepth jobs waiting.
+    bool submit(QueryLane lane, std::function<void()> job);
+
+    size_t queued(QueryLane lane) const;
+    size_t running(QueryLane lane) const;
+
+private:
+    struct Lane {
+        std::deque<std::function<void()>> jobs;
+        std::vector<std::thread> workers;
+        std::condition_variable ready;
+        size_t running = 0;
+    };
+
+    void work(Lane &lane);
+
+    mutable std::mutex mutex;
+    size_t queueDepth;
+    bool stopping = false;
+    Lane lanes[2];
+};
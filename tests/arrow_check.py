@@ -0,0 +1,57 @@
+# Checks that the Arrow IPC result stream matches the JSON result.
+# Needs a running server and the packages from requirements.txt.
+import json
+import time
+import urllib.request
+
+import pyarrow.ipc as ipc
+
+BASE_URL = "http://localhost:8080"
+ARROW_STREAM = "application/vnd.apache.arrow.stream"
+
+
+def call(method, path, body=None, accept="application/json"):
+    data = json.dumps(body).encode() if body is not None else None
+    req = urllib.request.Request(BASE_URL + path, data=data, method=method,
+                                 headers={"Content-Type": "application/json", "Accept": accept})
+    with urllib.request.urlopen(req) as resp:
+        return resp.read()
+
+
+def run_query(definition):
+    qid = json.loads(call("POST", "/query", {"queryDefinition": definition}))
+    for _ in range(50):
+        status = json.loads(call("GET", "/query/" + qid))["status"]
+        if status in ("COMPLETED", "FAILED"):
+            break
+        time.sleep(0.1)
+    if status != "COMPLETED":
+        raise SystemExit("FAIL: query " + qid + " ended with " + status)
+    return qid
+
+
+def main():
+    name = "arrow_%d" % int(time.time())
+    table_id = json.loads(call("PUT", "/table", {name: {"columns": {"id": "INT64", "kind": "VARCHAR"}}}))
+    csv_path = "../data/%s.csv" % name
+    with open(csv_path, "w") as out:
+        out.write("id,kind\n")
+        for i in range(20000):
+            out.write("%d,%s\n" % (i, "a" if i % 3 == 0 else "b"))
+    try:
+        run_query({"sourceFilepath": csv_path, "destinationTableName": name, "doesCsvContainHeader": True})
+        qid = run_query({"tableName": name})
+
+        expected = json.loads(call("GET", "/result/" + qid))[0]["columns"]
+        table = ipc.open_stream(call("GET", "/result/" + qid, accept=ARROW_STREAM)).read_all()
+        table.validate(full=True)
+        columns = [table.column(i).to_pylist() for i in range(table.num_columns)]
+        if columns != expected:
+            raise SystemExit("FAIL: Arrow stream differs from the JSON result")
+        print("arrow_check: OK (%d rows)" % table.num_rows)
+    finally:
+        call("DELETE", "/table/" + table_id)
+
+
+if __name__ == "__main__":
+    main()
@@ -6,6 +6,10 @@
 #include <chrono>
 #include <vector>
 #include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <limits>
 
 using namespace std;
 using json = nlohmann::ordered_json;
@@ -177,6 +181,8 @@ void tryToCreateTableColumnEntryMissingType(){
 void getSystem(){
     cpr::Response r = cpr::Get(cpr::Url{BASE_URL + "/system/info"});
     if (r.status_code != 200) fail("getSystem: GET /system/info failed: " + r.text);
+    json info = json::parse(r.text);
+    if (!info.contains("bufferPool") || !info["bufferPool"].contains("hits")) fail("getSystem: missing bufferPool counters: " + r.text);
 }
 
 vector<string> getQuieriesId() {
@@ -332,9 +338,9 @@ void invalidDataInCSVCopyQuery(){
     json copyReq = json::object();
     copyReq["queryDefinition"] = json::object({{"sourceFilepath", csvPath}, {"destinationTableName", tableName}, {"doesCsvContainHeader", true}});
     cpr::Response copyResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{copyReq.dump()});
-    if (copyResp.status_code == 200) {
-        fail(std::string("invalidDataInCSVCopyQuery: unexpected 200 status"));
-    }
+    if (copyResp.status_code != 200) fail("invalidDataInCSVCopyQuery: submit failed: " + copyResp.text);
+    std::string copyStatus = pollQueryStatus(json::parse(copyResp.text).get<std::string>());
+    if (copyStatus != "FAILED") fail("invalidDataInCSVCopyQuery: expected FAILED but got " + copyStatus);
     if (!created.is_string()) fail("expected string TableID");
     std::string tableId = created.get<std::string>();
     if (!tableId.empty()) cpr::Response del = cpr::Delete(cpr::Url{BASE_URL + "/table/" + tableId});
@@ -355,7 +361,9 @@ void lessColumnsInCSVCopyQuery(){
     json copyReq = json::object();
     copyReq["queryDefinition"] = json::object({{"sourceFilepath", csvPath}, {"destinationTableName", tableName}, {"doesCsvContainHeader", true}});
     cpr::Response copyResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{copyReq.dump()});
-    if (copyResp.status_code == 200) fail(std::string("lessColumnsInCSVCopyQuery: unexpected 200 status"));
+    if (copyResp.status_code != 200) fail("lessColumnsInCSVCopyQuery: submit failed: " + copyResp.text);
+    std::string copyStatus = pollQueryStatus(json::parse(copyResp.text).get<std::string>());
+    if (copyStatus != "FAILED") fail("lessColumnsInCSVCopyQuery: expected FAILED but got " + copyStatus);
 
     if (!created.is_string()) fail("expected string TableID");
     std::string tableId = created.get<std::string>();
@@ -484,7 +492,8 @@ void getQueryErrorWithCorrectQueryId(){
     cpr::Response copyResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{copyReq.dump()});
     std::string qid;
 
-    if (copyResp.status_code == 200) fail("getQueryErrorWithCorrectQueryId: expected non-200 for bad copy body");
+    if (copyResp.status_code != 200) fail("getQueryErrorWithCorrectQueryId: submit failed: " + copyResp.text);
+    pollQueryStatus(json::parse(copyResp.text).get<std::string>());
     
     cpr::Response qlist = cpr::Get(cpr::Url{BASE_URL + "/queries"}, cpr::Header{{"Accept","application/json"}});
     if (qlist.status_code != 200) {
@@ -597,8 +606,416 @@ void testRowLimitAndFlushResult(){
     if (elem["columns"].size() != 1) fail("testRowLimitAndFlushResult: expected 1 column but got " + std::to_string(elem["columns"].size()));
     if (!elem["columns"][0].is_array()) fail("testRowLimitAndFlushResult: column is not array: " + elem["columns"][0].dump());
     if (static_cast<int>(elem["columns"][0].size()) != 1) fail("testRowLimitAndFlushResult: expected 1 row in column but got " + std::to_string(elem["columns"][0].size()));
+    if (!elem.contains("nextOffset") || elem["nextOffset"] != 1) fail("testRowLimitAndFlushResult: expected nextOffset 1: " + elem.dump());
+
+    getReq["rowLimit"] = 2;
+    getReq["offset"] = 1;
+    cpr::Response page = cpr::Get(cpr::Url{BASE_URL + "/result/" + selectQid}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{getReq.dump()});
+    if (page.status_code != 200) fail("testRowLimitAndFlushResult: GET /result with offset failed: " + page.text);
+    json pageResults = json::parse(page.text);
+    if (!pageResults.is_array() || pageResults.empty()) fail("testRowLimitAndFlushResult: page missing or empty: " + page.text);
+    if (pageResults[0]["columns"] != json::array({json::array({20, 30})})) fail("testRowLimitAndFlushResult: unexpected page: " + pageResults[0].dump());
+    if (pageResults[0].contains("nextOffset")) fail("testRowLimitAndFlushResult: last page should not have nextOffset: " + pageResults[0].dump());
+
+    if (!tableId.empty()) cpr::Response del = cpr::Delete(cpr::Url{BASE_URL + "/table/" + tableId});
+}
+
+void testOrderByWithLimit(){
+    std::string tableName = "obl_" + std::to_string(::time(nullptr));
+    std::string createBody = "{" + std::string("\"" + tableName + "\": { \"columns\": { \"id\": \"INT64\" } } }");
+    cpr::Response r = cpr::Put(cpr::Url{BASE_URL + "/table"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{createBody});
+    if (r.status_code != 200) fail("testOrderByWithLimit: create table failed: " + r.text);
+    std::string tableId = json::parse(r.text).get<std::string>();
+
+    std::string csvPath = std::string("../data/") + tableName + ".csv";
+    {
+        std::ofstream out(csvPath);
+        out << "id\n";
+        for (int i = 0; i < 20000; ++i) out << ((i * 7919) % 20000) << "\n";
+    }
+
+    json copyReq = json::object();
+    copyReq["queryDefinition"] = json::object({{"sourceFilepath", csvPath}, {"destinationTableName", tableName}, {"doesCsvContainHeader", true}});
+    cpr::Response copyResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{copyReq.dump()});
+    if (copyResp.status_code != 200) fail("testOrderByWithLimit: copy submit failed: " + copyResp.text);
+    std::string copyStatus = pollQueryStatus(json::parse(copyResp.text).get<std::string>());
+    if (copyStatus != "COMPLETED") fail("testOrderByWithLimit: copy did not complete: " + copyStatus);
+
+    json selectReq = json::object();
+    selectReq["queryDefinition"] = json::object({
+        {"columnClauses", json::array({json::object({{"tableName", tableName}, {"columnName", "id"}})})},
+        {"orderByClauses", json::array({json::object({{"columnIndex", 0}, {"ascending", false}})})},
+        {"limitClause", json::object({{"limit", 3}})}
+    });
+    cpr::Response selectResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{selectReq.dump()});
+    if (selectResp.status_code != 200) fail("testOrderByWithLimit: select submit failed: " + selectResp.text);
+    std::string selectQid = json::parse(selectResp.text).get<std::string>();
+    std::string selectStatus = pollQueryStatus(selectQid);
+    if (selectStatus != "COMPLETED") fail("testOrderByWithLimit: select did not complete: " + selectStatus);
+
+    cpr::Response res = cpr::Get(cpr::Url{BASE_URL + "/result/" + selectQid}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{"{}"});
+    if (res.status_code != 200) fail("testOrderByWithLimit: GET /result failed: " + res.text);
+    json results = json::parse(res.text);
+    if (!results.is_array() || results.empty()) fail("testOrderByWithLimit: result missing or empty: " + res.text);
+    json expected = json::array({json::array({19999, 19998, 19997})});
+    if (results[0]["columns"] != expected) fail("testOrderByWithLimit: unexpected rows: " + results[0].dump());
+
+    if (!tableId.empty()) cpr::Response del = cpr::Delete(cpr::Url{BASE_URL + "/table/" + tableId});
+}
+
+void testGroupByAggregates(){
+    std::string tableName = "grp_" + std::to_string(::time(nullptr));
+    std::string createBody = "{" + std::string("\"" + tableName + "\": { \"columns\": { \"id\": \"INT64\", \"kind\": \"VARCHAR\" } } }");
+    cpr::Response r = cpr::Put(cpr::Url{BASE_URL + "/table"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{createBody});
+    if (r.status_code != 200) fail("testGroupByAggregates: create table failed: " + r.text);
+    std::string tableId = json::parse(r.text).get<std::string>();
+
+    std::string csvPath = std::string("../data/") + tableName + ".csv";
+    {
+        std::ofstream out(csvPath);
+        out << "id,kind\n";
+        for (int i = 0; i < 20000; ++i) out << i << "," << (i % 3 == 0 ? "a" : "b") << "\n";
+    }
+
+    json copyReq = json::object();
+    copyReq["queryDefinition"] = json::object({{"sourceFilepath", csvPath}, {"destinationTableName", tableName}, {"doesCsvContainHeader", true}});
+    cpr::Response copyResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{copyReq.dump()});
+    if (copyResp.status_code != 200) fail("testGroupByAggregates: copy submit failed: " + copyResp.text);
+    std::string copyStatus = pollQueryStatus(json::parse(copyResp.text).get<std::string>());
+    if (copyStatus != "COMPLETED") fail("testGroupByAggregates: copy did not complete: " + copyStatus);
+
+    json kind = json::object({{"tableName", tableName}, {"columnName", "kind"}});
+    json id = json::object({{"tableName", tableName}, {"columnName", "id"}});
+    json selectReq = json::object();
+    selectReq["queryDefinition"] = json::object({
+        {"columnClauses", json::array({
+            kind,
+            json::object({{"aggregateFunction", "COUNT"}}),
+            json::object({{"aggregateFunction", "SUM"}, {"argument", id}}),
+            json::object({{"aggregateFunction", "MIN"}, {"argument", id}}),
+            json::object({{"aggregateFunction", "MAX"}, {"argument", id}})
+        })},
+        {"groupByClauses", json::array({kind})},
+        {"orderByClauses", json::array({json::object({{"columnIndex", 0}, {"ascending", true}})})}
+    });
+    cpr::Response selectResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{selectReq.dump()});
+    if (selectResp.status_code != 200) fail("testGroupByAggregates: select submit failed: " + selectResp.text);
+    std::string selectQid = json::parse(selectResp.text).get<std::string>();
+    std::string selectStatus = pollQueryStatus(selectQid);
+    if (selectStatus != "COMPLETED") fail("testGroupByAggregates: select did not complete: " + selectStatus);
+
+    cpr::Response res = cpr::Get(cpr::Url{BASE_URL + "/result/" + selectQid}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{"{}"});
+    if (res.status_code != 200) fail("testGroupByAggregates: GET /result failed: " + res.text);
+    json results = json::parse(res.text);
+    if (!results.is_array() || results.empty()) fail("testGroupByAggregates: result missing or empty: " + res.text);
+    json expected = json::array({
+        json::array({"a", "b"}),
+        json::array({6667, 13333}),
+        json::array({66663333, 133326667}),
+        json::array({0, 1}),
+        json::array({19998, 19999})
+    });
+    if (results[0]["columns"] != expected) fail("testGroupByAggregates: unexpected rows: " + results[0].dump());
+
+    if (!tableId.empty()) cpr::Response del = cpr::Delete(cpr::Url{BASE_URL + "/table/" + tableId});
+}
+
+static std::string queryStatus(const std::string &queryId) {
+    cpr::Response qr = cpr::Get(cpr::Url{BASE_URL + "/query/" + queryId}, cpr::Header{{"Accept","application/json"}});
+    if (qr.status_code != 200) return std::string();
+    json qbody = json::parse(qr.text);
+    if (qbody.is_array() && !qbody.empty()) qbody = qbody[0];
+    return qbody.is_object() ? qbody.value("status", "") : std::string();
+}
+
+void testResultOfRunningQuery(){
+    std::string tableName = "run_" + std::to_string(::time(nullptr));
+    std::string createBody = "{" + std::string("\"" + tableName + "\": { \"columns\": { \"id\": \"INT64\", \"text\": \"VARCHAR\" } } }");
+    cpr::Response r = cpr::Put(cpr::Url{BASE_URL + "/table"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{createBody});
+    if (r.status_code != 200) fail("testResultOfRunningQuery: create table failed: " + r.text);
+    std::string tableId = json::parse(r.text).get<std::string>();
+
+    std::string csvPath = std::string("../data/") + tableName + ".csv";
+    {
+        std::ofstream out(csvPath);
+        out << "id,text\n";
+        for (int i = 0; i < 1000000; ++i) out << i << ",row number " << i << " of the table read while its select is still running\n";
+    }
+
+    json copyReq = json::object();
+    copyReq["queryDefinition"] = json::object({{"sourceFilepath", csvPath}, {"destinationTableName", tableName}, {"doesCsvContainHeader", true}});
+    cpr::Response copyResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{copyReq.dump()});
+    if (copyResp.status_code != 200) fail("testResultOfRunningQuery: copy submit failed: " + copyResp.text);
+    std::string copyStatus = pollQueryStatus(json::parse(copyResp.text).get<std::string>(), 300);
+    if (copyStatus != "COMPLETED") fail("testResultOfRunningQuery: copy did not complete: " + copyStatus);
+
+    // A single worker and several string functions per row keep the SELECT
+    // running long enough to be observed; its result is readable meanwhile.
+    json text = json::object({{"tableName", tableName}, {"columnName", "text"}});
+    json upper = json::object({{"functionName", "UPPER"}, {"arguments", json::array({text})}});
+    json selectReq = json::object();
+    selectReq["queryDefinition"] = json::object({
+        {"columnClauses", json::array({
+            json::object({{"tableName", tableName}, {"columnName", "id"}}),
+            upper,
+            json::object({{"functionName", "LOWER"}, {"arguments", json::array({upper})}}),
+            json::object({{"functionName", "REPLACE"}, {"arguments", json::array({text, json::object({{"value", "row"}}), json::object({{"value", "ROW"}})})}}),
+            json::object({{"functionName", "CONCAT"}, {"arguments", json::array({text, text})}})
+        })},
+        {"parallelism", 1}
+    });
+    json partial;
+    std::string selectQid;
+    for (int attempt = 0; attempt < 3 && partial.is_null(); ++attempt) {
+        cpr::Response selectResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{selectReq.dump()});
+        if (selectResp.status_code != 200) fail("testResultOfRunningQuery: select submit failed: " + selectResp.text);
+        selectQid = json::parse(selectResp.text).get<std::string>();
+        for (int i = 0; i < 2000; ++i) {
+            std::string status = queryStatus(selectQid);
+            if (status == "COMPLETED" || status == "FAILED") break;
+            if (status == "RUNNING") {
+                cpr::Response res = cpr::Get(cpr::Url{BASE_URL + "/result/" + selectQid}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{"{\"flushResult\": true}"});
+                if (res.status_code != 200) fail("testResultOfRunningQuery: GET /result of a running query failed: " + res.text);
+                json results = json::parse(res.text);
+                if (!results.is_array() || results.empty()) fail("testResultOfRunningQuery: running result should be a page with nextOffset: " + res.text);
+                partial = results[0];
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        if (pollQueryStatus(selectQid, 300) != "COMPLETED") fail("testResultOfRunningQuery: select did not complete");
+    }
+    if (partial.is_null()) fail("testResultOfRunningQuery: select was never observed running");
+
+    int rowCount = partial["rowCount"].get<int>();
+    if (!partial.contains("nextOffset") || partial["nextOffset"] != rowCount) fail("testResultOfRunningQuery: running result should report nextOffset: " + partial.dump().substr(0, 200));
+
+    // flushResult does not remove a result that is still being written, and
+    // the rows read early are the start of the final result.
+    json getReq = json::object({{"rowLimit", std::max(rowCount, 1)}, {"flushResult", true}});
+    cpr::Response full = cpr::Get(cpr::Url{BASE_URL + "/result/" + selectQid}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{getReq.dump()});
+    if (full.status_code != 200) fail("testResultOfRunningQuery: GET /result failed: " + full.text);
+    json finished = json::parse(full.text);
+    if (!finished.is_array() || finished.empty()) fail("testResultOfRunningQuery: final result is empty");
+    if (rowCount > 0 && finished[0]["columns"] != partial["columns"]) {
+        fail("testResultOfRunningQuery: rows read while running differ from the final result");
+    }
+
+    if (!tableId.empty()) cpr::Response del = cpr::Delete(cpr::Url{BASE_URL + "/table/" + tableId});
+    std::filesystem::remove(csvPath);
+}
+
+static std::string createAndCopy(const std::string &test, const std::string &tableName, const json &columns, const std::string &csvPath) {
+    json createBody = json::object({{tableName, json::object({{"columns", columns}})}});
+    cpr::Response r = cpr::Put(cpr::Url{BASE_URL + "/table"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{createBody.dump()});
+    if (r.status_code != 200) fail(test + ": create table failed: " + r.text);
+    std::string tableId = json::parse(r.text).get<std::string>();
+
+    json destinationColumns = json::array();
+    for (const auto &column : columns.items()) destinationColumns.push_back(column.key());
+    json copyReq = json::object();
+    copyReq["queryDefinition"] = json::object({{"sourceFilepath", csvPath}, {"destinationTableName", tableName}, {"doesCsvContainHeader", true}, {"destinationColumns", destinationColumns}});
+    cpr::Response copyResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{copyReq.dump()});
+    if (copyResp.status_code != 200) fail(test + ": copy submit failed: " + copyResp.text);
+    std::string copyStatus = pollQueryStatus(json::parse(copyResp.text).get<std::string>(), 100);
+    if (copyStatus != "COMPLETED") fail(test + ": copy did not complete: " + copyStatus);
+    return tableId;
+}
+
+// Runs a SELECT to completion and returns its columns; a query without rows
+// gives an empty array.
+static json selectColumns(const std::string &test, const json &queryDefinition) {
+    json selectReq = json::object({{"queryDefinition", queryDefinition}});
+    cpr::Response selectResp = cpr::Post(cpr::Url{BASE_URL + "/query"}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{selectReq.dump()});
+    if (selectResp.status_code != 200) fail(test + ": select submit failed: " + selectResp.text);
+    std::string selectQid = json::parse(selectResp.text).get<std::string>();
+    std::string selectStatus = pollQueryStatus(selectQid, 100);
+    if (selectStatus != "COMPLETED") fail(test + ": select did not complete: " + selectStatus);
+
+    cpr::Response res = cpr::Get(cpr::Url{BASE_URL + "/result/" + selectQid}, cpr::Header{{"Content-Type","application/json"}}, cpr::Body{"{}"});
+    if (res.status_code != 200) fail(test + ": GET /result failed: " + res.text);
+    json results = json::parse(res.text);
+    if (!results.is_array()) fail(test + ": result is not an array: " + res.text.substr(0, 200));
+    return results.empty() ? json::array() : results[0]["columns"];
+}
+
+static void compareColumns(const std::string &test, const json &columns, const json &expected, const std::vector<std::string> &names) {
+    if (columns.size() != expected.size()) fail(test + ": expected " + std::to_string(expected.size()) + " columns but got " + std::to_string(columns.size()));
+    for (size_t c = 0; c < expected.size(); ++c) {
+        if (columns[c].size() != expected[c].size()) fail(test + ": column " + names[c] + " has " + std::to_string(columns[c].size()) + " rows instead of " + std::to_string(expected[c].size()));
+        for (size_t row = 0; row < expected[c].size(); ++row) {
+            if (columns[c][row] != expected[c][row]) fail(test + ": column " + names[c] + " row " + std::to_string(row) + " is " + columns[c][row].dump() + " instead of " + expected[c][row].dump());
+        }
+    }
+}
+
+void testIntegerCodecs(){
+    std::string tableName = "icodec_" + std::to_string(::time(nullptr));
+    const int64_t lo = std::numeric_limits<int64_t>::min();
+    const int64_t hi = std::numeric_limits<int64_t>::max();
+    // Three chunks of 8192 rows; each column is shaped so that the writer
+    // picks a different codec: constant, RLE, delta, delta-of-delta,
+    // bit-packed, and runs and mixes of INT64_MIN and INT64_MAX.
+    std::vector<std::string> names = {"id", "constant", "runs", "increasing", "quadratic", "small", "extremes", "mixed"};
+    json expected = json::array();
+    for (size_t c = 0; c < names.size(); ++c) expected.push_back(json::array());
+    for (int64_t i = 0; i < 3 * 8192; ++i) {
+        expected[0].push_back(i);
+        expected[1].push_back(42);
+        expected[2].push_back((i / 1000) * 1000003);
+        expected[3].push_back(i * 3 + 7);
+        expected[4].push_back(i * i + 1000);
+        expected[5].push_back((i * 7919) % 1000);
+        expected[6].push_back((i / 100) % 2 ? hi : lo);
+        expected[7].push_back(i % 3 == 0 ? lo : i % 3 == 1 ? hi : i);
+    }
+
+    std::string csvPath = std::string("../data/") + tableName + ".csv";
+    {
+        std::ofstream out(csvPath);
+        for (size_t c = 0; c < names.size(); ++c) out << (c ? "," : "") << names[c];
+        out << "\n";
+        for (size_t row = 0; row < expected[0].size(); ++row) {
+            for (size_t c = 0; c < names.size(); ++c) out << (c ? "," : "") << expected[c][row].get<int64_t>();
+            out << "\n";
+        }
+    }
+
+    json columns = json::object();
+    json columnClauses = json::array();
+    for (const auto &name : names) {
+        columns[name] = "INT64";
+        columnClauses.push_back(json::object({{"tableName", tableName}, {"columnName", name}}));
+    }
+    std::string tableId = createAndCopy("testIntegerCodecs", tableName, columns, csvPath);
+
+    json result = selectColumns("testIntegerCodecs", json::object({
+        {"columnClauses", columnClauses},
+        {"orderByClauses", json::array({json::object({{"columnIndex", 0}, {"ascending", true}})})}
+    }));
+    compareColumns("testIntegerCodecs", result, expected, names);
+
+    if (!tableId.empty()) cpr::Response del = cpr::Delete(cpr::Url{BASE_URL + "/table/" + tableId});
+    std::filesystem::remove(csvPath);
+}
+
+void testStringCodecs(){
+    std::string tableName = "scodec_" + std::to_string(::time(nullptr));
+    const std::string nul("nul\0byte", 8);
+    // kind repeats five values and is dictionary encoded, note is long
+    // repetitive text kept as zstd offsets, and mail is short distinct text
+    // compressed with FSST. All three hold an empty string and a value with
+    // an embedded NUL.
+    const std::vector<std::string> kinds = {"alpha", "beta", "gamma", "", nul};
+    const char *domains[] = {"gmail.com", "example.org", "mail.pl", "wp.pl"};
+    std::vector<std::string> kind, note, mail;
+    for (size_t i = 0; i < 3 * 8192; ++i) {
+        kind.push_back(kinds[i % kinds.size()]);
+        std::string text = "order " + std::to_string(i) + " shipped from the central warehouse and packed in a standard box then delivered by courier within two business days";
+        note.push_back(i % 1000 == 0 ? std::string() : i % 1000 == 1 ? nul : text);
+        size_t h = i * 2654435761u % 1000000007u;
+        std::string address = "user" + std::to_string(h % 100000) + "@" + domains[h % 4];
+        mail.push_back(i % 997 == 0 ? std::string() : i % 997 == 1 ? nul : address);
+    }
+
+    std::string csvPath = std::string("../data/") + tableName + ".csv";
+    {
+        std::ofstream out(csvPath, std::ios::binary);
+        out << "id,kind,note,mail\n";
+        for (size_t i = 0; i < kind.size(); ++i) out << i << "," << kind[i] << "," << note[i] << "," << mail[i] << "\n";
+    }
+    json columns = json::object({{"id", "INT64"}, {"kind", "VARCHAR"}, {"note", "VARCHAR"}, {"mail", "VARCHAR"}});
+    std::string tableId = createAndCopy("testStringCodecs", tableName, columns, csvPath);
+
+    auto ref = [&](const std::string &column) { return json::object({{"tableName", tableName}, {"columnName", column}}); };
+    json byId = json::array({json::object({{"columnIndex", 0}, {"ascending", true}})});
+    json all = selectColumns("testStringCodecs", json::object({
+        {"columnClauses", json::array({ref("id"), ref("kind"), ref("note"), ref("mail")})},
+        {"orderByClauses", byId}
+    }));
+    json expected = json::array({json::array(), kind, note, mail});
+    for (size_t i = 0; i < kind.size(); ++i) expected[0].push_back(i);
+    compareColumns("testStringCodecs", all, expected, {"id", "kind", "note", "mail"});
+
+    // Equality and prefix ranges are answered on dictionary codes for kind
+    // and on the compressed values for mail; the expected ids come from
+    // comparing the source strings byte by byte.
+    auto compare = [&](const std::string &op, const std::string &column, const std::string &value) {
+        return json::object({{"operator", op}, {"leftOperand", ref(column)}, {"rightOperand", json::object({{"value", value}})}});
+    };
+    auto prefix = [&](const std::string &column, const std::string &from, const std::string &to) {
+        return json::object({{"operator", "AND"}, {"leftOperand", compare("GREATER_EQUAL", column, from)}, {"rightOperand", compare("LESS_THAN", column, to)}});
+    };
+    struct Check { std::string label; json where; std::function<bool(size_t)> match; };
+    const std::string picked = mail[12345];
+    std::vector<Check> checks = {
+        {"kind = beta", compare("EQUAL", "kind", "beta"), [&](size_t i) { return kind[i] == "beta"; }},
+        {"kind = empty", compare("EQUAL", "kind", ""), [&](size_t i) { return kind[i].empty(); }},
+        {"kind = NUL value", compare("EQUAL", "kind", nul), [&](size_t i) { return kind[i] == nul; }},
+        {"kind prefix b", prefix("kind", "b", "c"), [&](size_t i) { return kind[i] >= "b" && kind[i] < "c"; }},
+        {"note = empty", compare("EQUAL", "note", ""), [&](size_t i) { return note[i].empty(); }},
+        {"mail = picked", compare("EQUAL", "mail", picked), [&](size_t i) { return mail[i] == picked; }},
+        {"mail <> picked", compare("NOT_EQUAL", "mail", picked), [&](size_t i) { return mail[i] != picked; }},
+        {"mail = empty", compare("EQUAL", "mail", ""), [&](size_t i) { return mail[i].empty(); }},
+        {"mail = NUL value", compare("EQUAL", "mail", nul), [&](size_t i) { return mail[i] == nul; }},
+        {"mail prefix user12", prefix("mail", "user12", "user13"), [&](size_t i) { return mail[i] >= "user12" && mail[i] < "user13"; }},
+    };
+    for (const auto &check : checks) {
+        json ids = json::array();
+        for (size_t i = 0; i < kind.size(); ++i) if (check.match(i)) ids.push_back(i);
+        json result = selectColumns("testStringCodecs", json::object({
+            {"columnClauses", json::array({ref("id")})},
+            {"whereClause", check.where},
+            {"orderByClauses", byId}
+        }));
+        json wanted = ids.empty() ? json::array() : json::array({ids});
+        if (result != wanted) fail("testStringCodecs: " + check.label + " returned " + result.dump().substr(0, 200) + " instead of " + std::to_string(ids.size()) + " rows");
+    }
+
+    if (!tableId.empty()) cpr::Response del = cpr::Delete(cpr::Url{BASE_URL + "/table/" + tableId});
+    std::filesystem::remove(csvPath);
+}
+
+void testTrainedDictionaryAfterRestart(){
+    std::string tableName = "zdict_" + std::to_string(::time(nullptr));
+    // The first COPY into a table trains a zstd dictionary for name; its
+    // chunks can only be read back if the server finds the dictionary file
+    // again after a restart.
+    json expected = json::array({json::array(), json::array()});
+    for (size_t i = 0; i < 3 * 8192; ++i) {
+        expected[0].push_back(i);
+        expected[1].push_back("user" + std::to_string(i * 2654435761u % 1000000007u));
+    }
+    std::string csvPath = std::string("../data/") + tableName + ".csv";
+    {
+        std::ofstream out(csvPath);
+        out << "id,name\n";
+        for (size_t i = 0; i < expected[0].size(); ++i) out << i << "," << expected[1][i].get<std::string>() << "\n";
+    }
+    json columns = json::object({{"id", "INT64"}, {"name", "VARCHAR"}});
+    std::string tableId = createAndCopy("testTrainedDictionaryAfterRestart", tableName, columns, csvPath);
+
+    const char *command = std::getenv("ISBD_RESTART_COMMAND");
+    std::string restart = command ? command : "docker restart isbd-container";
+    if (std::system(restart.c_str()) != 0) fail("testTrainedDictionaryAfterRestart: restart command failed: " + restart);
+    bool up = false;
+    for (int i = 0; i < 100 && !up; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        up = cpr::Get(cpr::Url{BASE_URL + "/system/info"}).status_code == 200;
+    }
+    if (!up) fail("testTrainedDictionaryAfterRestart: server did not come back after restart");
+
+    json result = selectColumns("testTrainedDictionaryAfterRestart", json::object({
+        {"columnClauses", json::array({
+            json::object({{"tableName", tableName}, {"columnName", "id"}}),
+            json::object({{"tableName", tableName}, {"columnName", "name"}})
+        })},
+        {"orderByClauses", json::array({json::object({{"columnIndex", 0}, {"ascending", true}})})}
+    }));
+    compareColumns("testTrainedDictionaryAfterRestart", result, expected, {"id", "name"});
 
     if (!tableId.empty()) cpr::Response del = cpr::Delete(cpr::Url{BASE_URL + "/table/" + tableId});
+    std::filesystem::remove(csvPath);
 }
 
 void cleanupTestFiles() {
@@ -611,7 +1028,7 @@ void cleanupTestFiles() {
                 if (!p.is_regular_file()) continue;
                 std::string fname = p.path().filename().string();
                 if (p.path().extension() != ".csv") continue;
-                if (fname.rfind("ct_", 0) == 0 || fname.rfind("qe_", 0) == 0 || fname.rfind("qr_", 0) == 0 || fname.rfind("not_exists_", 0) == 0 || fname.rfind("rlfr_", 0) == 0) {
+                if (fname.rfind("ct_", 0) == 0 || fname.rfind("qe_", 0) == 0 || fname.rfind("qr_", 0) == 0 || fname.rfind("not_exists_", 0) == 0 || fname.rfind("rlfr_", 0) == 0 || fname.rfind("obl_", 0) == 0 || fname.rfind("grp_", 0) == 0 || fname.rfind("run_", 0) == 0 || fname.rfind("icodec_", 0) == 0 || fname.rfind("scodec_", 0) == 0 || fname.rfind("zdict_", 0) == 0) {
                     fs::remove(p.path());
                 }
             } catch (const std::exception &e) {
@@ -688,6 +1105,21 @@ int main() {
     std::cout << "[test-runner] testRowLimitAndFlushResult()" << std::endl;
     testRowLimitAndFlushResult();
 
+    std::cout << "[test-runner] testOrderByWithLimit()" << std::endl;
+    testOrderByWithLimit();
+
+    std::cout << "[test-runner] testGroupByAggregates()" << std::endl;
+    testGroupByAggregates();
+
+    std::cout << "[test-runner] testResultOfRunningQuery()" << std::endl;
+    testResultOfRunningQuery();
+
+    std::cout << "[test-runner] testIntegerCodecs()" << std::endl;
+    testIntegerCodecs();
+
+    std::cout << "[test-runner] testStringCodecs()" << std::endl;
+    testStringCodecs();
+
     std::cout << "[test-runner] getQueryResultWithInccorectQueryId()" << std::endl;
     getQueryResultWithInccorectQueryId();
 
@@ -706,6 +1138,10 @@ int main() {
     std::cout << "[test-runner] getQueryByInvalidID()" << std::endl;
     getQueryByInvalidID();
 
+    // Restarts the server, so it runs after every other test.
+    std::cout << "[test-runner] testTrainedDictionaryAfterRestart()" << std::endl;
+    testTrainedDictionaryAfterRestart();
+
     cleanupTestFiles();
     std::cout << "[test-runner] ALL TESTS COMPLETED" << std::endl;
 }
@@ -2,11 +2,13 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <cstddef>
 #include <filesystem>
 #include <variant>
 #include <optional>
+#include <memory>
 
 #include "query/selectQuery.h"
 
@@ -15,8 +17,24 @@ inline constexpr int PORT = 8080;
 inline constexpr size_t BATCH_SIZE = 8192;
 inline constexpr size_t BATCH_NUMBER = 10;
 inline constexpr int compresion_level = 3;
+inline constexpr size_t ZSTD_DICTIONARY_BYTES = 16 * 1024;
+inline constexpr size_t ZSTD_DICTIONARY_SAMPLE_BYTES = 1024 * 1024;
 inline constexpr uint32_t file_magic = 0x21374201;
+inline constexpr uint32_t file_magic_v2 = 0x21374202;
+inline constexpr uint32_t file_magic_v3 = 0x21374203;
+inline constexpr uint32_t file_magic_v4 = 0x21374204;
+inline constexpr uint32_t file_magic_v5 = 0x21374205;
+inline constexpr uint32_t file_magic_v6 = 0x21374206;
+inline constexpr size_t STATS_PREFIX_LEN = 8;
 inline constexpr uint32_t batch_magic = 0x69696969;
+inline constexpr uint32_t run_magic = 0x52554E01;
+inline constexpr size_t RUN_BLOCK_BYTES = 1024 * 1024;
+inline constexpr size_t PARALLEL_SORT_MIN_ROWS = 32768;
+inline constexpr size_t DEFAULT_COPY_WORKERS = 1;
+inline constexpr size_t DEFAULT_SELECT_WORKERS = 4;
+inline constexpr size_t DEFAULT_QUERY_QUEUE_DEPTH = 64;
+inline constexpr size_t PART_FILE_CACHE_ENTRIES = 1024;
+inline constexpr size_t DEFAULT_BUFFER_POOL_BYTES = 256 * 1024 * 1024;
 static constexpr uint8_t INTEGER = 0;
 static constexpr uint8_t STRING  = 1;
 static constexpr uint64_t PART_LIMIT = 3500ULL * 1024ULL * 1024ULL;
@@ -34,7 +52,8 @@ enum class SELECT_TABLE_ERROR {
     TABLE_NOT_EXISTS,
     INVALID_WHERE,
     INVALID_ORDER_BY,
-    INVALID_LIMIT
+    INVALID_LIMIT,
+    INVALID_GROUP_BY
 };
 
 struct Problem {
@@ -52,6 +71,7 @@ using Column = std::variant<std::vector<int64_t>, std::vector<std::string>, std:
 struct QueryResult {
     int rowCount;
     std::vector<Column> columns;
+    std::optional<size_t> nextOffset;
 };
 
 struct QueryError {
@@ -67,14 +87,44 @@ struct IntColumn {
     vector<int64_t> column;
 };
 
+struct SymbolTable;
+
+// The scan may keep a chunk compact instead of one string per row: either as
+// its sorted distinct values plus one code per row, or as one buffer with row
+// i at [offsets[i], offsets[i + 1]). With symbols set, that buffer holds the
+// FSST-compressed values. column is then left empty (see materializeStrings).
 struct StringColumn {
     string name;
     vector<string> column;
+    std::shared_ptr<const vector<string>> dictionary;
+    vector<uint32_t> codes;
+    std::shared_ptr<const string> data;
+    vector<uint32_t> offsets;
+    std::shared_ptr<const SymbolTable> symbols;
+
+    size_t rowCount() const {
+        if (dictionary) return codes.size();
+        if (data) return offsets.empty() ? 0 : offsets.size() - 1;
+        return column.size();
+    }
+};
+
+struct ChunkStats {
+    bool valid = false;
+    uint64_t rowCount = 0;
+    int64_t intMin = 0;
+    int64_t intMax = 0;
+    string strMin;
+    string strMax;
 };
 
 struct Batch {
     vector<IntColumn> intColumns;
     vector<StringColumn> stringColumns;
+    // Chunks the scan reads in place from the buffer pool; holding them keeps
+    // the chunks pinned until the batch is dropped.
+    vector<std::shared_ptr<const IntColumn>> sharedIntColumns;
+    vector<std::shared_ptr<const StringColumn>> sharedStringColumns;
     size_t num_rows;
 };
 
@@ -85,9 +135,78 @@ struct CopyQuery {
     bool doesCsvContainHeader;
 };
 
+// Typed column of an intermediate result: INT64 cells live in `ints`,
+// VARCHAR cells in `bytes` delimited by end offsets, BOOL cells in `bits`.
 struct ColumnData {
-    ValueType type;
-    std::vector<Value> data;
+    ValueType type = ValueType::INT64;
+    std::vector<int64_t> ints;
+    std::vector<uint64_t> offsets;
+    std::string bytes;
+    std::vector<uint64_t> bits;
+    size_t count = 0;
+
+    size_t size() const { return count; }
+
+    void reserve(size_t n) {
+        switch (type) {
+            case ValueType::INT64: ints.reserve(n); break;
+            case ValueType::VARCHAR: offsets.reserve(n); break;
+            case ValueType::BOOL: bits.reserve((n + 63) / 64); break;
+        }
+    }
+
+    void appendInt(int64_t v) { ints.push_back(v); count++; }
+
+    void appendString(std::string_view v) {
+        bytes.append(v.data(), v.size());
+        offsets.push_back(bytes.size());
+        count++;
+    }
+
+    void appendBool(bool v) {
+        if (count % 64 == 0) bits.push_back(0);
+        if (v) bits.back() |= (uint64_t)1 << (count % 64);
+        count++;
+    }
+
+    void append(const Value &v) {
+        switch (type) {
+            case ValueType::INT64: appendInt(v.intValue); break;
+            case ValueType::VARCHAR: appendString(v.stringValue); break;
+            case ValueType::BOOL: appendBool(v.boolValue); break;
+        }
+    }
+
+    void appendFrom(const ColumnData &other, size_t row) {
+        switch (type) {
+            case ValueType::INT64: appendInt(other.intAt(row)); break;
+            case ValueType::VARCHAR: appendString(other.stringAt(row)); break;
+            case ValueType::BOOL: appendBool(other.boolAt(row)); break;
+        }
+    }
+
+    int64_t intAt(size_t i) const { return ints[i]; }
+
+    std::string_view stringAt(size_t i) const {
+        uint64_t begin = i ? offsets[i - 1] : 0;
+        return std::string_view(bytes.data() + begin, offsets[i] - begin);
+    }
+
+    bool boolAt(size_t i) const { return (bits[i / 64] >> (i % 64)) & 1; }
+
+    Value valueAt(size_t i) const {
+        switch (type) {
+            case ValueType::INT64: return Value{ValueType::INT64, intAt(i), std::string(), false};
+            case ValueType::VARCHAR: return Value{ValueType::VARCHAR, 0, std::string(stringAt(i)), false};
+            case ValueType::BOOL: return Value{ValueType::BOOL, 0, std::string(), boolAt(i)};
+        }
+        return Value{ValueType::INT64, 0, std::string(), false};
+    }
+
+    size_t memoryBytes() const {
+        return sizeof(*this) + ints.capacity() * sizeof(int64_t) + offsets.capacity() * sizeof(uint64_t)
+            + bytes.capacity() + bits.capacity() * sizeof(uint64_t);
+    }
 };
 
 struct MixBatch {
@@ -98,6 +98,7 @@ json prepareQueryResponse(const QueryResponse &response) {
                 std::string qid = entry.value("queryId", std::string());
                 if (qid == response.queryId && entry.contains("queryDefinition")) {
                     json_info["queryDefinition"] = entry["queryDefinition"];
+                    if (entry.contains("statistics")) json_info["statistics"] = entry["statistics"];
                     return json_info;
                 }
             }
@@ -138,6 +139,7 @@ json prepareQueryResultResponse(const QueryResult& response) {
         json colJson = std::visit(ColumnToJson{}, col);
         j["columns"].push_back(colJson);
     }
+    if (response.nextOffset.has_value()) j["nextOffset"] = *response.nextOffset;
 
     return j;
 }
@@ -201,6 +203,34 @@ string handleCsvError(const std::string &query_id, CSV_TABLE_ERROR code) {
     return error.dump();
 }
 
+string handleSelectError(const std::string &query_id, const std::string &tableName, SELECT_TABLE_ERROR code) {
+    changeStatus(query_id, QueryStatus::FAILED);
+    std::string msg;
+    switch (code) {
+        case SELECT_TABLE_ERROR::TABLE_NOT_EXISTS:
+            msg = "Table " + tableName + " does not exist";
+            break;
+        case SELECT_TABLE_ERROR::INVALID_WHERE:
+            msg = "Invalid expression in query";
+            break;
+        case SELECT_TABLE_ERROR::INVALID_ORDER_BY:
+            msg = "Invalid ORDER BY clause";
+            break;
+        case SELECT_TABLE_ERROR::INVALID_LIMIT:
+            msg = "Invalid LIMIT clause";
+            break;
+        case SELECT_TABLE_ERROR::INVALID_GROUP_BY:
+            msg = "Invalid GROUP BY or aggregate";
+            break;
+        default:
+            msg = "Unexpected error";
+            break;
+    }
+    json error = createErrorResponse(msg);
+    addError(query_id, error);
+    return error.dump();
+}
+
 QueryType recogniseQuery(const json &query) {
     if (!query.is_object() || !query.contains("queryDefinition")) return QueryType::ERROR;
     const json &def = query["queryDefinition"];
@@ -404,7 +434,7 @@ bool validateCreateTableRequest(const json &parsed, json &out_create, std::vecto
     return false;
 }
 
-bool parseResultRequestBody(const std::string &json_body, int &rowLimit, bool &flushResult, json &errorOrParsed) {
+bool parseResultRequestBody(const std::string &json_body, int &rowLimit, size_t &offset, bool &flushResult, json &errorOrParsed) {
     if (json_body.empty()) return true;
 
     try {
@@ -412,6 +442,9 @@ bool parseResultRequestBody(const std::string &json_body, int &rowLimit, bool &f
         if (parsed.contains("rowLimit") && parsed["rowLimit"].is_number_integer()) {
             rowLimit = parsed["rowLimit"].get<int>();
         }
+        if (parsed.contains("offset") && parsed["offset"].is_number_unsigned()) {
+            offset = parsed["offset"].get<size_t>();
+        }
         if (parsed.contains("flushResult") && parsed["flushResult"].is_boolean()) {
             flushResult = parsed["flushResult"].get<bool>();
         }
@@ -445,6 +478,12 @@ void removeFiles(const std::string &Path, const std::vector<std::string> &file_n
     }
 }
 
+std::string partFilePath(const std::string &location, const std::string &file) {
+    std::string path = location;
+    if (!path.empty() && path.back() != '/' && path.back() != '\\') path.push_back('/');
+    return path + file;
+}
+
 std::vector<std::string> findDuplicateColumns(const json &cols) {
     std::vector<std::string> dupes;
     if (!cols.is_object()) return dupes;
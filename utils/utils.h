@@ -39,6 +39,8 @@ json errorResponse(const vector<Problem>& messages);
 
 string handleCsvError(const std::string &query_id, CSV_TABLE_ERROR code); 
 
+string handleSelectError(const std::string &query_id, const std::string &tableName, SELECT_TABLE_ERROR code);
+
 QueryType recogniseQuery(const json &query);
 
 string generateID();
@@ -62,9 +64,10 @@ json readLocalFile(const std::filesystem::path &basePath);
 void saveFile(const std::filesystem::path &basePath, json results);
 
 void removeFiles(const std::string &Path, const std::vector<std::string> &file_names);
+std::string partFilePath(const std::string &location, const std::string &file);
 
 vector<string> findDuplicateColumns(const json &cols);
 
 bool validateCreateTableRequest(const json &parsed, json &out_create, std::vector<Problem> &problems);
 
-bool parseResultRequestBody(const std::string &json_body, int &rowLimit, bool &flushResult, json &errorOrParsed);
\ No newline at end of file
+bool parseResultRequestBody(const std::string &json_body, int &rowLimit, size_t &offset, bool &flushResult, json &errorOrParsed);
\ No newline at end of file